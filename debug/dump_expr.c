@@ -84,7 +84,7 @@ void dump_expr(FILE *fp, Expr *expr) {
       sb_append(&sb, "\"", NULL);
       escape_string(expr->str.buf, expr->str.size, &sb);
       sb_append(&sb, "\"", NULL);
-      fputs(sb_to_string(&sb), fp);
+      fputs(sb_steal(&sb), fp);
     }
     break;
   case EX_VAR:
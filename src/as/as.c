@@ -38,7 +38,8 @@
 #endif
 
 #if defined(UNSUPPORTED)
-int main() {
+int run_as(int argc, char *argv[], FILE *ifp) {
+  (void)argc; (void)argv; (void)ifp;
   fprintf(stderr, "AS: unsupported environment\n");
   return 1;
 }
@@ -52,11 +53,10 @@ void parse_file(FILE *fp, const char *filename, Vector **section_irs, Table *lab
   ParseInfo info;
   info.filename = filename;
   info.lineno = 1;
+  SourceBuffer *src = read_source(fp);
   for (;; ++info.lineno) {
-    char *rawline = NULL;
-    size_t capa = 0;
-    ssize_t len = getline(&rawline, &capa, fp);
-    if (len == -1)
+    char *rawline;
+    if (source_getline(src, &rawline) == -1)
       break;
     info.rawline = rawline;
 
@@ -94,15 +94,6 @@ static void put_padding(FILE *fp, uintptr_t start) {
   }
 }
 
-static void drop_all(FILE *fp) {
-  for (;;) {
-    char buf[4096];
-    size_t size = fread(buf, 1, sizeof(buf), fp);
-    if (size < sizeof(buf))
-      break;
-  }
-}
-
 #if !defined(__NO_ELF_OBJ)
 static void putnum(FILE *fp, unsigned long num, int bytes) {
   for (int i = 0; i < bytes; ++i) {
@@ -153,8 +144,6 @@ static int output_obj(const char *ofn, Table *label_table, Vector *unresolved) {
     ofp = fopen(ofn, "wb");
     if (ofp == NULL) {
       fprintf(stderr, "Failed to open output file: %s\n", ofn);
-      if (!isatty(STDIN_FILENO))
-        drop_all(stdin);
       return 1;
     }
   }
@@ -432,6 +421,7 @@ static int output_obj(const char *ofn, Table *label_table, Vector *unresolved) {
     fseek(ofp, 0x28, SEEK_SET);
     putnum(ofp, sh_ofs, 8);
   }
+  fclose(ofp);
 
   return 0;
 }
@@ -458,8 +448,6 @@ static int output_exe(const char *ofn, Table *label_table) {
     fp = fopen(ofn, "wb");
     if (fp == NULL) {
       fprintf(stderr, "Failed to open output file: %s\n", ofn);
-      if (!isatty(STDIN_FILENO))
-        drop_all(stdin);
       return 1;
     }
   }
@@ -505,7 +493,9 @@ static int output_exe(const char *ofn, Table *label_table) {
 
 // ================================================
 
-int main(int argc, char *argv[]) {
+static const char TIME_REPORT[] = "--time-report";
+
+int run_as(int argc, char *argv[], FILE *ifp) {
   const char *ofn = NULL;
   bool out_obj = false;
   int iarg;
@@ -521,6 +511,13 @@ int main(int argc, char *argv[]) {
     } else if (strcmp(arg, "-c") == 0) {
       out_obj = true;
 #endif
+    } else if (starts_with(arg, TIME_REPORT) &&
+               (arg[sizeof(TIME_REPORT) - 1] == '\0' || arg[sizeof(TIME_REPORT) - 1] == '=')) {
+      const char *output = arg[sizeof(TIME_REPORT) - 1] == '=' ? &arg[sizeof(TIME_REPORT)] : NULL;
+      if (!init_time_report("as", output)) {
+        fprintf(stderr, "option not supported: %s\n", arg);
+        return 1;
+      }
     } else if (strcmp(arg, "--version") == 0) {
       show_version("as");
       return 0;
@@ -548,6 +545,7 @@ int main(int argc, char *argv[]) {
   for (int i = 0; i < SECTION_COUNT; ++i)
     section_irs[i] = new_vector();
 
+  time_report_begin("parse_file");
   if (iarg < argc) {
     for (int i = iarg; i < argc; ++i) {
       FILE *fp = fopen(argv[i], "r");
@@ -559,20 +557,26 @@ int main(int argc, char *argv[]) {
         break;
     }
   } else {
-    parse_file(stdin, "*stdin*", section_irs, &label_table);
+    parse_file(ifp, "*stdin*", section_irs, &label_table);
   }
+  time_report_end();
 
   if (!out_obj)
     section_aligns[SEC_DATA] = DATA_ALIGN;
 
   Vector *unresolved = out_obj ? new_vector() : NULL;
   if (!err) {
+    time_report_begin("calc_label_address");
     bool settle1, settle2;
     do {
       settle1 = calc_label_address(LOAD_ADDRESS, section_irs, &label_table);
       settle2 = resolve_relative_address(section_irs, &label_table, unresolved);
     } while (!(settle1 && settle2));
+    time_report_end();
+
+    time_report_begin("emit_irs");
     emit_irs(section_irs, &label_table);
+    time_report_end();
   }
 
   if (err) {
@@ -581,6 +585,7 @@ int main(int argc, char *argv[]) {
 
   fix_section_size(LOAD_ADDRESS);
 
+  time_report_begin("output_elf");
   int result;
 #if !defined(__NO_ELF_OBJ)
   if (out_obj) {
@@ -590,7 +595,9 @@ int main(int argc, char *argv[]) {
   {
     result = output_exe(ofn, &label_table);
   }
+  time_report_end();
 
+  finish_time_report();
   return result;
 }
 #endif
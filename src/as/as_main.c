@@ -0,0 +1,7 @@
+#include <stdio.h>
+
+extern int run_as(int argc, char *argv[], FILE *ifp);
+
+int main(int argc, char *argv[]) {
+  return run_as(argc, argv, stdin);
+}
@@ -42,7 +42,7 @@ static bool opr_reg8(const Reg *reg) {
 }
 
 static bool assemble_error(const ParseInfo *info, const char *message) {
-  parse_error(info, message);
+  asm_parse_error(info, message);
   return false;
 }
 
@@ -1132,6 +1132,20 @@ bool assemble_inst(Inst *inst, const ParseInfo *info, Code *code) {
   case CVTSS2SD:
     p = assemble_cvtsd2ss(inst, code, true);
     break;
+
+  case MOVAPS:
+    if (inst->src.type == REG_XMM && inst->dst.type == REG_XMM) {
+      unsigned char sno = inst->src.regxmm - XMM0;
+      unsigned char dno = inst->dst.regxmm - XMM0;
+      short buf[] = {
+        sno >= 8 || dno >= 8 ? (unsigned char)0x40 | ((sno & 8) >> 3) | ((dno & 8) >> 1) : -1,
+        0x0f,
+        0x28,
+        (unsigned char)0xc0 | ((dno & 7) << 3) | (sno & 7),
+      };
+      p = put_code_filtered(p, buf, ARRAY_SIZE(buf));
+    }
+    break;
 #endif
   default:
     break;
@@ -107,6 +107,8 @@ enum Opcode {
 
   CVTSD2SS,
   CVTSS2SD,
+
+  MOVAPS,
 #endif
 };
 
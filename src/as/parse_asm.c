@@ -116,6 +116,8 @@ static const char *kOpTable[] = {
 
   "cvtsd2ss",
   "cvtss2sd",
+
+  "movaps",
 #endif
 };
 
@@ -226,7 +228,7 @@ static const char *kDirectiveTable[] = {
 
 bool err;
 
-void parse_error(const ParseInfo *info, const char *message) {
+void asm_parse_error(const ParseInfo *info, const char *message) {
   fprintf(stderr, "%s(%d): %s\n", info->filename, info->lineno, message);
   fprintf(stderr, "%s\n", info->rawline);
   err = true;
@@ -406,7 +408,7 @@ static enum RegType parse_direct_register(ParseInfo *info, Operand *operand) {
     size = REG64;
     no = reg - RAX;
   } else {
-    parse_error(info, "Illegal register");
+    asm_parse_error(info, "Illegal register");
     return false;
   }
 
@@ -428,23 +430,23 @@ static bool parse_indirect_register(ParseInfo *info, Expr *offset, Operand *oper
     info->p = skip_whitespaces(info->p + 1);
     if (*info->p != '%' ||
         (++info->p, index_reg = find_register(&info->p), !is_reg64(index_reg)))
-      parse_error(info, "Register expected");
+      asm_parse_error(info, "Register expected");
     info->p = skip_whitespaces(info->p);
     if (*info->p == ',') {
       info->p = skip_whitespaces(info->p + 1);
       scale = parse_expr(info);
       if (scale->kind != EX_FIXNUM)
-        parse_error(info, "constant value expected");
+        asm_parse_error(info, "constant value expected");
       info->p = skip_whitespaces(info->p);
     }
   }
   if (*info->p != ')')
-    parse_error(info, "`)' expected");
+    asm_parse_error(info, "`)' expected");
   else
     ++info->p;
 
   if (!(is_reg64(base_reg) || (base_reg == RIP && index_reg == NOREG)))
-    parse_error(info, "Register expected1");
+    asm_parse_error(info, "Register expected1");
 
   if (index_reg == NOREG) {
     char no = base_reg - RAX;
@@ -455,7 +457,7 @@ static bool parse_indirect_register(ParseInfo *info, Expr *offset, Operand *oper
     operand->indirect.offset = offset;
   } else {
     if (!is_reg64(index_reg))
-      parse_error(info, "Register expected2");
+      asm_parse_error(info, "Register expected2");
 
     operand->type = INDIRECT_WITH_INDEX;
     operand->indirect_with_index.offset = offset;
@@ -476,7 +478,7 @@ static bool parse_indirect_register(ParseInfo *info, Expr *offset, Operand *oper
 static enum RegType parse_deref_register(ParseInfo *info, Operand *operand) {
   enum RegType reg = find_register(&info->p);
   if (!is_reg64(reg))
-    parse_error(info, "Illegal register");
+    asm_parse_error(info, "Illegal register");
 
   char no = reg - RAX;
   operand->type = DEREF_REG;
@@ -670,7 +672,7 @@ static Expr *parse_mul(ParseInfo *info) {
          (tok = match(info, TK_DIV)) != NULL) {
     Expr *rhs = unary(info);
     if (rhs == NULL) {
-      parse_error(info, "expression error");
+      asm_parse_error(info, "expression error");
       break;
     }
 
@@ -700,7 +702,7 @@ static Expr *parse_add(ParseInfo *info) {
          (tok = match(info, TK_SUB)) != NULL) {
     Expr *rhs = parse_mul(info);
     if (rhs == NULL) {
-      parse_error(info, "expression error");
+      asm_parse_error(info, "expression error");
       break;
     }
 
@@ -741,7 +743,7 @@ static bool parse_operand(ParseInfo *info, Operand *operand) {
   if (*p == '$') {
     info->p = p + 1;
     if (!immediate(&info->p, &operand->immediate))
-      parse_error(info, "Syntax error");
+      asm_parse_error(info, "Syntax error");
     operand->type = IMMEDIATE;
     return true;
   }
@@ -755,7 +757,7 @@ static bool parse_operand(ParseInfo *info, Operand *operand) {
         operand->direct.expr = expr;
         return true;
       }
-      parse_error(info, "direct number not implemented");
+      asm_parse_error(info, "direct number not implemented");
     }
   } else {
     if (info->p[1] == '%') {
@@ -767,7 +769,7 @@ static bool parse_operand(ParseInfo *info, Operand *operand) {
       }
       return parse_indirect_register(info, expr, operand);
     }
-    parse_error(info, "Illegal `('");
+    asm_parse_error(info, "Illegal `('");
   }
 
   return false;
@@ -801,7 +803,7 @@ Line *parse_line(ParseInfo *info) {
   line->label = parse_label(info);
   if (line->label != NULL) {
     if (*info->p != ':') {
-      parse_error(info, "`:' required after label");
+      asm_parse_error(info, "`:' required after label");
       return NULL;
     }
     ++info->p;
@@ -812,14 +814,14 @@ Line *parse_line(ParseInfo *info) {
     ++info->p;
     enum DirectiveType dir = find_directive(info);
     if (dir == NODIRECTIVE) {
-      parse_error(info, "Unknown directive");
+      asm_parse_error(info, "Unknown directive");
       return NULL;
     }
     line->dir = dir;
   } else if (*info->p != '\0') {
     parse_inst(info, &line->inst);
     if (*info->p != '\0' && !(*info->p == '/' && info->p[1] == '/')) {
-      parse_error(info, "Syntax error");
+      asm_parse_error(info, "Syntax error");
       err = true;
     }
   }
@@ -844,7 +846,7 @@ static size_t unescape_string(ParseInfo *info, const char *p, char *dst) {
   for (; *p != '"'; ++p, ++len) {
     char c = *p;
     if (c == '\0')
-      parse_error(info, "string not closed");
+      asm_parse_error(info, "string not closed");
     if (c == '\\') {
       // TODO: Handle \x...
       c = unescape_char(*(++p));
@@ -863,7 +865,7 @@ void handle_directive(ParseInfo *info, enum DirectiveType dir, Vector **section_
   case DT_ASCII:
     {
       if (*info->p != '"')
-        parse_error(info, "`\"' expected");
+        asm_parse_error(info, "`\"' expected");
       ++info->p;
       size_t len = unescape_string(info, info->p, NULL);
       char *str = malloc(len);
@@ -877,14 +879,14 @@ void handle_directive(ParseInfo *info, enum DirectiveType dir, Vector **section_
     {
       const Name *label = parse_label(info);
       if (label == NULL)
-        parse_error(info, ".comm: label expected");
+        asm_parse_error(info, ".comm: label expected");
       info->p = skip_whitespaces(info->p);
       if (*info->p != ',')
-        parse_error(info, ".comm: `,' expected");
+        asm_parse_error(info, ".comm: `,' expected");
       info->p = skip_whitespaces(info->p + 1);
       long count;
       if (!immediate(&info->p, &count)) {
-        parse_error(info, ".comm: count expected");
+        asm_parse_error(info, ".comm: count expected");
         return;
       }
 
@@ -892,7 +894,7 @@ void handle_directive(ParseInfo *info, enum DirectiveType dir, Vector **section_
       if (*info->p == ',') {
         info->p = skip_whitespaces(info->p + 1);
         if (!immediate(&info->p, &align) || align < 1) {
-          parse_error(info, ".comm: optional alignment expected");
+          asm_parse_error(info, ".comm: optional alignment expected");
           return;
         }
       }
@@ -921,7 +923,7 @@ void handle_directive(ParseInfo *info, enum DirectiveType dir, Vector **section_
     {
       long align;
       if (!immediate(&info->p, &align))
-        parse_error(info, ".align: number expected");
+        asm_parse_error(info, ".align: number expected");
       vec_push(irs, new_ir_align(align));
     }
     break;
@@ -933,7 +935,7 @@ void handle_directive(ParseInfo *info, enum DirectiveType dir, Vector **section_
     {
       Expr *expr = parse_expr(info);
       if (expr == NULL) {
-        parse_error(info, "expression expected");
+        asm_parse_error(info, "expression expected");
         break;
       }
 
@@ -960,7 +962,7 @@ void handle_directive(ParseInfo *info, enum DirectiveType dir, Vector **section_
     {
       Expr *expr = parse_expr(info);
       if (expr == NULL) {
-        parse_error(info, "expression expected");
+        asm_parse_error(info, "expression expected");
         break;
       }
 
@@ -990,7 +992,7 @@ void handle_directive(ParseInfo *info, enum DirectiveType dir, Vector **section_
     {
       const Name *label = parse_label(info);
       if (label == NULL) {
-        parse_error(info, ".globl: label expected");
+        asm_parse_error(info, ".globl: label expected");
         return;
       }
 
@@ -1003,13 +1005,13 @@ void handle_directive(ParseInfo *info, enum DirectiveType dir, Vector **section_
     {
       const Name *name = parse_section_name(info);
       if (name == NULL) {
-        parse_error(info, ".section: section name expected");
+        asm_parse_error(info, ".section: section name expected");
         return;
       }
       if (equal_name(name, alloc_name(".rodata", NULL, false))) {
         current_section = SEC_RODATA;
       } else {
-        parse_error(info, "Unknown section name");
+        asm_parse_error(info, "Unknown section name");
         return;
       }
     }
@@ -1019,7 +1021,7 @@ void handle_directive(ParseInfo *info, enum DirectiveType dir, Vector **section_
     break;
 
   default:
-    parse_error(info, "Unhandled directive");
+    asm_parse_error(info, "Unhandled directive");
     break;
   }
 }
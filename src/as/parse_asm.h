@@ -33,4 +33,4 @@ extern bool err;
 Line *parse_line(ParseInfo *info);
 void handle_directive(ParseInfo *info, enum DirectiveType dir, Vector **section_irs,
                       Table *label_table);
-void parse_error(const ParseInfo *info, const char *message);
+void asm_parse_error(const ParseInfo *info, const char *message);
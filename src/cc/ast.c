@@ -1,11 +1,12 @@
 #include "ast.h"
 
 #include <assert.h>
-#include <stdlib.h>  // malloc
 
 #include "type.h"
 #include "util.h"
 
+static Arena ast_arena;  // AST nodes are kept until the end.
+
 bool is_const(Expr *expr) {
   // TODO: Handle constant variable.
 
@@ -26,7 +27,7 @@ bool is_zero(Expr *expr) {
 }
 
 static Expr *new_expr(enum ExprKind kind, const Type *type, const Token *token) {
-  Expr *expr = malloc(sizeof(*expr));
+  Expr *expr = arena_alloc(&ast_arena, sizeof(*expr));
   expr->kind = kind;
   expr->type = type;
   expr->token = token;
@@ -50,7 +51,7 @@ Expr *new_expr_flolit(const Type *type, const Token *token, double flonum) {
 #endif
 
 Expr *new_expr_str(const Token *token, const char *str, ssize_t size) {
-  Type *type = malloc(sizeof(*type));
+  Type *type = arena_alloc(&ast_arena, sizeof(*type));
   type->kind = TY_ARRAY;
   type->qualifier = TQ_CONST;
   type->pa.ptrof = &tyChar;
@@ -129,7 +130,7 @@ Expr *new_expr_complit(const Type *type, const Token *token, Expr *var, Vector *
 // ================================================
 
 VarDecl *new_vardecl(const Type *type, const Token *ident, Initializer *init, int storage) {
-  VarDecl *decl = malloc(sizeof(*decl));
+  VarDecl *decl = arena_alloc(&ast_arena, sizeof(*decl));
   decl->type = type;
   decl->ident = ident;
   decl->init = init;
@@ -138,7 +139,7 @@ VarDecl *new_vardecl(const Type *type, const Token *ident, Initializer *init, in
 }
 
 Stmt *new_stmt(enum StmtKind kind, const Token *token) {
-  Stmt *stmt = malloc(sizeof(Stmt));
+  Stmt *stmt = arena_alloc(&ast_arena, sizeof(Stmt));
   stmt->kind = kind;
   stmt->token = token;
   return stmt;
@@ -246,7 +247,7 @@ Stmt *new_stmt_asm(const Token *token, Expr *str) {
 //
 
 static Declaration *new_decl(enum DeclKind kind) {
-  Declaration *decl = malloc(sizeof(*decl));
+  Declaration *decl = arena_alloc(&ast_arena, sizeof(*decl));
   decl->kind = kind;
   return decl;
 }
@@ -269,7 +270,7 @@ Declaration *new_decl_vardecl(Vector *decls) {
 
 Function *new_func(const Type *type, const Name *name) {
   assert(type->kind == TY_FUNC);
-  Function *func = malloc(sizeof(*func));
+  Function *func = arena_alloc(&ast_arena, sizeof(*func));
   func->type = type;
   func->name = name;
 
@@ -282,6 +283,8 @@ Function *new_func(const Type *type, const Name *name) {
   func->bbcon = NULL;
   func->ret_bb = NULL;
   func->retval = NULL;
+  func->ir_arena = NULL;
+  func->eliminated_ir_count = 0;
 
   return func;
 }
@@ -7,6 +7,7 @@
 #include <stdint.h>  // intptr_t
 #include <sys/types.h>  // ssize_t
 
+typedef struct Arena Arena;
 typedef struct BB BB;
 typedef struct BBContainer BBContainer;
 typedef struct Name Name;
@@ -287,6 +288,8 @@ typedef struct Function {
   BBContainer *bbcon;
   BB *ret_bb;
   VReg *retval;
+  Arena *ir_arena;  // Holds IR, BBs and registers, released after the function is emitted.
+  int eliminated_ir_count;  // by `optimize`
 } Function;
 
 Function *new_func(const Type *type, const Name *name);
@@ -3,11 +3,14 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "ast.h"
 #include "codegen.h"
+#include "codegen_thread.h"
 #include "emit.h"
 #include "emit_code.h"
 #include "ir_debug.h"
 #include "lexer.h"
+#include "optimize.h"
 #include "parser.h"
 #include "type.h"
 #include "util.h"
@@ -32,16 +35,67 @@ static void init_compiler(FILE *ofp) {
   install_builtins();
 }
 
-static void compile1(FILE *ifp, const char *filename, Vector *decls) {
+static void compile1(FILE *ifp, const char *filename, Vector *decls, DeclHandler handler) {
   set_source_file(ifp, filename);
-  parse(decls);
+  parse(decls, handler);
+}
+
+// Generates and emits a function just after it is parsed, and releases its IR,
+// so that memory for IR is bounded by the largest function instead of the whole file.
+// Global variables are left in `toplevel`, because later declarations can complete them.
+static bool gen_emit_defun(Declaration *decl) {
+  if (decl->kind != DCL_DEFUN)
+    return false;
+
+  time_report_begin("gen");
+  gen_decl(decl);
+  time_report_end();
+
+  time_report_begin("emit_code");
+  emit_decl(decl);
+  time_report_end();
+  return true;
+}
+
+// Same as above, but registers are allocated and code is emitted on worker threads.
+static bool gen_queue_defun(Declaration *decl) {
+  if (decl->kind != DCL_DEFUN)
+    return false;
+
+  Function *func = decl->defun.func;
+  if (func->scopes == NULL)  // Prototype definition
+    return true;
+
+  time_report_begin("gen");
+  gen_defun(func);
+  time_report_end();
+
+  // Workers report their time as `alloc_physical_registers` and `emit_code`,
+  // and the main thread's waiting for them and writing out is charged here.
+  time_report_begin("wait_codegen");
+  queue_defun(func);
+  time_report_end();
+  return true;
+}
+
+static bool warmed_up;
+
+// Parse declarations (e.g. system headers) in advance, and keep them for following `run_cc1`.
+void warm_up_cc1(FILE *ifp, const char *filename) {
+  init_compiler(NULL);
+  toplevel = new_vector();
+  compile1(ifp, filename, toplevel, NULL);
+  warmed_up = true;
 }
 
 static const char LOCAL_LABEL_PREFIX[] = "--local-label-prefix=";
+static const char TIME_REPORT[] = "--time-report";
+static const char THREADS[] = "--threads=";
 
-int main(int argc, char *argv[]) {
+int run_cc1(int argc, char *argv[], FILE *ifp, FILE *ofp) {
   int iarg;
   bool dump_ir = false;
+  int threads = -1;
 
   for (iarg = 1; iarg < argc; ++iarg) {
     char *arg = argv[iarg];
@@ -57,6 +111,17 @@ int main(int argc, char *argv[]) {
       fprintf(stderr, "option not supported: %s\n", arg);
       return 1;
 #endif
+    } else if (starts_with(arg, TIME_REPORT) &&
+               (arg[sizeof(TIME_REPORT) - 1] == '\0' || arg[sizeof(TIME_REPORT) - 1] == '=')) {
+      const char *output = arg[sizeof(TIME_REPORT) - 1] == '=' ? &arg[sizeof(TIME_REPORT)] : NULL;
+      if (!init_time_report("cc1", output)) {
+        fprintf(stderr, "option not supported: %s\n", arg);
+        return 1;
+      }
+    } else if (starts_with(arg, THREADS)) {
+      threads = atoi(&arg[sizeof(THREADS) - 1]);
+    } else if (starts_with(arg, "-O")) {
+      optimize_level = arg[2] == '\0' ? 1 : atoi(&arg[2]);
     } else if (strcmp(arg, "--version") == 0) {
       show_version("cc1");
       return 0;
@@ -67,30 +132,56 @@ int main(int argc, char *argv[]) {
   }
 
   // Compile.
-  init_compiler(stdout);
+  if (warmed_up) {
+    init_emit(ofp);
+  } else {
+    init_compiler(ofp);
+    toplevel = new_vector();
+  }
 
-  toplevel = new_vector();
+  // IR is kept for all functions to dump.
+  DeclHandler handler = NULL;
+  if (!dump_ir) {
+    if (threads < 0)
+      threads = default_codegen_threads();
+    handler = start_codegen_threads(threads, ofp) ? gen_queue_defun : gen_emit_defun;
+  }
+  time_report_begin("parse");
   if (iarg < argc) {
     for (int i = iarg; i < argc; ++i) {
       const char *filename = argv[i];
       FILE *ifp = fopen(filename, "r");
       if (ifp == NULL)
         error("Cannot open file: %s\n", filename);
-      compile1(ifp, filename, toplevel);
+      compile1(ifp, filename, toplevel, handler);
       fclose(ifp);
     }
   } else {
-    compile1(stdin, "*stdin*", toplevel);
+    compile1(ifp, "*stdin*", toplevel, handler);
   }
+  time_report_end();
+
+  // Functions are written before global variables, as without threads.
+  if (handler == gen_queue_defun) {
+    time_report_begin("wait_codegen");
+    stop_codegen_threads();
+    time_report_end();
+  }
+
+  time_report_begin("gen");
   gen(toplevel);
+  time_report_end();
 
   if (!dump_ir) {
+    time_report_begin("emit_code");
     emit_code(toplevel);
+    time_report_end();
   } else {
 #if !defined(SELF_HOSTING) && !defined(__XV6)
     do_dump_ir(toplevel);
 #endif
   }
 
+  finish_time_report();
   return 0;
 }
@@ -0,0 +1,7 @@
+#include <stdio.h>
+
+extern int run_cc1(int argc, char *argv[], FILE *ifp, FILE *ofp);
+
+int main(int argc, char *argv[]) {
+  return run_cc1(argc, argv, stdin, stdout);
+}
@@ -10,6 +10,7 @@
 #include "ast.h"
 #include "ir.h"
 #include "lexer.h"
+#include "optimize.h"
 #include "regalloc.h"
 #include "table.h"
 #include "type.h"
@@ -446,11 +447,12 @@ void gen_stmt(Stmt *stmt) {
 
 ////////////////////////////////////////////////
 
-static void gen_defun(Function *func) {
+void gen_defun(Function *func) {
   if (func->scopes == NULL)  // Prototype definition
     return;
 
   curfunc = func;
+  func->ir_arena = ir_arena = calloc(1, sizeof(*ir_arena));
   func->bbcon = new_func_blocks();
   set_curbb(new_bb());
   func->ra = curra = new_reg_alloc(PHYSICAL_REG_MAX);
@@ -481,15 +483,42 @@ static void gen_defun(Function *func) {
   set_curbb(func->ret_bb);
   curbb = NULL;
 
+  curfunc = NULL;
+  curscope = global_scope;
+  curra = NULL;
+  ir_arena = NULL;
+}
+
+void alloc_defun_registers(Function *func) {
+  if (func->scopes == NULL)  // Prototype definition
+    return;
+
+  ir_arena = func->ir_arena;
+  if (optimize_level > 0) {
+    curra = func->ra;
+    optimize(func);
+    curra = NULL;
+  }
   prepare_register_allocation(func);
   convert_3to2(func->bbcon);
   alloc_physical_registers(func->ra, func->bbcon);
-
   remove_unnecessary_bb(func->bbcon);
+  ir_arena = NULL;
+}
 
-  curfunc = NULL;
-  curscope = global_scope;
-  curra = NULL;
+void release_defun(Function *func) {
+  if (func->ir_arena == NULL)
+    return;
+
+  free_func_blocks(func->bbcon);
+  free_vector(func->ra->vregs);
+  arena_release(func->ir_arena);
+  free(func->ir_arena);
+  func->ir_arena = NULL;
+  func->ra = NULL;
+  func->bbcon = NULL;
+  func->ret_bb = NULL;
+  func->retval = NULL;
 }
 
 void gen_decl(Declaration *decl) {
@@ -499,6 +528,9 @@ void gen_decl(Declaration *decl) {
   switch (decl->kind) {
   case DCL_DEFUN:
     gen_defun(decl->defun.func);
+    time_report_begin("alloc_physical_registers");
+    alloc_defun_registers(decl->defun.func);
+    time_report_end();
     break;
   case DCL_VARDECL:
     break;
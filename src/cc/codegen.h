@@ -6,7 +6,9 @@
 #include <stddef.h>  // size_t
 
 typedef struct BB BB;
+typedef struct Declaration Declaration;
 typedef struct Expr Expr;
+typedef struct Function Function;
 typedef struct StructInfo StructInfo;
 typedef struct Type Type;
 typedef struct VReg VReg;
@@ -19,6 +21,13 @@ extern const char RET_VAR_NAME[];
 // Public
 
 void gen(Vector *decls);
+void gen_decl(Declaration *decl);
+// Generates IR for the function, which `gen_decl` does before allocating registers.
+void gen_defun(Function *func);
+// Touches only IR of the function, so it can run on another thread.
+void alloc_defun_registers(Function *func);
+// Releases IR of the function at once, after it is emitted.
+void release_defun(Function *func);
 
 // Private
 
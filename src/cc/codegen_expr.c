@@ -15,7 +15,7 @@
 #include "parser.h"  // curfunc
 
 VRegType *to_vtype(const Type *type) {
-  VRegType *vtype = malloc(sizeof(*vtype));
+  VRegType *vtype = arena_alloc(ir_arena, sizeof(*vtype));
   vtype->size = type_size(type);
   vtype->align = align_size(type);
 
@@ -29,6 +29,8 @@ VRegType *to_vtype(const Type *type) {
 #endif
   if (is_unsigned)
     flag |= VRTF_UNSIGNED;
+  if (type->qualifier & TQ_VOLATILE)
+    flag |= VRTF_VOLATILE;
   vtype->flag = flag;
 
   return vtype;
@@ -0,0 +1,212 @@
+#include "codegen_thread.h"
+
+#if !defined(SELF_HOSTING) && !defined(__XV6)
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>  // malloc
+#include <time.h>  // clock_gettime
+#include <unistd.h>  // sysconf
+
+#include "ast.h"
+#include "codegen.h"
+#include "emit.h"
+#include "emit_code.h"
+#include "util.h"
+
+#define MAX_THREADS  (8)
+#define JOBS_PER_THREAD  (2)  // Bounds functions in flight, to keep memory for IR small.
+
+// Parsing and IR generation stay on the main thread, because they share names, labels,
+// scopes and types.  Workers take a function with its own IR arena, allocate registers
+// and emit its code into a memory buffer, which the main thread writes out in order.
+typedef struct {
+  Function *func;
+  bool global;
+  bool done;
+  char *buf;
+  size_t size;
+  // Time taken on the worker, reported by the main thread.
+  double alloc_wall, alloc_cpu;
+  double emit_wall, emit_cpu;
+} Job;
+
+static struct {
+  pthread_t threads[MAX_THREADS];
+  int thread_count;
+  pthread_mutex_t mutex;
+  pthread_cond_t queued;  // A job is queued, or workers are stopped.
+  pthread_cond_t done;    // A job is done.
+  bool stop;
+
+  // Ring buffer, indices are not wrapped:
+  //   [head, next): taken by workers, [next, tail): waiting.
+  Job *jobs;
+  int capacity;
+  int head, next, tail;
+
+  FILE *ofp;
+} pool;
+
+static double clock_sec(clockid_t clk) {
+  struct timespec ts;
+  clock_gettime(clk, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void run_job(Job *job) {
+  double wall0 = clock_sec(CLOCK_MONOTONIC), cpu0 = clock_sec(CLOCK_THREAD_CPUTIME_ID);
+  alloc_defun_registers(job->func);
+  double wall1 = clock_sec(CLOCK_MONOTONIC), cpu1 = clock_sec(CLOCK_THREAD_CPUTIME_ID);
+
+  FILE *fp = open_memstream(&job->buf, &job->size);
+  init_emit(fp);
+  emit_defun_code(job->func, job->global);
+  fclose(fp);
+
+  job->alloc_wall = wall1 - wall0;
+  job->alloc_cpu = cpu1 - cpu0;
+  job->emit_wall = clock_sec(CLOCK_MONOTONIC) - wall1;
+  job->emit_cpu = clock_sec(CLOCK_THREAD_CPUTIME_ID) - cpu1;
+}
+
+static void *worker(void *arg) {
+  UNUSED(arg);
+  pthread_mutex_lock(&pool.mutex);
+  for (;;) {
+    while (pool.next == pool.tail && !pool.stop)
+      pthread_cond_wait(&pool.queued, &pool.mutex);
+    if (pool.next == pool.tail)
+      break;
+
+    Job *job = &pool.jobs[pool.next++ % pool.capacity];
+    pthread_mutex_unlock(&pool.mutex);
+    run_job(job);
+    pthread_mutex_lock(&pool.mutex);
+    job->done = true;
+    pthread_cond_signal(&pool.done);
+  }
+  pthread_mutex_unlock(&pool.mutex);
+  return NULL;
+}
+
+static void write_job(Job *job) {
+  time_report_add("alloc_physical_registers", job->alloc_wall, job->alloc_cpu);
+  time_report_add("emit_code", job->emit_wall, job->emit_cpu);
+  fwrite(job->buf, 1, job->size, pool.ofp);
+  free(job->buf);
+  emit_defun_statics(job->func);
+  release_defun(job->func);
+}
+
+// Writes out finished jobs from the head.  Waits for unfinished ones if `all` is set,
+// or if the buffer is full.
+static void write_jobs(bool all) {
+  pthread_mutex_lock(&pool.mutex);
+  while (pool.head != pool.tail) {
+    Job *job = &pool.jobs[pool.head % pool.capacity];
+    if (!job->done) {
+      if (!all && pool.tail - pool.head < pool.capacity)
+        break;
+      pthread_cond_wait(&pool.done, &pool.mutex);
+      continue;
+    }
+    // Workers never touch a job after it is done.
+    pthread_mutex_unlock(&pool.mutex);
+    write_job(job);
+    pthread_mutex_lock(&pool.mutex);
+    ++pool.head;
+  }
+  pthread_mutex_unlock(&pool.mutex);
+}
+
+int default_codegen_threads(void) {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n < 1 ? 1 : n > MAX_THREADS ? MAX_THREADS : (int)n;
+}
+
+bool start_codegen_threads(int count, FILE *ofp) {
+  assert(pool.thread_count == 0);
+  if (count > MAX_THREADS)
+    count = MAX_THREADS;
+  if (count <= 1)
+    return false;
+
+  pthread_mutex_init(&pool.mutex, NULL);
+  pthread_cond_init(&pool.queued, NULL);
+  pthread_cond_init(&pool.done, NULL);
+  pool.stop = false;
+  pool.capacity = count * JOBS_PER_THREAD;
+  pool.jobs = malloc(sizeof(*pool.jobs) * pool.capacity);
+  pool.head = pool.next = pool.tail = 0;
+  pool.ofp = ofp;
+
+  for (int i = 0; i < count; ++i) {
+    if (pthread_create(&pool.threads[i], NULL, worker, NULL) != 0)
+      break;
+    ++pool.thread_count;
+  }
+  if (pool.thread_count > 0)
+    return true;
+
+  free(pool.jobs);
+  return false;
+}
+
+void stop_codegen_threads(void) {
+  if (pool.thread_count <= 0)
+    return;
+
+  write_jobs(true);
+  pthread_mutex_lock(&pool.mutex);
+  pool.stop = true;
+  pthread_cond_broadcast(&pool.queued);
+  pthread_mutex_unlock(&pool.mutex);
+  for (int i = 0; i < pool.thread_count; ++i)
+    pthread_join(pool.threads[i], NULL);
+  pool.thread_count = 0;
+
+  pthread_cond_destroy(&pool.done);
+  pthread_cond_destroy(&pool.queued);
+  pthread_mutex_destroy(&pool.mutex);
+  free(pool.jobs);
+  pool.jobs = NULL;
+}
+
+void queue_defun(Function *func) {
+  assert(pool.thread_count > 0);
+  assert(func->scopes != NULL);
+  bool global = is_global_func(func);  // Looks up the global scope, so done here.
+
+  write_jobs(false);
+
+  pthread_mutex_lock(&pool.mutex);
+  Job *job = &pool.jobs[pool.tail++ % pool.capacity];
+  job->func = func;
+  job->global = global;
+  job->done = false;
+  job->buf = NULL;
+  job->size = 0;
+  pthread_cond_signal(&pool.queued);
+  pthread_mutex_unlock(&pool.mutex);
+}
+
+#else
+
+int default_codegen_threads(void) {
+  return 1;
+}
+
+bool start_codegen_threads(int count, FILE *ofp) {
+  (void)count; (void)ofp;
+  return false;
+}
+
+void stop_codegen_threads(void) {
+}
+
+void queue_defun(Function *func) {
+  (void)func;
+}
+
+#endif
@@ -0,0 +1,18 @@
+// Register allocation and code emission on worker threads
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdio.h>  // FILE
+
+typedef struct Function Function;
+
+int default_codegen_threads(void);
+// Returns false if threads are not available, then functions should be handled in place.
+bool start_codegen_threads(int count, FILE *ofp);
+// Writes out all queued functions before stopping.
+void stop_codegen_threads(void);
+
+// Queues a function after its IR is generated.  Code for queued functions is written to
+// `ofp` in the order of queueing, and IR of each function is released after it.
+void queue_defun(Function *func);
@@ -12,11 +12,11 @@
 #define MANGLE_PREFIX  "_"
 #endif
 
-static FILE *emit_fp;
+static THREAD_LOCAL FILE *emit_fp;
 
 char *fmt(const char *s, ...) {
-  static char buf[4][64];
-  static int index;
+  static THREAD_LOCAL char buf[4][64];
+  static THREAD_LOCAL int index;
   char *p = buf[index];
   if (++index >= 4)
     index = 0;
@@ -165,7 +165,7 @@ static void construct_initial_value(const Type *type, const Initializer *init) {
             sb_append(&sb, NULCHR, NULL);
         }
         sb_append(&sb, "\"", NULL);
-        _ASCII(sb_to_string(&sb));
+        _ASCII(sb_steal(&sb));
       } else {
         error("Illegal initializer");
       }
@@ -269,11 +269,6 @@ static bool is_asm(Stmt *stmt) {
   return stmt->kind == ST_ASM;
 }
 
-static VarInfo *find_ret_var(Scope *scope) {
-  const Name *retval_name = alloc_name(RET_VAR_NAME, NULL, false);
-  return scope_find(scope, retval_name, NULL);
-}
-
 static void put_args_to_stack(Function *func) {
   static const char *kReg8s[] = {DIL, SIL, DL, CL, R8B, R9B};
   static const char *kReg16s[] = {DI, SI, DX, CX, R8W, R9W};
@@ -286,15 +281,9 @@ static void put_args_to_stack(Function *func) {
 
   int arg_index = 0;
   if (is_stack_param(func->type->func.ret)) {
-    Scope *top_scope = func->scopes->data[0];
-    VarInfo *varinfo = find_ret_var(top_scope);
-    assert(varinfo != NULL);
-    const Type *type = varinfo->type;
-    int size = type_size(type);
-    int offset = varinfo->local.reg->offset;
-    assert(size < (int)(sizeof(kRegTable) / sizeof(*kRegTable)) &&
-           kRegTable[size] != NULL);
-    MOV(kRegTable[size][0], OFFSET_INDIRECT(offset, RBP, NULL, 1));
+    // Pointer to the return value.
+    assert(func->retval != NULL);
+    MOV(kReg64s[0], OFFSET_INDIRECT(func->retval->offset, RBP, NULL, 1));
     ++arg_index;
   }
 
@@ -356,21 +345,18 @@ static void put_args_to_stack(Function *func) {
   }
 }
 
-static void emit_defun(Function *func) {
-  if (func->scopes == NULL)  // Prototype definition
-    return;
+bool is_global_func(const Function *func) {
+  const VarInfo *varinfo = scope_find(global_scope, func->name, NULL);
+  return varinfo == NULL || (varinfo->storage & VS_STATIC) == 0;
+}
 
+void emit_defun_code(Function *func, bool global) {
+  assert(func->scopes != NULL);
   assert(stackpos == 8);
 
   emit_comment(NULL);
   _TEXT();
 
-  bool global = true;
-  const VarInfo *varinfo = scope_find(global_scope, func->name, NULL);
-  if (varinfo != NULL) {
-    global = (varinfo->storage & VS_STATIC) == 0;
-  }
-
   const char *label = fmt_name(func->name);
   if (global) {
     const char *gl = MANGLE(label);
@@ -423,7 +409,10 @@ static void emit_defun(Function *func) {
 
   RET();
 
-  // Output static local variables.
+  assert(stackpos == 8);
+}
+
+void emit_defun_statics(Function *func) {
   for (int i = 0; i < func->scopes->len; ++i) {
     Scope *scope = func->scopes->data[i];
     if (scope->vars == NULL)
@@ -437,40 +426,47 @@ static void emit_defun(Function *func) {
       emit_varinfo(gvarinfo, gvarinfo->global.init);
     }
   }
-
-  assert(stackpos == 8);
 }
 
-void emit_code(Vector *decls) {
-  for (int i = 0, len = decls->len; i < len; ++i) {
-    Declaration *decl = decls->data[i];
-    if (decl == NULL)
-      continue;
-
-    switch (decl->kind) {
-    case DCL_DEFUN:
-      emit_defun(decl->defun.func);
-      break;
-    case DCL_VARDECL:
-      {
-        emit_comment(NULL);
-        Vector *decls = decl->vardecl.decls;
-        for (int i = 0; i < decls->len; ++i) {
-          VarDecl *vd = decls->data[i];
-          if ((vd->storage & VS_EXTERN) != 0)
-            continue;
-          const Name *name = vd->ident->ident;
-          const VarInfo *varinfo = scope_find(global_scope, name, NULL);
-          assert(varinfo != NULL);
+void emit_decl(Declaration *decl) {
+  if (decl == NULL)
+    return;
 
-          emit_varinfo(varinfo, varinfo->global.init);
-        }
+  switch (decl->kind) {
+  case DCL_DEFUN:
+    {
+      Function *func = decl->defun.func;
+      if (func->scopes != NULL) {  // Not a prototype definition.
+        emit_defun_code(func, is_global_func(func));
+        emit_defun_statics(func);
       }
-      break;
+      release_defun(func);
+    }
+    break;
+  case DCL_VARDECL:
+    {
+      emit_comment(NULL);
+      Vector *decls = decl->vardecl.decls;
+      for (int i = 0; i < decls->len; ++i) {
+        VarDecl *vd = decls->data[i];
+        if ((vd->storage & VS_EXTERN) != 0)
+          continue;
+        const Name *name = vd->ident->ident;
+        const VarInfo *varinfo = scope_find(global_scope, name, NULL);
+        assert(varinfo != NULL);
 
-    default:
-      error("Unhandled decl in emit_code: %d", decl->kind);
-      break;
+        emit_varinfo(varinfo, varinfo->global.init);
+      }
     }
+    break;
+
+  default:
+    error("Unhandled decl in emit_code: %d", decl->kind);
+    break;
   }
 }
+
+void emit_code(Vector *decls) {
+  for (int i = 0, len = decls->len; i < len; ++i)
+    emit_decl(decls->data[i]);
+}
@@ -2,6 +2,17 @@
 
 #pragma once
 
+#include <stdbool.h>
+
+typedef struct Declaration Declaration;
+typedef struct Function Function;
 typedef struct Vector Vector;
 
 void emit_code(Vector *decls);
+void emit_decl(Declaration *decl);
+
+// `emit_decl` for a function is split into these, so that the code can be emitted on
+// another thread: it touches only the function itself, unlike the others.
+bool is_global_func(const Function *func);
+void emit_defun_code(Function *func, bool global);
+void emit_defun_statics(Function *func);  // Static local variables.
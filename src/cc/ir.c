@@ -16,7 +16,7 @@ static void pop_caller_save_regs(unsigned short living);
 static VRegType vtVoidPtr = {.size = WORD_SIZE, .align = WORD_SIZE, .flag = 0};
 static VRegType vtBool    = {.size = 4, .align = 4, .flag = 0};
 
-int stackpos = 8;
+THREAD_LOCAL int stackpos = 8;
 
 static enum ConditionKind invert_cond(enum ConditionKind cond) {
   assert(COND_EQ <= cond && cond <= COND_UGT);
@@ -30,7 +30,7 @@ static enum ConditionKind invert_cond(enum ConditionKind cond) {
 // Virtual register
 
 VReg *new_vreg(int vreg_no, const VRegType *vtype, int flag) {
-  VReg *vreg = malloc(sizeof(*vreg));
+  VReg *vreg = arena_alloc(ir_arena, sizeof(*vreg));
   vreg->virt = vreg_no;
   vreg->phys = -1;
   vreg->fixnum = 0;
@@ -83,12 +83,13 @@ const int kCallerSaveFRegs[] = {0, 1, 2, 3, 4, 5};
 #endif
 
 //
-RegAlloc *curra;
+THREAD_LOCAL RegAlloc *curra;
+THREAD_LOCAL Arena *ir_arena;
 
 // Intermediate Representation
 
 static IR *new_ir(enum IrKind kind) {
-  IR *ir = malloc(sizeof(*ir));
+  IR *ir = arena_alloc(ir_arena, sizeof(*ir));
   ir->kind = kind;
   ir->dst = ir->opr1 = ir->opr2 = NULL;
   ir->size = -1;
@@ -106,7 +107,7 @@ VReg *new_const_vreg(intptr_t value, const VRegType *vtype) {
   return vreg;
 }
 
-static intptr_t clamp_value(intptr_t value, const VRegType *vtype) {
+intptr_t clamp_value(intptr_t value, const VRegType *vtype) {
   if (vtype->flag & VRTF_UNSIGNED) {
     switch (vtype->size) {
     case 1:  value = (unsigned char)value; break;
@@ -317,6 +318,7 @@ void new_ir_incdec(enum IrKind kind, VReg *reg, int size, intptr_t value) {
 VReg *new_ir_cond(enum ConditionKind cond) {
   IR *ir = new_ir(IR_COND);
   ir->cond.kind = cond;
+  ir->size = vtBool.size;
   return ir->dst = reg_alloc_spawn(curra, &vtBool, 0);
 }
 
@@ -387,6 +389,8 @@ void new_ir_memcpy(VReg *dst, VReg *src, int size) {
     ir->opr1 = src;
     ir->opr2 = dst;
     ir->size = size;
+    if (!IS_POWER_OF_2(size) || size > 8)
+      ir->loop.label = alloc_label();
   }
 }
 
@@ -394,6 +398,7 @@ void new_ir_clear(VReg *reg, size_t size) {
   IR *ir = new_ir(IR_CLEAR);
   ir->size = size;
   ir->opr1 = reg;
+  ir->loop.label = alloc_label();
 }
 
 void new_ir_asm(const char *asm_) {
@@ -401,6 +406,17 @@ void new_ir_asm(const char *asm_) {
   ir->asm_.str = asm_;
 }
 
+IR *new_ir_phi(VReg *dst, int arg_count) {
+  assert(curbb == NULL);  // Inserted into a BB by the caller.
+  IR *ir = new_ir(IR_PHI);
+  ir->dst = dst;
+  ir->size = dst->vtype->size;
+  ir->phi.args = arena_alloc(ir_arena, sizeof(*ir->phi.args) * arg_count);
+  for (int i = 0; i < arg_count; ++i)
+    ir->phi.args[i] = dst;
+  return ir;
+}
+
 IR *new_ir_load_spilled(VReg *reg, int offset, int size, int flag) {
   IR *ir = new_ir(IR_LOAD_SPILLED);
   ir->value = offset;
@@ -419,7 +435,7 @@ IR *new_ir_store_spilled(VReg *reg, int offset, int size, int flag) {
   return ir;
 }
 
-static void ir_memcpy(int dst_reg, int src_reg, ssize_t size) {
+static void ir_memcpy(int dst_reg, int src_reg, ssize_t size, const Name *loop) {
   const char *dst = kReg64s[dst_reg];
   const char *src = kReg64s[src_reg];
 
@@ -443,9 +459,9 @@ static void ir_memcpy(int dst_reg, int src_reg, ssize_t size) {
     break;
   default:
     {
-      const Name *name = alloc_label();
-      const char *label = fmt_name(name);
+      const char *label = fmt_name(loop);
       PUSH(src);
+      PUSH(dst);
       MOV(IM(size), RCX);
       EMIT_LABEL(label);
       MOV(INDIRECT(src, NULL, 1), DL);
@@ -454,6 +470,7 @@ static void ir_memcpy(int dst_reg, int src_reg, ssize_t size) {
       INC(dst);
       DEC(RCX);
       JNE(label);
+      POP(dst);
       POP(src);
     }
     break;
@@ -1092,11 +1109,8 @@ static void ir_out(IR *ir) {
 
 #ifndef __NO_FLONUM
       if (ir->dst->vtype->flag & VRTF_FLONUM) {
-        switch (ir->size) {
-        case SZ_FLOAT:   MOVSS(XMM0, kFReg64s[ir->dst->phys]); break;
-        case SZ_DOUBLE:  MOVSD(XMM0, kFReg64s[ir->dst->phys]); break;
-        default: assert(false); break;
-        }
+        assert(ir->size == SZ_FLOAT || ir->size == SZ_DOUBLE);
+        MOVAPS(XMM0, kFReg64s[ir->dst->phys]);
         break;
       }
 #endif
@@ -1113,11 +1127,8 @@ static void ir_out(IR *ir) {
   case IR_RESULT:
 #ifndef __NO_FLONUM
     if (ir->opr1->vtype->flag & VRTF_FLONUM) {
-      switch (ir->size) {
-      case SZ_FLOAT:   MOVSS(kFReg64s[ir->opr1->phys], XMM0); break;
-      case SZ_DOUBLE:  MOVSD(kFReg64s[ir->opr1->phys], XMM0); break;
-      default: assert(false); break;
-      }
+      assert(ir->size == SZ_FLOAT || ir->size == SZ_DOUBLE);
+      MOVAPS(kFReg64s[ir->opr1->phys], XMM0);
       break;
     }
 #endif
@@ -1215,11 +1226,8 @@ static void ir_out(IR *ir) {
 #ifndef __NO_FLONUM
       if (ir->dst->vtype->flag & VRTF_FLONUM) {
         if (ir->opr1->phys != ir->dst->phys) {
-          switch (ir->size) {
-          case SZ_FLOAT:   MOVSS(kFReg64s[ir->opr1->phys], kFReg64s[ir->dst->phys]); break;
-          case SZ_DOUBLE:  MOVSD(kFReg64s[ir->opr1->phys], kFReg64s[ir->dst->phys]); break;
-          default: assert(false); break;
-          }
+          assert(ir->size == SZ_FLOAT || ir->size == SZ_DOUBLE);
+          MOVAPS(kFReg64s[ir->opr1->phys], kFReg64s[ir->dst->phys]);
           break;
         }
       }
@@ -1241,13 +1249,13 @@ static void ir_out(IR *ir) {
   case IR_MEMCPY:
     assert(!(ir->opr1->flag & VRF_CONST));
     assert(!(ir->opr2->flag & VRF_CONST));
-    ir_memcpy(ir->opr2->phys, ir->opr1->phys, ir->size);
+    ir_memcpy(ir->opr2->phys, ir->opr1->phys, ir->size, ir->loop.label);
     break;
 
   case IR_CLEAR:
     {
       assert(!(ir->opr1->flag & VRF_CONST));
-      const char *loop = fmt_name(alloc_label());
+      const char *loop = fmt_name(ir->loop.label);
       MOV(kReg64s[ir->opr1->phys], RSI);
       MOV(IM(ir->size), EDI);
       XOR(AL, AL);
@@ -1313,27 +1321,58 @@ static void ir_out(IR *ir) {
 
 // Basic Block
 
-BB *curbb;
+THREAD_LOCAL BB *curbb;
 
 BB *new_bb(void) {
-  BB *bb = malloc(sizeof(*bb));
+  BB *bb = arena_alloc(ir_arena, sizeof(*bb));
   bb->next = NULL;
   bb->label = alloc_label();
   bb->irs = new_vector();
   bb->in_regs = NULL;
   bb->out_regs = NULL;
   bb->assigned_regs = NULL;
+  bb->index = -1;
+  bb->preds = NULL;
+  bb->succs = NULL;
+  bb->idom = NULL;
+  bb->loop = NULL;
   return bb;
 }
 
 //
 
 BBContainer *new_func_blocks(void) {
-  BBContainer *bbcon = malloc(sizeof(*bbcon));
+  BBContainer *bbcon = arena_alloc(ir_arena, sizeof(*bbcon));
   bbcon->bbs = new_vector();
   return bbcon;
 }
 
+// BBs themselves are in `ir_arena`, so only their vectors are freed.
+static void free_bb_vectors(BB *bb) {
+  Vector *vecs[] = {bb->irs, bb->in_regs, bb->out_regs, bb->assigned_regs, bb->preds, bb->succs};
+  for (int i = 0; i < (int)(sizeof(vecs) / sizeof(*vecs)); ++i) {
+    if (vecs[i] != NULL)
+      free_vector(vecs[i]);
+  }
+}
+
+void remove_bb_at(BBContainer *bbcon, int index) {
+  Vector *bbs = bbcon->bbs;
+  BB *bb = bbs->data[index];
+  if (index > 0) {
+    BB *pbb = bbs->data[index - 1];
+    pbb->next = bb->next;
+  }
+  vec_remove_at(bbs, index);
+  free_bb_vectors(bb);
+}
+
+void free_func_blocks(BBContainer *bbcon) {
+  for (int i = 0; i < bbcon->bbs->len; ++i)
+    free_bb_vectors(bbcon->bbs->data[i]);
+  free_vector(bbcon->bbs);
+}
+
 static IR *is_last_jmp(BB *bb) {
   int len;
   IR *ir;
@@ -1389,12 +1428,7 @@ void remove_unnecessary_bb(BBContainer *bbcon) {
         continue;
       }
 
-      if (i > 0) {
-        BB *pbb = bbs->data[i - 1];
-        pbb->next = bb->next;
-      }
-
-      vec_remove_at(bbs, i);
+      remove_bb_at(bbcon, i);
       --i;
       again = true;
     }
@@ -1523,7 +1557,9 @@ static void three_to_two(BB *bb) {
     case IR_BITNOT:
       {
         assert(!(ir->dst->flag & VRF_CONST));
-        IR *ir2 = malloc(sizeof(*ir2));
+        if (ir->opr1 == ir->dst)
+          break;
+        IR *ir2 = arena_alloc(ir_arena, sizeof(*ir2));
         ir2->kind = IR_MOV;
         ir2->dst = ir->dst;
         ir2->opr1 = ir->opr1;
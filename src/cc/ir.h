@@ -6,7 +6,11 @@
 #include <stddef.h>  // size_t
 #include <stdint.h>  // intptr_t
 
+#include "util.h"  // THREAD_LOCAL
+
+typedef struct Arena Arena;
 typedef struct BB BB;
+typedef struct Loop Loop;
 typedef struct Name Name;
 typedef struct RegAlloc RegAlloc;
 typedef struct Vector Vector;
@@ -27,6 +31,7 @@ typedef struct Vector Vector;
 #ifndef __NO_FLONUM
 #define VRTF_FLONUM    (1 << 1)
 #endif
+#define VRTF_VOLATILE  (1 << 2)
 
 typedef struct VRegType {
   int size;
@@ -89,6 +94,7 @@ enum IrKind {
   IR_MEMCPY,  // memcpy(opr2, opr1, size)
   IR_CLEAR,   // memset(opr1, 0, size)
   IR_ASM,     // assembler code
+  IR_PHI,     // dst = phi(phi.args[index of predecessor]), only while in SSA form
 
   IR_LOAD_SPILLED,   // dst(spilled) = [ofs]
   IR_STORE_SPILLED,  // [ofs] = opr1(spilled)
@@ -148,10 +154,17 @@ typedef struct IR {
     struct {
       const char *str;
     } asm_;
+    struct {
+      const Name *label;  // Allocated at generation, not to touch labels while emitting.
+    } loop;  // IR_MEMCPY, IR_CLEAR
+    struct {
+      VReg **args;  // Same order as `preds` of the BB.
+    } phi;
   };
 } IR;
 
 VReg *new_const_vreg(intptr_t value, const VRegType *vtype);
+intptr_t clamp_value(intptr_t value, const VRegType *vtype);
 VReg *new_ir_bop(enum IrKind kind, VReg *opr1, VReg *opr2, const VRegType *vtype);
 VReg *new_ir_unary(enum IrKind kind, VReg *opr, const VRegType *vtype);
 void new_ir_mov(VReg *dst, VReg *src);
@@ -173,13 +186,17 @@ VReg *new_ir_cast(VReg *vreg, const VRegType *dsttype);
 void new_ir_memcpy(VReg *dst, VReg *src, int size);
 void new_ir_clear(VReg *reg, size_t size);
 void new_ir_asm(const char *asm_);
+IR *new_ir_phi(VReg *dst, int arg_count);  // Arguments are initialized with `dst`.
 
 IR *new_ir_load_spilled(VReg *reg, int offset, int size, int flag);
 IR *new_ir_store_spilled(VReg *reg, int offset, int size, int flag);
 
 // Register allocator
 
-extern RegAlloc *curra;
+// These are per thread, because registers are allocated and code is emitted on worker threads.
+extern THREAD_LOCAL RegAlloc *curra;
+// IR, BBs and registers of the function under generation are allocated here.
+extern THREAD_LOCAL Arena *ir_arena;
 
 // Basci Block:
 //   Chunk of IR codes without branching in the middle (except at the bottom).
@@ -192,18 +209,36 @@ typedef struct BB {
   Vector *in_regs;  // <VReg*>
   Vector *out_regs;  // <VReg*>
   Vector *assigned_regs;  // <VReg*>
+
+  // Control flow graph, built by `analyze_cfg`.
+  int index;  // in BBContainer
+  Vector *preds;  // <BB*>
+  Vector *succs;  // <BB*>: Fallthrough first.
+  struct BB *idom;  // Immediate dominator
+  Loop *loop;  // Innermost natural loop containing the BB, or NULL.
 } BB;
 
-extern BB *curbb;
+extern THREAD_LOCAL BB *curbb;
 
 BB *new_bb(void);
 
+// Natural loop: Entered only through the header, and has a back edge to it.
+typedef struct Loop {
+  BB *header;
+  BB *preheader;  // Only predecessor of the header out of the loop, with no other successor.
+  struct Loop *parent;
+  int depth;  // 1 for an outermost loop.
+} Loop;
+
 // Basic blocks in a function
 typedef struct BBContainer {
   Vector *bbs;  // <BB*>
 } BBContainer;
 
 BBContainer *new_func_blocks(void);
+void free_func_blocks(BBContainer *bbcon);
+// Removes a BB, and connects its previous one to the next.
+void remove_bb_at(BBContainer *bbcon, int index);
 void remove_unnecessary_bb(BBContainer *bbcon);
 void push_callee_save_regs(unsigned short used);
 void pop_callee_save_regs(unsigned short used);
@@ -215,6 +250,6 @@ void emit_bb_irs(BBContainer *bbcon);
 #define PUSH_STACK_POS()  do { stackpos += WORD_SIZE; } while (0)
 #define POP_STACK_POS()   do { stackpos -= WORD_SIZE; } while (0)
 
-extern int stackpos;
+extern THREAD_LOCAL int stackpos;
 
 void convert_3to2(BBContainer *bbcon);  // Make 3 address code to 2.
@@ -134,9 +134,26 @@ static void dump_func_ir(Function *func) {
   }
 
   fprintf(fp, "BB: #%d\n", bbcon->bbs->len);
+  fprintf(fp, "Eliminated IR: #%d\n", func->eliminated_ir_count);
   for (int i = 0; i < bbcon->bbs->len; ++i) {
     BB *bb = bbcon->bbs->data[i];
-    fprintf(fp, "// BB %d\n", i);
+    Loop *loop = bb->loop;
+    if (loop == NULL) {
+      fprintf(fp, "// BB %d\n", i);
+    } else {
+      const Name *label = loop->header->label;
+      fprintf(fp, "// BB %d: loop %.*s", i, label->bytes, label->chars);
+      if (loop->header == bb) {
+        fprintf(fp, " header, depth %d", loop->depth);
+        if (loop->parent != NULL)
+          fprintf(fp, ", in %.*s", loop->parent->header->label->bytes,
+                  loop->parent->header->label->chars);
+        if (loop->preheader != NULL)
+          fprintf(fp, ", preheader %.*s", loop->preheader->label->bytes,
+                  loop->preheader->label->chars);
+      }
+      fprintf(fp, "\n");
+    }
     fprintf(fp, "%.*s:\n", bb->label->bytes, bb->label->chars);
     for (int j = 0; j < bb->irs->len; ++j) {
       IR *ir = bb->irs->data[j];
@@ -5,6 +5,7 @@
 #include <stdarg.h>
 #include <stdlib.h>  // malloc, strtoul
 #include <string.h>
+#include <stdint.h>  // uintptr_t
 #include <sys/types.h>  // ssize_t
 
 #include "table.h"
@@ -111,7 +112,7 @@ static const char kSingleOperatorTypeMap[128] = {  // enum TokenKind
 };
 
 typedef struct {
-  FILE *fp;
+  SourceBuffer *src;
   const char *filename;
   Line *line;
   const char *p;
@@ -123,6 +124,7 @@ typedef struct {
 static Lexer lexer;
 
 static Table reserved_word_table;
+static Arena token_arena;  // Tokens and lines, which are kept until the end.
 
 static void show_error_line(const char *line, const char *p, int len) {
   fprintf(stderr, "%s\n", line);
@@ -173,7 +175,7 @@ void parse_error(const Token *token, const char *fmt, ...) {
 }
 
 static Token *alloc_token(enum TokenKind kind, const char *begin, const char *end) {
-  Token *token = malloc(sizeof(*token));
+  Token *token = arena_alloc(&token_arena, sizeof(*token));
   token->kind = kind;
   token->line = lexer.line;
   token->begin = begin;
@@ -223,12 +225,16 @@ static char backslash(char c) {
   }
 }
 
+static Line *alloc_line(void) {
+  return arena_alloc(&token_arena, sizeof(Line));
+}
+
 void init_lexer(void) {
   init_reserved_word_table();
 }
 
 void set_source_file(FILE *fp, const char *filename) {
-  lexer.fp = fp;
+  lexer.src = fp != NULL ? read_source(fp) : NULL;
   lexer.filename = filename;
   lexer.line = NULL;
   lexer.p = "";
@@ -237,12 +243,12 @@ void set_source_file(FILE *fp, const char *filename) {
 }
 
 void set_source_string(const char *line, const char *filename, int lineno) {
-  Line *p = malloc(sizeof(*p));
+  Line *p = alloc_line();
   p->filename = lexer.filename;
   p->buf = line;
   p->lineno = lineno;
 
-  lexer.fp = NULL;
+  lexer.src = NULL;
   lexer.filename = filename;
   lexer.line = p;
   lexer.p = line;
@@ -295,32 +301,21 @@ static int scan_linemarker(const char *line, long *pnum, char **pfn, int *pflag)
 }
 
 static void read_next_line(void) {
-  if (lexer.fp == NULL) {
+  if (lexer.src == NULL) {
     lexer.p = NULL;
     lexer.line = NULL;
     return;
   }
 
-  char *line = NULL;
-  size_t capa = 0;
+  char *line;
   for (;;) {
-    ssize_t len = getline(&line, &capa, lexer.fp);
+    ssize_t len = source_getline(lexer.src, &line);
     if (len == -1) {
       lexer.p = NULL;
       lexer.line = NULL;
       return;
     }
-    for (;;) {
-      if (len > 0 && line[len - 1] == '\n')
-        line[--len] = '\0';
-      if (len < 1 || line[len - 1] != '\\')
-        break;
-      // Continue line.
-      line[--len] = '\0';
-      ssize_t nextlen = getline_cat(&line, &capa, lexer.fp, len);
-      if (nextlen != -1)
-        len = nextlen;
-    }
+    source_join_lines(lexer.src, line, len, NULL);
 
     if (line[0] != '#')
       break;
@@ -336,7 +331,7 @@ static void read_next_line(void) {
     }
   }
 
-  Line *p = malloc(sizeof(*p));
+  Line *p = alloc_line();
   p->filename = lexer.filename;
   p->buf = line;
   p->lineno = ++lexer.lineno;
@@ -344,8 +339,102 @@ static void read_next_line(void) {
   lexer.p = lexer.line->buf;
 }
 
+// Scanning kernels
+//
+// Each one returns the first character which stops the scan, and stops at '\0' at the latest.
+// SSE2 version classifies 16 characters at a time.  The loads are aligned, so that they never
+// cross a page boundary beyond the terminating '\0'.
+
+#if defined(__SSE2__) && !defined(SELF_HOSTING)
+#include <emmintrin.h>
+
+typedef __m128i (*ScanStop)(__m128i chunk);  // Returns 0xff for characters to stop at.
+
+static inline const char *scan_until(const char *p, ScanStop stop) {
+  const char *block = (const char*)((uintptr_t)p & ~(uintptr_t)15);
+  unsigned int mask = _mm_movemask_epi8(stop(_mm_load_si128((const __m128i*)block)));
+  mask &= ~0U << (p - block);
+  while (mask == 0) {
+    block += 16;
+    mask = _mm_movemask_epi8(stop(_mm_load_si128((const __m128i*)block)));
+  }
+  return block + __builtin_ctz(mask);
+}
+
+static inline __m128i in_range(__m128i c, char lo, char hi) {
+  return _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8(lo - 1)),
+                       _mm_cmplt_epi8(c, _mm_set1_epi8(hi + 1)));
+}
+
+static inline __m128i stop_not_space(__m128i c) {
+  __m128i space = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8(' ')), in_range(c, '\t', '\r'));
+  return _mm_xor_si128(space, _mm_set1_epi8(-1));
+}
+
+static inline __m128i stop_not_ident(__m128i c) {
+  __m128i ident = _mm_or_si128(
+      _mm_or_si128(in_range(c, 'a', 'z'), in_range(c, 'A', 'Z')),
+      _mm_or_si128(in_range(c, '0', '9'), _mm_cmpeq_epi8(c, _mm_set1_epi8('_'))));
+  return _mm_xor_si128(ident, _mm_set1_epi8(-1));
+}
+
+static inline __m128i stop_star(__m128i c) {
+  return _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('*')), _mm_cmpeq_epi8(c, _mm_setzero_si128()));
+}
+
+static inline __m128i stop_string(__m128i c) {
+  return _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('"')), _mm_cmpeq_epi8(c, _mm_set1_epi8('\\'))),
+      _mm_cmpeq_epi8(c, _mm_setzero_si128()));
+}
+
+static const char *scan_spaces(const char *p) {
+  // Most of runs are zero or one character, which are not worth to use the vector.
+  if (!isspace(*p) || !isspace(*++p))
+    return p;
+  return scan_until(p, stop_not_space);
+}
+
+static inline const char *scan_ident(const char *p) {
+  return scan_until(p, stop_not_ident);
+}
+
+static inline const char *scan_comment(const char *p) {
+  return scan_until(p, stop_star);
+}
+
+static inline const char *scan_string(const char *p) {
+  return scan_until(p, stop_string);
+}
+
+#else
+
+static const char *scan_spaces(const char *p) {
+  return skip_whitespaces(p);
+}
+
+static const char *scan_ident(const char *p) {
+  while (isalnum(*p) || *p == '_')
+    ++p;
+  return p;
+}
+
+static const char *scan_comment(const char *p) {
+  while (*p != '*' && *p != '\0')
+    ++p;
+  return p;
+}
+
+static const char *scan_string(const char *p) {
+  for (char c; (c = *p) != '"' && c != '\\' && c != '\0'; )
+    ++p;
+  return p;
+}
+#endif
+
 static const char *skip_block_comment(const char *p) {
   for (;;) {
+    p = scan_comment(p);
     char c = *p++;
     if (c == '\0') {
       read_next_line();
@@ -365,7 +454,7 @@ static const char *skip_line_comment(void) {
 
 static const char *skip_whitespace_or_comment(const char *p) {
   for (;;) {
-    p = skip_whitespaces(p);
+    p = scan_spaces(p);
     switch (*p) {
     case '\0':
       read_next_line();
@@ -465,12 +554,7 @@ const char *read_ident(const char *p) {
   if (!isalpha(*p) && *p != '_')
     return NULL;
 
-  const char *q;
-  for (q = p + 1; ; ++q) {
-    if (!(isalnum(*q) || *q == '_'))
-      break;
-  }
-  return q;
+  return scan_ident(p + 1);
 }
 
 static Token *read_char(const char **pp) {
@@ -496,31 +580,38 @@ static Token *read_char(const char **pp) {
 }
 
 static Token *read_string(const char **pp) {
-  const int ADD = 16;
   const char *p = *pp;
   const char *begin, *end;
   size_t capa = 16, size = 0;
   char *str = malloc(capa);
   for (;;) {
     begin = p++;  // Skip first '"'
-    for (char c; (c = *p++) != '"'; ) {
-      if (c == '\0')
-        lex_error(p - 1, "String not closed");
-      if (size + 1 >= capa) {
-        capa += ADD;
+    for (;;) {
+      // Copy plain characters at once, and handle an escape or the end one by one.
+      const char *q = scan_string(p);
+      size_t len = q - p;
+      if (size + len + 1 >= capa) {
+        while (size + len + 1 >= capa)
+          capa <<= 1;
         str = realloc(str, capa);
         if (str == NULL)
           lex_error(p, "Out of memory");
       }
+      memcpy(str + size, p, len);
+      size += len;
+      p = q;
 
-      if (c == '\\') {
-        c = *p++;
-        if (c == '\0')
-          lex_error(p, "String not closed");
-        c = backslash(c);
-      }
+      char c = *p++;
+      if (c == '"')
+        break;
+      if (c == '\0')
+        lex_error(p - 1, "String not closed");
+      assert(c == '\\');
+      c = *p++;
+      if (c == '\0')
+        lex_error(p, "String not closed");
       assert(size < capa);
-      str[size++] = c;
+      str[size++] = backslash(c);
     }
     end = p;
 
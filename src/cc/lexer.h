@@ -115,6 +115,7 @@ enum TokenKind {
   // For preprocessor.
   PPTK_CONCAT,       // ##
   PPTK_STRINGIFY,    // #
+  PPTK_OTHER,        // Made by `##`, other than an identifier
 };
 
 // Token
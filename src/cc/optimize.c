@@ -0,0 +1,1920 @@
+#include "optimize.h"
+
+#include <assert.h>
+#include <limits.h>  // CHAR_BIT
+#include <stdint.h>
+#include <stdlib.h>  // malloc
+
+#include "ast.h"
+#include "ir.h"
+#include "regalloc.h"
+#include "ssa.h"
+#include "util.h"
+
+#ifndef __NO_FLONUM
+#define IS_FLONUM(vtype)  (((vtype)->flag & VRTF_FLONUM) != 0)
+#else
+#define IS_FLONUM(vtype)  (false)
+#endif
+
+int optimize_level;
+
+static bool is_version(const Ssa *ssa, VReg *vreg) {
+  return vreg != NULL && ssa_orig(ssa, vreg) != vreg;
+}
+
+// A variable whose address is taken lives in memory, so its value changes without a
+// definition.  `IR_BOFS` takes only its place.
+static bool reads_variable_in_memory(IR *ir) {
+  if (ir->kind == IR_BOFS)
+    return false;
+  return (ir->opr1 != NULL && (ir->opr1->flag & VRF_REF)) ||
+         (ir->opr2 != NULL && (ir->opr2->flag & VRF_REF));
+}
+
+static intptr_t extend_value(intptr_t value, int size, bool is_unsigned) {
+  switch (size) {
+  case 1:  return is_unsigned ? (intptr_t)(unsigned char)value : (intptr_t)(signed char)value;
+  case 2:  return is_unsigned ? (intptr_t)(unsigned short)value : (intptr_t)(short)value;
+  case 4:  return is_unsigned ? (intptr_t)(unsigned int)value : (intptr_t)(int)value;
+  default:  return value;
+  }
+}
+
+// Sparse conditional constant propagation:
+//   "Constant Propagation with Conditional Branches" by Wegman and Zadeck.
+//   Values of versions and executable edges are assumed optimistically, and lowered
+//   until they settle.
+
+enum LatticeKind {
+  LAT_TOP,     // Not known yet
+  LAT_CONST,
+  LAT_BOTTOM,  // Not a constant
+};
+
+typedef struct {
+  enum LatticeKind kind;
+  intptr_t value;
+} Lattice;
+
+typedef struct Use {
+  struct Use *next;
+  BB *bb;
+  int index;  // in `bb->irs`
+} Use;
+
+typedef struct {
+  Ssa *ssa;
+  int nreg;
+  Lattice *lattices;     // Indexed by `virt`
+  Use **uses;            // Indexed by `virt`
+  bool *executable;      // Indexed by BB index
+  unsigned int *edges;   // Indexed by BB index: Bits of executable edges to `succs`.
+  Vector *bb_work;       // <BB*>
+  Vector *reg_work;      // <VReg*>
+} Sccp;
+
+static Lattice lattice_of(Sccp *sccp, VReg *vreg) {
+  Lattice lat;
+  lat.kind = LAT_BOTTOM;
+  lat.value = 0;
+  if (vreg->flag & VRF_CONST) {
+    if (!IS_FLONUM(vreg->vtype)) {
+      lat.kind = LAT_CONST;
+      lat.value = vreg->fixnum;
+    }
+  } else if (vreg->virt < sccp->nreg && is_version(sccp->ssa, vreg)) {
+    // The original register is the incoming value of a parameter, so it stays bottom.
+    lat = sccp->lattices[vreg->virt];
+  }
+  return lat;
+}
+
+static void set_lattice(Sccp *sccp, VReg *vreg, Lattice lat) {
+  Lattice *p = &sccp->lattices[vreg->virt];
+  if (p->kind == LAT_BOTTOM || lat.kind == LAT_TOP)
+    return;
+  if (p->kind == LAT_CONST) {
+    if (lat.kind == LAT_CONST && lat.value == p->value)
+      return;
+    lat.kind = LAT_BOTTOM;
+  }
+  *p = lat;
+  vec_push(sccp->reg_work, vreg);
+}
+
+static int succ_index(BB *bb, BB *succ) {
+  for (int i = 0; i < bb->succs->len; ++i) {
+    if (bb->succs->data[i] == succ)
+      return i;
+  }
+  assert(false);
+  return -1;
+}
+
+static bool is_edge_executable(Sccp *sccp, BB *bb, BB *succ) {
+  return (sccp->edges[bb->index] & (1U << succ_index(bb, succ))) != 0;
+}
+
+static void mark_edge(Sccp *sccp, BB *bb, BB *succ) {
+  unsigned int bit = 1U << succ_index(bb, succ);
+  if (sccp->edges[bb->index] & bit)
+    return;
+  sccp->edges[bb->index] |= bit;
+  vec_push(sccp->bb_work, succ);
+}
+
+// Evaluates a condition on the flags set by the last CMP or TEST before `index`.
+static Lattice eval_cond(Sccp *sccp, BB *bb, int index, enum ConditionKind cond) {
+  Lattice result;
+  result.kind = LAT_BOTTOM;
+  result.value = 0;
+
+  IR *ir = NULL;
+  for (int i = index; --i >= 0;) {
+    IR *p = bb->irs->data[i];
+    if (p->kind == IR_CMP || p->kind == IR_TEST) {
+      ir = p;
+      break;
+    }
+  }
+  if (ir == NULL)  // Flags are set in the previous BB.
+    return result;
+
+  Lattice lhs = lattice_of(sccp, ir->opr1);
+  Lattice rhs;
+  if (ir->kind == IR_CMP) {
+    rhs = lattice_of(sccp, ir->opr2);
+  } else {
+    rhs.kind = LAT_CONST;
+    rhs.value = 0;
+  }
+  if (lhs.kind == LAT_BOTTOM || rhs.kind == LAT_BOTTOM)
+    return result;
+  if (lhs.kind == LAT_TOP || rhs.kind == LAT_TOP) {
+    result.kind = LAT_TOP;
+    return result;
+  }
+
+  bool is_unsigned = !(cond >= COND_LT && cond <= COND_GT);
+  intptr_t a = extend_value(lhs.value, ir->size, is_unsigned);
+  intptr_t b = extend_value(rhs.value, ir->size, is_unsigned);
+  bool value;
+  switch (cond) {
+  case COND_EQ:  value = a == b; break;
+  case COND_NE:  value = a != b; break;
+  case COND_LT:  value = a < b; break;
+  case COND_LE:  value = a <= b; break;
+  case COND_GE:  value = a >= b; break;
+  case COND_GT:  value = a > b; break;
+  case COND_ULT:  value = (uintptr_t)a < (uintptr_t)b; break;
+  case COND_ULE:  value = (uintptr_t)a <= (uintptr_t)b; break;
+  case COND_UGE:  value = (uintptr_t)a >= (uintptr_t)b; break;
+  case COND_UGT:  value = (uintptr_t)a > (uintptr_t)b; break;
+  default:  return result;
+  }
+  result.kind = LAT_CONST;
+  result.value = value;
+  return result;
+}
+
+static bool fold_bop(IR *ir, intptr_t a, intptr_t b, intptr_t *presult) {
+  int size = ir->size;
+  uintptr_t ua = a, ub = b;
+  uintptr_t value;
+  switch (ir->kind) {
+  case IR_ADD:     value = ua + ub; break;
+  case IR_SUB:     value = ua - ub; break;
+  case IR_MUL:     value = ua * ub; break;
+  case IR_BITAND:  value = ua & ub; break;
+  case IR_BITOR:   value = ua | ub; break;
+  case IR_BITXOR:  value = ua ^ ub; break;
+  case IR_DIV:
+  case IR_MOD:
+    {
+      intptr_t min = extend_value((intptr_t)((uintptr_t)1 << (size * CHAR_BIT - 1)), size, false);
+      a = extend_value(a, size, false);
+      b = extend_value(b, size, false);
+      if (b == 0 || (b == -1 && a == min))  // Left to trap at runtime.
+        return false;
+      value = ir->kind == IR_DIV ? a / b : a % b;
+    }
+    break;
+  case IR_DIVU:
+  case IR_MODU:
+    ua = extend_value(a, size, true);
+    ub = extend_value(b, size, true);
+    if (ub == 0)
+      return false;
+    value = ir->kind == IR_DIVU ? ua / ub : ua % ub;
+    break;
+  case IR_LSHIFT:
+  case IR_RSHIFT:
+    if (b < 0 || b >= size * CHAR_BIT)
+      return false;
+    if (ir->kind == IR_LSHIFT)
+      value = ua << b;
+    else if (ir->opr1->vtype->flag & VRTF_UNSIGNED)
+      value = (uintptr_t)extend_value(a, size, true) >> b;
+    else
+      value = extend_value(a, size, false) >> b;
+    break;
+  default:
+    return false;
+  }
+  *presult = clamp_value(value, ir->dst->vtype);
+  return true;
+}
+
+static Lattice evaluate(Sccp *sccp, BB *bb, int index) {
+  IR *ir = bb->irs->data[index];
+  Lattice result;
+  result.kind = LAT_BOTTOM;
+  result.value = 0;
+  if (IS_FLONUM(ir->dst->vtype))
+    return result;
+
+  switch (ir->kind) {
+  case IR_PHI:
+    result.kind = LAT_TOP;
+    for (int i = 0; i < bb->preds->len; ++i) {
+      if (!is_edge_executable(sccp, bb->preds->data[i], bb))
+        continue;
+      Lattice lat = lattice_of(sccp, ir->phi.args[i]);
+      if (lat.kind == LAT_TOP)
+        continue;
+      if (result.kind == LAT_TOP) {
+        result = lat;
+      } else if (lat.kind == LAT_BOTTOM || lat.value != result.value) {
+        result.kind = LAT_BOTTOM;
+        break;
+      }
+    }
+    return result;
+
+  case IR_MOV:
+  case IR_CAST:
+  case IR_NEG:
+  case IR_BITNOT:
+    {
+      if (IS_FLONUM(ir->opr1->vtype))
+        return result;
+      Lattice lat = lattice_of(sccp, ir->opr1);
+      if (lat.kind != LAT_CONST)
+        return lat;
+      uintptr_t value = lat.value;
+      if (ir->kind == IR_NEG)
+        value = -value;
+      else if (ir->kind == IR_BITNOT)
+        value = ~value;
+      result.kind = LAT_CONST;
+      result.value = clamp_value(value, ir->dst->vtype);
+    }
+    return result;
+
+  case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_MOD: case IR_DIVU: case IR_MODU:
+  case IR_BITAND: case IR_BITOR: case IR_BITXOR: case IR_LSHIFT: case IR_RSHIFT:
+    {
+      Lattice lhs = lattice_of(sccp, ir->opr1);
+      Lattice rhs = lattice_of(sccp, ir->opr2);
+      if (lhs.kind == LAT_BOTTOM || rhs.kind == LAT_BOTTOM)
+        return result;
+      if (lhs.kind == LAT_TOP || rhs.kind == LAT_TOP) {
+        result.kind = LAT_TOP;
+        return result;
+      }
+      if (fold_bop(ir, lhs.value, rhs.value, &result.value))
+        result.kind = LAT_CONST;
+    }
+    return result;
+
+  case IR_COND:
+    return eval_cond(sccp, bb, index, ir->cond.kind);
+
+  default:
+    return result;
+  }
+}
+
+static void visit_ir(Sccp *sccp, BB *bb, int index) {
+  IR *ir = bb->irs->data[index];
+  switch (ir->kind) {
+  case IR_JMP:
+    if (ir->jmp.cond == COND_ANY) {
+      mark_edge(sccp, bb, ir->jmp.bb);
+    } else {
+      Lattice cond = eval_cond(sccp, bb, index, ir->jmp.cond);
+      if (cond.kind == LAT_TOP)
+        break;
+      assert(bb->next != NULL);
+      if (cond.kind == LAT_BOTTOM || cond.value)
+        mark_edge(sccp, bb, ir->jmp.bb);
+      if (cond.kind == LAT_BOTTOM || !cond.value)
+        mark_edge(sccp, bb, bb->next);
+    }
+    break;
+
+  case IR_CMP:
+  case IR_TEST:
+    // Revisit consumers of the flags.
+    for (int i = index + 1; i < bb->irs->len; ++i) {
+      IR *next = bb->irs->data[i];
+      if (next->kind == IR_CMP || next->kind == IR_TEST)
+        break;
+      if (next->kind == IR_COND || next->kind == IR_JMP)
+        visit_ir(sccp, bb, i);
+    }
+    break;
+
+  default:
+    if (is_version(sccp->ssa, ir->dst))
+      set_lattice(sccp, ir->dst, evaluate(sccp, bb, index));
+    break;
+  }
+}
+
+static void visit_bb(Sccp *sccp, BB *bb) {
+  bool first = !sccp->executable[bb->index];
+  sccp->executable[bb->index] = true;
+
+  Vector *irs = bb->irs;
+  for (int i = 0; i < irs->len; ++i) {
+    IR *ir = irs->data[i];
+    if (!first && ir->kind != IR_PHI)  // Only phis depend on a new incoming edge.
+      break;
+    visit_ir(sccp, bb, i);
+  }
+  if (first && bb->next != NULL &&
+      (irs->len == 0 || ((IR*)irs->data[irs->len - 1])->kind != IR_JMP))
+    mark_edge(sccp, bb, bb->next);
+}
+
+static void add_use(Sccp *sccp, VReg *vreg, BB *bb, int index) {
+  if (!is_version(sccp->ssa, vreg))
+    return;
+  Use *use = arena_alloc(ir_arena, sizeof(*use));
+  use->bb = bb;
+  use->index = index;
+  use->next = sccp->uses[vreg->virt];
+  sccp->uses[vreg->virt] = use;
+}
+
+static void run_sccp(Sccp *sccp) {
+  Vector *bbs = sccp->ssa->bbcon->bbs;
+  for (int i = 0; i < bbs->len; ++i) {
+    BB *bb = bbs->data[i];
+    for (int j = 0; j < bb->irs->len; ++j) {
+      IR *ir = bb->irs->data[j];
+      if (ir->kind == IR_PHI) {
+        for (int k = 0; k < bb->preds->len; ++k)
+          add_use(sccp, ir->phi.args[k], bb, j);
+      } else {
+        add_use(sccp, ir->opr1, bb, j);
+        add_use(sccp, ir->opr2, bb, j);
+      }
+    }
+  }
+
+  vec_push(sccp->bb_work, bbs->data[0]);
+  for (;;) {
+    if (sccp->bb_work->len > 0) {
+      visit_bb(sccp, vec_pop(sccp->bb_work));
+    } else if (sccp->reg_work->len > 0) {
+      VReg *vreg = vec_pop(sccp->reg_work);
+      for (Use *use = sccp->uses[vreg->virt]; use != NULL; use = use->next) {
+        if (sccp->executable[use->bb->index])
+          visit_ir(sccp, use->bb, use->index);
+      }
+    } else {
+      break;
+    }
+  }
+}
+
+// Whether the emitter accepts a constant for the operand.
+static bool accepts_const(IR *ir, int opr, intptr_t value) {
+  switch (ir->kind) {
+  case IR_MOV:
+    return true;
+  case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_MOD: case IR_DIVU: case IR_MODU:
+  case IR_BITAND: case IR_BITOR: case IR_BITXOR:
+  case IR_CMP: case IR_TEST: case IR_PUSHARG: case IR_RESULT:
+    return is_im32(value);
+  case IR_LSHIFT:
+  case IR_RSHIFT:
+    return opr == 1 ? is_im32(value) : value >= 0 && value < ir->size * CHAR_BIT;
+  default:
+    return false;
+  }
+}
+
+static VReg *const_of(Sccp *sccp, VReg **consts, VReg *vreg) {
+  VReg *c = consts[vreg->virt];
+  if (c == NULL)
+    consts[vreg->virt] = c = new_const_vreg(sccp->lattices[vreg->virt].value, vreg->vtype);
+  return c;
+}
+
+static bool is_const_version(Sccp *sccp, VReg *vreg) {
+  return vreg != NULL && vreg->virt < sccp->nreg && is_version(sccp->ssa, vreg) &&
+         sccp->lattices[vreg->virt].kind == LAT_CONST;
+}
+
+// Replaces constant definitions with moves, and uses with immediates where possible.
+static void replace_consts(Sccp *sccp) {
+  VReg **consts = calloc(sccp->nreg, sizeof(*consts));
+  Vector *bbs = sccp->ssa->bbcon->bbs;
+  for (int i = 0; i < bbs->len; ++i) {
+    BB *bb = bbs->data[i];
+    if (!sccp->executable[i])
+      continue;
+    for (int j = 0; j < bb->irs->len; ++j) {
+      IR *ir = bb->irs->data[j];
+      if (ir->kind == IR_PHI)
+        continue;
+      if (is_const_version(sccp, ir->dst) &&
+          !(ir->kind == IR_MOV && (ir->opr1->flag & VRF_CONST))) {
+        ir->kind = IR_MOV;
+        ir->opr1 = const_of(sccp, consts, ir->dst);
+        ir->opr2 = NULL;
+        ir->size = ir->dst->vtype->size;
+        continue;
+      }
+      if (is_const_version(sccp, ir->opr1) &&
+          accepts_const(ir, 1, sccp->lattices[ir->opr1->virt].value))
+        ir->opr1 = const_of(sccp, consts, ir->opr1);
+      if (is_const_version(sccp, ir->opr2) &&
+          accepts_const(ir, 2, sccp->lattices[ir->opr2->virt].value))
+        ir->opr2 = const_of(sccp, consts, ir->opr2);
+    }
+  }
+  free(consts);
+}
+
+static bool reads_flags_first(BB *bb) {
+  for (int i = 0; i < bb->irs->len; ++i) {
+    IR *ir = bb->irs->data[i];
+    switch (ir->kind) {
+    case IR_CMP: case IR_TEST: case IR_CALL:
+      return false;
+    case IR_COND:
+      return true;
+    case IR_JMP:
+      return ir->jmp.cond != COND_ANY;
+    default:
+      break;
+    }
+  }
+  return false;
+}
+
+// Removes the CMP or TEST for a folded branch, unless another one reads the flags.
+static void remove_flag_setter(BB *bb) {
+  Vector *irs = bb->irs;
+  for (int i = irs->len; --i >= 0;) {
+    IR *ir = irs->data[i];
+    if (ir->kind == IR_COND || ir->kind == IR_JMP)
+      return;
+    if (ir->kind == IR_CMP || ir->kind == IR_TEST) {
+      for (int j = 0; j < bb->succs->len; ++j) {
+        if (reads_flags_first(bb->succs->data[j]))
+          return;
+      }
+      vec_remove_at(irs, i);
+      return;
+    }
+  }
+}
+
+static void fold_branches(Sccp *sccp) {
+  Vector *bbs = sccp->ssa->bbcon->bbs;
+  for (int i = 0; i < bbs->len; ++i) {
+    BB *bb = bbs->data[i];
+    Vector *irs = bb->irs;
+    if (!sccp->executable[i] || irs->len == 0)
+      continue;
+    IR *jmp = irs->data[irs->len - 1];
+    if (jmp->kind != IR_JMP || jmp->jmp.cond == COND_ANY || jmp->jmp.bb == bb->next)
+      continue;
+    bool taken = is_edge_executable(sccp, bb, jmp->jmp.bb);
+    bool fallthrough = is_edge_executable(sccp, bb, bb->next);
+    if (taken == fallthrough)
+      continue;
+    if (taken) {
+      jmp->jmp.cond = COND_ANY;
+      remove_cfg_edge(bb, bb->next);
+    } else {
+      vec_pop(irs);
+      remove_cfg_edge(bb, jmp->jmp.bb);
+    }
+    remove_flag_setter(bb);
+  }
+}
+
+static void propagate_consts(Ssa *ssa) {
+  Vector *bbs = ssa->bbcon->bbs;
+  Sccp sccp;
+  sccp.ssa = ssa;
+  sccp.nreg = ssa->ra->vregs->len;
+  sccp.lattices = calloc(sccp.nreg, sizeof(*sccp.lattices));  // LAT_TOP
+  sccp.uses = calloc(sccp.nreg, sizeof(*sccp.uses));
+  sccp.executable = calloc(bbs->len, sizeof(*sccp.executable));
+  sccp.edges = calloc(bbs->len, sizeof(*sccp.edges));
+  sccp.bb_work = new_vector();
+  sccp.reg_work = new_vector();
+
+  run_sccp(&sccp);
+  replace_consts(&sccp);
+  fold_branches(&sccp);
+  // Edges from folded branches are removed, so BBs never executed are unreachable.
+  remove_unreachable_bbs(ssa->bbcon);
+
+  free_vector(sccp.reg_work);
+  free_vector(sccp.bb_work);
+  free(sccp.edges);
+  free(sccp.executable);
+  free(sccp.uses);
+  free(sccp.lattices);
+}
+
+// `dst = opr1 op opr2` is emitted as `dst = opr1; dst op= opr2` after `convert_3to2`.
+static bool is_two_address(enum IrKind kind) {
+  switch (kind) {
+  case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_MOD: case IR_DIVU: case IR_MODU:
+  case IR_BITAND: case IR_BITOR: case IR_BITXOR: case IR_LSHIFT: case IR_RSHIFT:
+  case IR_NEG: case IR_BITNOT:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Whether the operand can be in the same register as the destination, once versions of
+// a register are mapped back to it.
+static bool can_share_dst(IR *ir, int opr) {
+  return opr == 1 && (is_two_address(ir->kind) || ir->kind == IR_LOAD);
+}
+
+// Only one operand of an instruction can be on the stack.  Variables and registers living
+// across BBs may be spilled, unlike ones generated for an expression.
+static bool may_spill(const Ssa *ssa, BB **def_bbs, BB *bb, VReg *vreg) {
+  if (vreg == NULL || (vreg->flag & VRF_CONST))
+    return false;
+  return (vreg->flag & VRF_LOCAL) || !is_version(ssa, vreg) || def_bbs[vreg->virt] != bb;
+}
+
+// The register which is emitted together with the operand, after `convert_3to2`.
+static VReg *paired_operand(IR *ir, int opr) {
+  if (is_two_address(ir->kind))
+    return opr == 2 ? ir->dst : NULL;
+  return opr == 1 ? ir->opr2 : ir->opr1;
+}
+
+static bool is_same_vtype(const VRegType *a, const VRegType *b) {
+  return a->size == b->size && a->flag == b->flag;
+}
+
+// Local value numbering: A computation which is same as an earlier one in the BB becomes
+// a move from its result, which copy propagation removes.  Operands are versions, so they
+// hold the same values wherever they are used;  only loads depend on memory, and they are
+// forgotten at an instruction which may write it.
+//
+// Open addressing with linear probing, like the type table.
+
+#define HASH_VALUE_MUL  (0x9e3779b1U)
+#define HASH_MIX(hash, value)  (((hash) ^ (uint32_t)(value)) * HASH_VALUE_MUL)
+
+typedef struct {
+  IR *ir;
+  uint32_t hash;
+  int epoch;  // Memory state which a load reads.
+} ValueEntry;
+
+typedef struct {
+  const Ssa *ssa;
+  ValueEntry *entries;
+  int capacity;
+  int epoch;
+  VReg **reps;  // Indexed by `virt`: Earlier register with the same value, or NULL.
+} ValueTable;
+
+static bool is_commutative(enum IrKind kind) {
+  switch (kind) {
+  case IR_ADD: case IR_MUL: case IR_BITAND: case IR_BITOR: case IR_BITXOR:
+    return true;
+  default:
+    return false;
+  }
+}
+
+static bool is_numberable(IR *ir) {
+  switch (ir->kind) {
+  case IR_LOAD:
+    return !(ir->dst->vtype->flag & VRTF_VOLATILE);
+  case IR_BOFS: case IR_IOFS: case IR_CAST: case IR_NEG: case IR_BITNOT:
+  case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_MOD: case IR_DIVU: case IR_MODU:
+  case IR_BITAND: case IR_BITOR: case IR_BITXOR: case IR_LSHIFT: case IR_RSHIFT:
+    return true;
+  default:
+    return false;
+  }
+}
+
+static bool writes_memory(IR *ir) {
+  switch (ir->kind) {
+  case IR_STORE: case IR_INC: case IR_DEC: case IR_CALL: case IR_MEMCPY: case IR_CLEAR:
+  case IR_ASM:
+    return true;
+  default:
+    return false;
+  }
+}
+
+static VReg *rep_of(ValueTable *table, VReg *vreg) {
+  if (is_version(table->ssa, vreg) && table->reps[vreg->virt] != NULL)
+    return table->reps[vreg->virt];
+  return vreg;
+}
+
+static uint32_t hash_operand(const VReg *vreg) {
+  if (vreg == NULL)
+    return 0;
+  if (vreg->flag & VRF_CONST)
+    return HASH_MIX(vreg->vtype->size, vreg->fixnum);
+  return HASH_MIX(-1, vreg->virt);
+}
+
+static bool is_same_operand(const VReg *a, const VReg *b) {
+  if (a == b)
+    return true;
+  return a != NULL && b != NULL && (a->flag & b->flag & VRF_CONST) && a->fixnum == b->fixnum &&
+         is_same_vtype(a->vtype, b->vtype);
+}
+
+static uint32_t hash_value(ValueTable *table, IR *ir) {
+  uint32_t hash = HASH_MIX(HASH_MIX(ir->kind, ir->size), ir->dst->vtype->flag);
+  if (ir->kind == IR_IOFS)
+    return HASH_MIX(HASH_MIX(hash, (uintptr_t)ir->iofs.label >> 3), ir->iofs.global);
+  uint32_t h1 = hash_operand(rep_of(table, ir->opr1));
+  uint32_t h2 = hash_operand(rep_of(table, ir->opr2));
+  if (is_commutative(ir->kind))
+    return HASH_MIX(hash, h1 + h2);
+  return HASH_MIX(HASH_MIX(hash, h1), h2);
+}
+
+static bool is_same_value(ValueTable *table, IR *a, IR *b) {
+  if (a->kind != b->kind || a->size != b->size ||
+      !is_same_vtype(a->dst->vtype, b->dst->vtype))
+    return false;
+  if (a->kind == IR_IOFS)
+    return a->iofs.label == b->iofs.label && a->iofs.global == b->iofs.global;
+  VReg *a1 = rep_of(table, a->opr1), *a2 = rep_of(table, a->opr2);
+  VReg *b1 = rep_of(table, b->opr1), *b2 = rep_of(table, b->opr2);
+  return (is_same_operand(a1, b1) && is_same_operand(a2, b2)) ||
+         (is_commutative(a->kind) && is_same_operand(a1, b2) && is_same_operand(a2, b1));
+}
+
+// Returns the entry for the computation, or an empty one to put it.
+static ValueEntry *find_value_entry(ValueTable *table, IR *ir, uint32_t hash) {
+  uint32_t mask = table->capacity - 1;
+  for (uint32_t index = hash & mask; ; index = (index + 1) & mask) {
+    ValueEntry *entry = &table->entries[index];
+    if (entry->ir == NULL || (entry->hash == hash && is_same_value(table, entry->ir, ir)))
+      return entry;
+  }
+}
+
+static void number_values_in_bb(ValueTable *table, const int *def_counts, BB *bb) {
+  const Ssa *ssa = table->ssa;
+  Vector *irs = bb->irs;
+  for (int i = 0; i < irs->len; ++i) {
+    IR *ir = irs->data[i];
+    if (writes_memory(ir)) {
+      ++table->epoch;
+      continue;
+    }
+    if (!is_version(ssa, ir->dst))
+      continue;
+    if (ir->kind == IR_MOV) {
+      if (is_same_vtype(ir->opr1->vtype, ir->dst->vtype))
+        table->reps[ir->dst->virt] = rep_of(table, ir->opr1);
+      continue;
+    }
+    if (!is_numberable(ir) || reads_variable_in_memory(ir))
+      continue;
+
+    uint32_t hash = hash_value(table, ir);
+    ValueEntry *entry = find_value_entry(table, ir, hash);
+    if (entry->ir != NULL && (entry->ir->kind != IR_LOAD || entry->epoch == table->epoch)) {
+      ir->kind = IR_MOV;
+      ir->opr1 = entry->ir->dst;
+      ir->opr2 = NULL;
+      ir->size = ir->dst->vtype->size;
+      table->reps[ir->dst->virt] = rep_of(table, ir->opr1);
+      continue;
+    }
+    // The result is reused, so it must not be defined again.
+    if (def_counts[ssa_orig(ssa, ir->dst)->virt] != 1)
+      continue;
+    entry->ir = ir;
+    entry->hash = hash;
+    entry->epoch = table->epoch;
+  }
+}
+
+static void number_values(Ssa *ssa) {
+  Vector *bbs = ssa->bbcon->bbs;
+  int nreg = ssa->ra->vregs->len;
+  int *def_counts = calloc(nreg, sizeof(*def_counts));
+  int max_len = 0;
+  for (int i = 0; i < bbs->len; ++i) {
+    BB *bb = bbs->data[i];
+    if (bb->irs->len > max_len)
+      max_len = bb->irs->len;
+    for (int j = 0; j < bb->irs->len; ++j) {
+      IR *ir = bb->irs->data[j];
+      if (is_version(ssa, ir->dst))
+        ++def_counts[ssa_orig(ssa, ir->dst)->virt];
+    }
+  }
+
+  ValueTable table;
+  table.ssa = ssa;
+  table.entries = malloc(sizeof(*table.entries) * max_len * 4);
+  table.epoch = 0;
+  table.reps = calloc(nreg, sizeof(*table.reps));
+  for (int i = 0; i < bbs->len; ++i) {
+    BB *bb = bbs->data[i];
+    // At most half full.
+    for (table.capacity = 1; table.capacity < bb->irs->len * 2; table.capacity *= 2)
+      ;
+    for (int j = 0; j < table.capacity; ++j)
+      table.entries[j].ir = NULL;
+    number_values_in_bb(&table, def_counts, bb);
+  }
+
+  free(table.reps);
+  free(table.entries);
+  free(def_counts);
+}
+
+// Copy propagation: A use of `x = MOV y` is replaced with `y`, if the same version of `y`
+// still reaches it.  Versions of a register share one register after leaving SSA, so a
+// version must not be extended over another one:  The dominator tree is walked to know
+// the current version at each use, which is exact if phis are placed for the register,
+// if it has only one definition, or within the BB of the copy.
+
+typedef struct {
+  Ssa *ssa;
+  IR **defs;         // Indexed by `virt`
+  BB **def_bbs;      // Indexed by `virt`
+  int *def_counts;   // Indexed by original `virt`
+  VReg **currents;   // Indexed by original `virt`: Current version.
+  Vector *saved;     // <VReg*>: Versions to restore at leaving a BB.
+  Vector **children;  // <BB*>: Dominator tree.
+} CopyProp;
+
+static VReg *current_of(CopyProp *cp, VReg *orig) {
+  VReg *vreg = cp->currents[orig->virt];
+  return vreg != NULL ? vreg : orig;
+}
+
+static VReg *source_of_copy(CopyProp *cp, BB *bb, IR *ir, int opr, VReg *vreg) {
+  Ssa *ssa = cp->ssa;
+  while (is_version(ssa, vreg)) {
+    IR *def = cp->defs[vreg->virt];
+    if (def == NULL || def->kind != IR_MOV)
+      break;
+    VReg *src = def->opr1;
+    // Parameters are spilled, so a copy in a register is better than them.
+    if (!is_ssa_reg(src) || src->param_index >= 0 || !is_same_vtype(src->vtype, vreg->vtype))
+      break;
+    VReg *orig = ssa_orig(ssa, src);
+    if (current_of(cp, orig) != src ||
+        !(ssa->globals[orig->virt] || cp->def_counts[orig->virt] <= 1 ||
+          cp->def_bbs[vreg->virt] == bb))
+      break;
+    if (ir->dst != NULL && ssa_orig(ssa, ir->dst) == orig && !can_share_dst(ir, opr))
+      break;
+    if (may_spill(ssa, cp->def_bbs, bb, src) &&
+        may_spill(ssa, cp->def_bbs, bb, paired_operand(ir, opr)))
+      break;
+    vreg = src;
+  }
+  return vreg;
+}
+
+static void propagate_copies_in_bb(CopyProp *cp, BB *bb) {
+  Ssa *ssa = cp->ssa;
+  int saved = cp->saved->len;
+  Vector *irs = bb->irs;
+  for (int i = 0; i < irs->len; ++i) {
+    IR *ir = irs->data[i];
+    if (ir->kind != IR_PHI) {  // Arguments of phis are left, to keep versions apart.
+      ir->opr1 = source_of_copy(cp, bb, ir, 1, ir->opr1);
+      ir->opr2 = source_of_copy(cp, bb, ir, 2, ir->opr2);
+    }
+    if (is_version(ssa, ir->dst)) {
+      VReg *orig = ssa_orig(ssa, ir->dst);
+      vec_push(cp->saved, current_of(cp, orig));
+      cp->currents[orig->virt] = ir->dst;
+    }
+  }
+
+  Vector *children = cp->children[bb->index];
+  for (int i = 0; i < children->len; ++i)
+    propagate_copies_in_bb(cp, children->data[i]);
+
+  while (cp->saved->len > saved) {
+    VReg *vreg = vec_pop(cp->saved);
+    cp->currents[ssa_orig(ssa, vreg)->virt] = vreg;
+  }
+}
+
+static void propagate_copies(Ssa *ssa) {
+  Vector *bbs = ssa->bbcon->bbs;
+  int nbb = bbs->len, nreg = ssa->ra->vregs->len;
+  CopyProp cp;
+  cp.ssa = ssa;
+  cp.defs = calloc(nreg, sizeof(*cp.defs));
+  cp.def_bbs = calloc(nreg, sizeof(*cp.def_bbs));
+  cp.def_counts = calloc(nreg, sizeof(*cp.def_counts));
+  cp.currents = calloc(nreg, sizeof(*cp.currents));
+  cp.saved = new_vector();
+  cp.children = malloc(sizeof(*cp.children) * nbb);
+
+  // Folded branches may have changed dominators.
+  analyze_dominators(ssa->bbcon);
+  for (int i = 0; i < nbb; ++i)
+    cp.children[i] = new_vector();
+  for (int i = 0; i < nbb; ++i) {
+    BB *bb = bbs->data[i];
+    if (bb->idom != NULL)
+      vec_push(cp.children[bb->idom->index], bb);
+    for (int j = 0; j < bb->irs->len; ++j) {
+      IR *ir = bb->irs->data[j];
+      if (is_version(ssa, ir->dst)) {
+        cp.defs[ir->dst->virt] = ir;
+        cp.def_bbs[ir->dst->virt] = bb;
+        ++cp.def_counts[ssa_orig(ssa, ir->dst)->virt];
+      }
+    }
+  }
+
+  propagate_copies_in_bb(&cp, bbs->data[0]);
+
+  for (int i = 0; i < nbb; ++i)
+    free_vector(cp.children[i]);
+  free(cp.children);
+  free_vector(cp.saved);
+  free(cp.currents);
+  free(cp.def_counts);
+  free(cp.def_bbs);
+  free(cp.defs);
+}
+
+// Dead code elimination: Definitions without side effects are removed unless their
+// values reach an instruction with side effects.
+
+static bool is_removable(const Ssa *ssa, IR *ir) {
+  switch (ir->kind) {
+  case IR_BOFS: case IR_IOFS: case IR_SOFS:
+  case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_MOD: case IR_DIVU: case IR_MODU:
+  case IR_BITAND: case IR_BITOR: case IR_BITXOR: case IR_LSHIFT: case IR_RSHIFT:
+  case IR_NEG: case IR_BITNOT: case IR_COND: case IR_CAST: case IR_MOV: case IR_PHI:
+    return is_version(ssa, ir->dst);
+  default:
+    return false;
+  }
+}
+
+static void mark_live(const Ssa *ssa, VReg *vreg, bool *live, Vector *work) {
+  if (is_version(ssa, vreg) && !live[vreg->virt]) {
+    live[vreg->virt] = true;
+    vec_push(work, vreg);
+  }
+}
+
+static void mark_operands(const Ssa *ssa, BB *bb, IR *ir, bool *live, Vector *work) {
+  if (ir->kind == IR_PHI) {
+    for (int i = 0; i < bb->preds->len; ++i)
+      mark_live(ssa, ir->phi.args[i], live, work);
+  } else {
+    mark_live(ssa, ir->opr1, live, work);
+    mark_live(ssa, ir->opr2, live, work);
+  }
+}
+
+static void eliminate_dead_code(Ssa *ssa) {
+  Vector *bbs = ssa->bbcon->bbs;
+  int nreg = ssa->ra->vregs->len;
+  IR **defs = calloc(nreg, sizeof(*defs));
+  BB **def_bbs = calloc(nreg, sizeof(*def_bbs));
+  bool *live = calloc(nreg, sizeof(*live));
+  Vector *work = new_vector();
+
+  for (int i = 0; i < bbs->len; ++i) {
+    BB *bb = bbs->data[i];
+    for (int j = 0; j < bb->irs->len; ++j) {
+      IR *ir = bb->irs->data[j];
+      if (is_version(ssa, ir->dst)) {
+        defs[ir->dst->virt] = ir;
+        def_bbs[ir->dst->virt] = bb;
+      }
+      if (!is_removable(ssa, ir))
+        mark_operands(ssa, bb, ir, live, work);
+    }
+  }
+  while (work->len > 0) {
+    VReg *vreg = vec_pop(work);
+    IR *ir = defs[vreg->virt];
+    if (ir != NULL && is_removable(ssa, ir))
+      mark_operands(ssa, def_bbs[vreg->virt], ir, live, work);
+  }
+
+  for (int i = 0; i < bbs->len; ++i) {
+    BB *bb = bbs->data[i];
+    Vector *irs = bb->irs;
+    for (int j = 0; j < irs->len; ++j) {
+      IR *ir = irs->data[j];
+      if (is_removable(ssa, ir) && !live[ir->dst->virt])
+        vec_remove_at(irs, j--);
+    }
+  }
+
+  free_vector(work);
+  free(live);
+  free(def_bbs);
+  free(defs);
+}
+
+// Loop invariant code motion: A computation in a loop whose operands are defined out of
+// it is moved to the preheader, from inner loops to outer ones.  Operations are hoisted
+// even if they are conditional in the loop, so only ones which never trap are taken:  a load
+// is taken only from the address of a variable, and only if nothing in the loop writes memory.
+
+typedef struct {
+  Ssa *ssa;
+  IR **defs;        // Indexed by `virt`
+  BB **def_bbs;     // Indexed by `virt`
+  int *def_counts;  // Indexed by original `virt`
+} Licm;
+
+static bool is_hoistable(IR *ir) {
+  switch (ir->kind) {
+  case IR_BOFS: case IR_IOFS: case IR_CAST: case IR_NEG: case IR_BITNOT:
+  case IR_ADD: case IR_SUB: case IR_MUL: case IR_BITAND: case IR_BITOR: case IR_BITXOR:
+  case IR_LSHIFT: case IR_RSHIFT:
+    return true;
+  default:
+    return false;
+  }
+}
+
+static bool is_invariant(Licm *licm, Loop *loop, VReg *vreg) {
+  if (!is_version(licm->ssa, vreg))
+    return true;
+  BB *bb = licm->def_bbs[vreg->virt];
+  return bb == NULL || !is_in_loop(bb, loop);
+}
+
+static bool is_variable_address(Licm *licm, VReg *vreg) {
+  if (!is_version(licm->ssa, vreg))
+    return false;
+  IR *def = licm->defs[vreg->virt];
+  return def != NULL && (def->kind == IR_BOFS || def->kind == IR_IOFS);
+}
+
+static bool can_hoist(Licm *licm, Loop *loop, IR *ir, bool writes) {
+  const Ssa *ssa = licm->ssa;
+  if (!is_version(ssa, ir->dst) || ir->dst->param_index >= 0 ||
+      licm->def_counts[ssa_orig(ssa, ir->dst)->virt] != 1)
+    return false;
+  if (ir->kind == IR_LOAD) {
+    if (writes || (ir->dst->vtype->flag & VRTF_VOLATILE) || !is_variable_address(licm, ir->opr1))
+      return false;
+  } else if (!is_hoistable(ir) || reads_variable_in_memory(ir)) {
+    return false;
+  }
+  return is_invariant(licm, loop, ir->opr1) && is_invariant(licm, loop, ir->opr2);
+}
+
+// Position to put code at the end of the preheader, before its jump to the header.
+static int preheader_end(Loop *loop) {
+  Vector *pirs = loop->preheader->irs;
+  int pos = pirs->len;
+  if (pos > 0 && ((IR*)pirs->data[pos - 1])->kind == IR_JMP)
+    --pos;
+  return pos;
+}
+
+static void hoist_from_loop(Licm *licm, Loop *loop) {
+  Vector *bbs = licm->ssa->bbcon->bbs;
+  BB *preheader = loop->preheader;
+  bool writes = false;
+  for (int i = 0; i < bbs->len; ++i) {
+    BB *bb = bbs->data[i];
+    if (!is_in_loop(bb, loop))
+      continue;
+    for (int j = 0; j < bb->irs->len; ++j) {
+      if (writes_memory(bb->irs->data[j]))
+        writes = true;
+    }
+  }
+
+  Vector *pirs = preheader->irs;
+  int pos = preheader_end(loop);
+  // An operand may be defined later in the order of BBs, so repeat until nothing moves.
+  for (bool moved = true; moved;) {
+    moved = false;
+    for (int i = 0; i < bbs->len; ++i) {
+      BB *bb = bbs->data[i];
+      if (!is_in_loop(bb, loop))
+        continue;
+      Vector *irs = bb->irs;
+      for (int j = 0; j < irs->len; ++j) {
+        IR *ir = irs->data[j];
+        if (!can_hoist(licm, loop, ir, writes))
+          continue;
+        vec_remove_at(irs, j--);
+        vec_insert(pirs, pos++, ir);
+        licm->def_bbs[ir->dst->virt] = preheader;
+        moved = true;
+      }
+    }
+  }
+}
+
+static IR *insert_ir(Vector *irs, int index, enum IrKind kind, VReg *dst, VReg *opr1,
+                     VReg *opr2, int size) {
+  IR *ir = arena_alloc(ir_arena, sizeof(*ir));
+  ir->kind = kind;
+  ir->dst = dst;
+  ir->opr1 = opr1;
+  ir->opr2 = opr2;
+  ir->size = size;
+  ir->value = 0;
+  vec_insert(irs, index, ir);
+  return ir;
+}
+
+static VReg *copy_before(Ssa *ssa, Vector *irs, int index, VReg *vreg) {
+  VReg *tmp = new_ssa_temp(ssa, vreg->vtype);
+  insert_ir(irs, index, IR_MOV, tmp, vreg, NULL, vreg->vtype->size);
+  return tmp;
+}
+
+static int compare_loop_depth(const void *pa, const void *pb) {
+  const Loop *a = *(const Loop**)pa, *b = *(const Loop**)pb;
+  if (a->depth != b->depth)
+    return b->depth - a->depth;
+  return a->header->index - b->header->index;
+}
+
+// Loops which have a preheader to put code in, innermost first.
+static Vector *collect_loops(Ssa *ssa) {
+  // Dominators are analyzed after folding branches.
+  analyze_loops(ssa->bbcon);
+
+  Vector *bbs = ssa->bbcon->bbs;
+  Vector *loops = new_vector();
+  for (int i = 0; i < bbs->len; ++i) {
+    BB *bb = bbs->data[i];
+    Loop *loop = bb->loop;
+    if (loop == NULL || loop->header != bb || loop->preheader == NULL ||
+        reads_flags_first(bb))
+      continue;
+    // Code is put before the jump, which must not read flags.
+    Vector *pirs = loop->preheader->irs;
+    IR *last = pirs->len > 0 ? pirs->data[pirs->len - 1] : NULL;
+    if (last != NULL && last->kind == IR_JMP && last->jmp.cond != COND_ANY)
+      continue;
+    vec_push(loops, loop);
+  }
+  QSORT(loops->data, loops->len, sizeof(*loops->data), compare_loop_depth);
+  return loops;
+}
+
+static void hoist_invariants(Ssa *ssa) {
+  Vector *loops = collect_loops(ssa);
+  if (loops->len == 0) {
+    free_vector(loops);
+    return;
+  }
+
+  Vector *bbs = ssa->bbcon->bbs;
+  int nreg = ssa->ra->vregs->len;
+  Licm licm;
+  licm.ssa = ssa;
+  licm.defs = calloc(nreg, sizeof(*licm.defs));
+  licm.def_bbs = calloc(nreg, sizeof(*licm.def_bbs));
+  licm.def_counts = calloc(nreg, sizeof(*licm.def_counts));
+  for (int i = 0; i < bbs->len; ++i) {
+    BB *bb = bbs->data[i];
+    for (int j = 0; j < bb->irs->len; ++j) {
+      IR *ir = bb->irs->data[j];
+      if (is_version(ssa, ir->dst)) {
+        licm.defs[ir->dst->virt] = ir;
+        licm.def_bbs[ir->dst->virt] = bb;
+        ++licm.def_counts[ssa_orig(ssa, ir->dst)->virt];
+      }
+    }
+  }
+
+  for (int i = 0; i < loops->len; ++i)
+    hoist_from_loop(&licm, loops->data[i]);
+
+  free(licm.def_counts);
+  free(licm.def_bbs);
+  free(licm.defs);
+  free_vector(loops);
+}
+
+// Strength reduction of induction variables: An index which steps by a constant in each
+// iteration, `i = phi(init, i + step)`, makes an address `base + i * size` step by
+// `step * size`.  The address is kept in a new register instead, which starts from the one
+// for `init` in the preheader and steps next to the index.  An `int` index is sign-extended,
+// which stays linear because it never overflows.
+// Then a comparison of the index with an invariant becomes one of the address with the
+// address for the bound, so the index dies unless something else uses it.  Addresses of an
+// array don't overflow, so the order of them is same as the one of indices.
+
+typedef struct {
+  BB *latch;
+  int entry, back;  // Indices of the preheader and the latch in predecessors of the header
+  VReg *index;      // Defined by the phi in the header
+  VReg *next;       // Defined by `step` in the latch
+  VReg *init;       // Incoming from the preheader
+  IR *step;         // next = index +/- constant
+  bool tested;      // Comparisons are replaced.
+} InductionVar;
+
+typedef struct {
+  Loop *loop;
+  InductionVar *iv;
+  VReg *base;
+  IR *cast;    // Sign extension of the index, or NULL
+  IR *scale;   // IR_MUL or IR_LSHIFT by a constant, or NULL
+  VReg *cur;   // Address for `index`
+  VReg *next;  // Address for `next`
+} DerivedIv;
+
+typedef struct {
+  Ssa *ssa;
+  int nreg;         // Registers spawned after scanning are out of the arrays.
+  IR **defs;        // Indexed by `virt`
+  BB **def_bbs;     // Indexed by `virt`
+  int *use_counts;  // Indexed by `virt`
+  bool *addresses;  // Indexed by `virt`: Used as the address of a load or a store.
+  Vector *derived;  // <DerivedIv*>
+} Ivsr;
+
+static void scan_defs_uses(Ivsr *ivsr) {
+  const Ssa *ssa = ivsr->ssa;
+  Vector *bbs = ssa->bbcon->bbs;
+  int nreg = ivsr->nreg = ssa->ra->vregs->len;
+  ivsr->defs = calloc(nreg, sizeof(*ivsr->defs));
+  ivsr->def_bbs = calloc(nreg, sizeof(*ivsr->def_bbs));
+  ivsr->use_counts = calloc(nreg, sizeof(*ivsr->use_counts));
+  ivsr->addresses = calloc(nreg, sizeof(*ivsr->addresses));
+  for (int i = 0; i < bbs->len; ++i) {
+    BB *bb = bbs->data[i];
+    for (int j = 0; j < bb->irs->len; ++j) {
+      IR *ir = bb->irs->data[j];
+      if (is_version(ssa, ir->dst)) {
+        ivsr->defs[ir->dst->virt] = ir;
+        ivsr->def_bbs[ir->dst->virt] = bb;
+      }
+      if (ir->kind == IR_PHI) {
+        for (int k = 0; k < bb->preds->len; ++k) {
+          if (is_version(ssa, ir->phi.args[k]))
+            ++ivsr->use_counts[ir->phi.args[k]->virt];
+        }
+        continue;
+      }
+      if (is_version(ssa, ir->opr1))
+        ++ivsr->use_counts[ir->opr1->virt];
+      if (is_version(ssa, ir->opr2))
+        ++ivsr->use_counts[ir->opr2->virt];
+      VReg *addr = ir->kind == IR_LOAD ? ir->opr1 : ir->kind == IR_STORE ? ir->opr2 : NULL;
+      if (is_version(ssa, addr))
+        ivsr->addresses[addr->virt] = true;
+    }
+  }
+
+  // Operands of an address with an offset (e.g. `a[i][j]`, `a[i].x`) are addresses too.
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (int i = bbs->len; --i >= 0;) {
+      BB *bb = bbs->data[i];
+      for (int j = bb->irs->len; --j >= 0;) {
+        IR *ir = bb->irs->data[j];
+        if (ir->kind != IR_ADD || !is_version(ssa, ir->dst) || !ivsr->addresses[ir->dst->virt])
+          continue;
+        VReg *oprs[] = {ir->opr1, ir->opr2};
+        for (int k = 0; k < 2; ++k) {
+          VReg *opr = oprs[k];
+          if (is_version(ssa, opr) && !ivsr->addresses[opr->virt]) {
+            ivsr->addresses[opr->virt] = true;
+            changed = true;
+          }
+        }
+      }
+    }
+  }
+}
+
+static void free_defs_uses(Ivsr *ivsr) {
+  free(ivsr->addresses);
+  free(ivsr->use_counts);
+  free(ivsr->def_bbs);
+  free(ivsr->defs);
+}
+
+static IR *def_of(Ivsr *ivsr, VReg *vreg) {
+  if (!is_version(ivsr->ssa, vreg) || vreg->virt >= ivsr->nreg)
+    return NULL;
+  return ivsr->defs[vreg->virt];
+}
+
+static bool is_loop_invariant(Ivsr *ivsr, Loop *loop, VReg *vreg) {
+  if (vreg == NULL || (vreg->flag & VRF_REF))
+    return false;
+  if (!is_version(ivsr->ssa, vreg))
+    return true;
+  if (vreg->virt >= ivsr->nreg)
+    return false;
+  BB *bb = ivsr->def_bbs[vreg->virt];
+  return bb == NULL || !is_in_loop(bb, loop);
+}
+
+// The constant which the register holds, or NULL.
+static VReg *constant_of(Ivsr *ivsr, VReg *vreg) {
+  if (vreg->flag & VRF_CONST)
+    return vreg;
+  IR *def = def_of(ivsr, vreg);
+  return def != NULL && def->kind == IR_MOV && (def->opr1->flag & VRF_CONST) ? def->opr1 : NULL;
+}
+
+static int index_of_ir(Vector *irs, IR *ir) {
+  for (int i = 0; i < irs->len; ++i) {
+    if (irs->data[i] == ir)
+      return i;
+  }
+  return -1;
+}
+
+static Vector *find_induction_vars(Ivsr *ivsr, Loop *loop) {
+  Vector *ivs = new_vector();
+  BB *header = loop->header;
+  if (header->preds->len != 2)  // One latch
+    return ivs;
+  int entry = header->preds->data[0] == loop->preheader ? 0 : 1;
+  int back = 1 - entry;
+  BB *latch = header->preds->data[back];
+  for (int i = 0; i < header->irs->len; ++i) {
+    IR *phi = header->irs->data[i];
+    if (phi->kind != IR_PHI)
+      break;
+    VReg *index = phi->dst;
+    if (IS_FLONUM(index->vtype) || index->vtype->size < 4)
+      continue;
+    VReg *next = phi->phi.args[back];
+    IR *step = def_of(ivsr, next);
+    // A variable is updated by a copy of the sum, until coalescing.
+    if (step != NULL && step->kind == IR_MOV && ivsr->def_bbs[next->virt] == latch &&
+        ivsr->use_counts[step->opr1->virt < ivsr->nreg ? step->opr1->virt : 0] == 1)
+      step = def_of(ivsr, step->opr1);
+    if (step == NULL || ivsr->def_bbs[step->dst->virt] != latch ||
+        (step->kind != IR_ADD && step->kind != IR_SUB) || step->opr1 != index ||
+        !(step->opr2->flag & VRF_CONST))
+      continue;
+    InductionVar *iv = arena_alloc(ir_arena, sizeof(*iv));
+    iv->latch = latch;
+    iv->entry = entry;
+    iv->back = back;
+    iv->index = index;
+    iv->next = next;
+    iv->init = phi->phi.args[entry];
+    iv->step = step;
+    iv->tested = false;
+    vec_push(ivs, iv);
+  }
+  return ivs;
+}
+
+// The operand multiplied by a constant.
+static VReg *scaled_operand(IR *ir) {
+  switch (ir->kind) {
+  case IR_MUL:
+    if (ir->opr1->flag & VRF_CONST)
+      return ir->opr2;
+    // Fallthrough
+  case IR_LSHIFT:
+    return (ir->opr2->flag & VRF_CONST) ? ir->opr1 : NULL;
+  default:
+    return NULL;
+  }
+}
+
+static intptr_t scale_of(IR *scale) {
+  if (scale == NULL)
+    return 1;
+  VReg *c = (scale->opr1->flag & VRF_CONST) ? scale->opr1 : scale->opr2;
+  return scale->kind == IR_MUL ? c->fixnum : (intptr_t)((uintptr_t)1 << c->fixnum);
+}
+
+// Matches `vreg = index * size`, where the index may be sign-extended from `int`.
+static bool match_scaled_index(Ivsr *ivsr, VReg *vreg, VReg *index, IR **pcast, IR **pscale) {
+  IR *def = def_of(ivsr, vreg);
+  *pcast = *pscale = NULL;
+  if (def != NULL && def->size == WORD_SIZE && !IS_FLONUM(def->dst->vtype) &&
+      scaled_operand(def) != NULL) {
+    *pscale = def;
+    vreg = scaled_operand(def);
+    def = def_of(ivsr, vreg);
+  }
+  if (vreg == index)
+    return index->vtype->size == WORD_SIZE;
+  if (def != NULL && def->kind == IR_CAST && def->opr1 == index && def->size == WORD_SIZE &&
+      !IS_FLONUM(def->dst->vtype) && index->vtype->size == 4 &&
+      !(index->vtype->flag & VRTF_UNSIGNED)) {
+    *pcast = def;
+    return true;
+  }
+  return false;
+}
+
+// Value of `base + index * size` for a constant index, which must fit in an immediate.
+static bool derived_offset(DerivedIv *d, VReg *index, intptr_t *poffset) {
+  intptr_t value = index->fixnum;
+  if (d->cast != NULL)
+    value = extend_value(value, 4, false);
+  *poffset = (intptr_t)((uintptr_t)value * (uintptr_t)scale_of(d->scale));
+  return is_im32(*poffset);
+}
+
+// Puts `dst = base + index * size` at the end of the preheader.
+static void emit_derived(Ssa *ssa, DerivedIv *d, VReg *index, VReg *dst) {
+  Vector *pirs = d->loop->preheader->irs;
+  int pos = preheader_end(d->loop);
+  intptr_t offset;
+  if (index->flag & VRF_CONST) {
+    if (!derived_offset(d, index, &offset))
+      assert(false);
+    if (offset == 0)
+      insert_ir(pirs, pos, IR_MOV, dst, d->base, NULL, WORD_SIZE);
+    else
+      insert_ir(pirs, pos, IR_ADD, dst, d->base, new_const_vreg(offset, dst->vtype), WORD_SIZE);
+    return;
+  }
+
+  VReg *vreg = index;
+  if (d->cast != NULL) {
+    VReg *tmp = new_ssa_temp(ssa, d->cast->dst->vtype);
+    insert_ir(pirs, pos++, IR_CAST, tmp, vreg, NULL, WORD_SIZE);
+    vreg = tmp;
+  }
+  if (d->scale != NULL) {
+    IR *scale = d->scale;
+    VReg *tmp = new_ssa_temp(ssa, scale->dst->vtype);
+    VReg *c = (scale->opr1->flag & VRF_CONST) ? scale->opr1 : scale->opr2;
+    insert_ir(pirs, pos++, scale->kind, tmp, vreg, c, WORD_SIZE);
+    vreg = tmp;
+  }
+  insert_ir(pirs, pos, IR_ADD, dst, d->base, vreg, WORD_SIZE);
+}
+
+static bool is_same_derived(DerivedIv *d, InductionVar *iv, VReg *base, IR *cast, IR *scale) {
+  return d->iv == iv && d->base == base && (d->cast != NULL) == (cast != NULL) &&
+         (d->scale == NULL ? scale == NULL
+                           : scale != NULL && scale->kind == d->scale->kind &&
+                                 scale_of(scale) == scale_of(d->scale));
+}
+
+static DerivedIv *add_derived(Ivsr *ivsr, Loop *loop, InductionVar *iv, VReg *base, IR *cast,
+                              IR *scale, const VRegType *vtype) {
+  Vector *derived = ivsr->derived;
+  for (int i = 0; i < derived->len; ++i) {
+    DerivedIv *d = derived->data[i];
+    if (is_same_derived(d, iv, base, cast, scale))
+      return d;
+  }
+
+  DerivedIv *d = arena_alloc(ir_arena, sizeof(*d));
+  d->loop = loop;
+  d->iv = iv;
+  d->base = base;
+  d->cast = cast;
+  d->scale = scale;
+
+  IR *step = iv->step;
+  VReg *init = constant_of(ivsr, iv->init);
+  if (init == NULL)
+    init = iv->init;
+  intptr_t delta, offset;
+  if (!derived_offset(d, step->opr2, &delta) ||
+      ((init->flag & VRF_CONST) && !derived_offset(d, init, &offset)))
+    return NULL;
+  if (step->kind == IR_SUB)
+    delta = -delta;
+
+  Ssa *ssa = ivsr->ssa;
+  VReg *orig = reg_alloc_spawn(ssa->ra, vtype, 0);
+  VReg *start = new_ssa_version(ssa, orig);
+  d->cur = new_ssa_version(ssa, orig);
+  d->next = new_ssa_version(ssa, orig);
+  emit_derived(ssa, d, init, start);
+  IR *phi = new_ir_phi(d->cur, 2);
+  phi->phi.args[iv->entry] = start;
+  phi->phi.args[iv->back] = d->next;
+  vec_insert(loop->header->irs, 0, phi);
+  Vector *lirs = iv->latch->irs;
+  insert_ir(lirs, index_of_ir(lirs, step) + 1, IR_ADD, d->next, d->cur,
+            new_const_vreg(delta, vtype), WORD_SIZE);
+  vec_push(derived, d);
+  return d;
+}
+
+// Loads and stores in the BB take the address directly from the copy at `index`, until the
+// step.
+static void propagate_address(BB *bb, int index, DerivedIv *d) {
+  Vector *irs = bb->irs;
+  IR *mov = irs->data[index];
+  int end = bb == d->iv->latch ? index_of_ir(irs, d->iv->step) : irs->len;
+  for (int i = index + 1; i < end; ++i) {
+    IR *ir = irs->data[i];
+    if (ir->kind == IR_LOAD && ir->opr1 == mov->dst)
+      ir->opr1 = d->cur;
+    else if (ir->kind == IR_STORE && ir->opr2 == mov->dst)
+      ir->opr2 = d->cur;
+  }
+}
+
+static void reduce_in_loop(Ivsr *ivsr, Loop *loop) {
+  Vector *ivs = find_induction_vars(ivsr, loop);
+  Vector *bbs = ivsr->ssa->bbcon->bbs;
+  for (int i = 0; i < bbs->len && ivs->len > 0; ++i) {
+    BB *bb = bbs->data[i];
+    if (!is_in_loop(bb, loop))
+      continue;
+    Vector *irs = bb->irs;
+    for (int j = 0; j < irs->len; ++j) {
+      IR *ir = irs->data[j];
+      if (ir->kind != IR_ADD || ir->size != WORD_SIZE || IS_FLONUM(ir->dst->vtype) ||
+          def_of(ivsr, ir->dst) != ir || !ivsr->addresses[ir->dst->virt])
+        continue;
+      for (int k = 0; k < 2; ++k) {
+        VReg *base = k == 0 ? ir->opr1 : ir->opr2;
+        VReg *scaled = k == 0 ? ir->opr2 : ir->opr1;
+        if ((base->flag & VRF_CONST) || !is_loop_invariant(ivsr, loop, base))
+          continue;
+        InductionVar *iv = NULL;
+        IR *cast, *scale;
+        for (int l = 0; l < ivs->len; ++l) {
+          InductionVar *p = ivs->data[l];
+          if (match_scaled_index(ivsr, scaled, p->index, &cast, &scale)) {
+            iv = p;
+            break;
+          }
+        }
+        // The address for `index` must not be read after the step.
+        if (iv == NULL || (bb == iv->latch && j > index_of_ir(irs, iv->step)))
+          continue;
+        DerivedIv *d = add_derived(ivsr, loop, iv, base, cast, scale, ir->dst->vtype);
+        if (d == NULL)
+          continue;
+        ir->kind = IR_MOV;
+        ir->opr1 = d->cur;
+        ir->opr2 = NULL;
+        j = index_of_ir(irs, ir);  // A phi may be inserted before.
+        propagate_address(bb, j, d);
+        break;
+      }
+    }
+  }
+  free_vector(ivs);
+}
+
+static bool is_signed_cond(enum ConditionKind cond) {
+  switch (cond) {
+  case COND_EQ: case COND_NE: case COND_LT: case COND_LE: case COND_GE: case COND_GT:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// The register which the operand holds, directly or by a copy only for it.
+static VReg *copied_from(Ivsr *ivsr, BB *bb, VReg *opr) {
+  IR *def = def_of(ivsr, opr);
+  if (def != NULL && def->kind == IR_MOV && ivsr->def_bbs[opr->virt] == bb &&
+      ivsr->use_counts[opr->virt] == 1)
+    return def->opr1;
+  return opr;
+}
+
+// Returns the operand index (1 or 2) of the compared index, or 0 if the comparison can't be
+// replaced, or -1 if it doesn't compare the index.
+static int test_operand(Ivsr *ivsr, DerivedIv *d, BB *bb, int index) {
+  InductionVar *iv = d->iv;
+  Vector *irs = bb->irs;
+  IR *cmp = irs->data[index];
+  VReg *oprs[] = {cmp->opr1, cmp->opr2};
+  for (int k = 0; k < 2; ++k) {
+    VReg *x = copied_from(ivsr, bb, oprs[k]);
+    if (x != iv->index && x != iv->next)
+      continue;
+    VReg *bound = constant_of(ivsr, oprs[1 - k]);
+    if (bound == NULL)
+      bound = oprs[1 - k];
+    IR *user = index + 1 < irs->len ? irs->data[index + 1] : NULL;
+    enum ConditionKind cond = user == NULL ? COND_NONE
+                              : user->kind == IR_JMP ? user->jmp.cond
+                              : user->kind == IR_COND ? user->cond.kind : COND_NONE;
+    intptr_t offset;
+    if (!is_signed_cond(cond) || !is_loop_invariant(ivsr, d->loop, bound) ||
+        bound->vtype->size != 4 || (bound->vtype->flag & VRTF_UNSIGNED) ||
+        ((bound->flag & VRF_CONST) && !derived_offset(d, bound, &offset)) ||
+        (x == iv->index && bb == iv->latch && index > index_of_ir(irs, iv->step)))
+      return 0;
+    return k + 1;
+  }
+  return -1;
+}
+
+// Linear function test replacement: `index < bound` becomes `cur < base + bound * size`.
+static bool replace_tests(Ivsr *ivsr, DerivedIv *d) {
+  InductionVar *iv = d->iv;
+  intptr_t size = scale_of(d->scale);
+  if (d->cast == NULL || size <= 0 || !is_im32(size))
+    return false;
+
+  Vector *tests = new_vector();  // <BB*, IR*>
+  int index_uses = 1, next_uses = 1;  // The step, and the phi.
+  Vector *bbs = ivsr->ssa->bbcon->bbs;
+  for (int i = 0; i < bbs->len; ++i) {
+    BB *bb = bbs->data[i];
+    if (!is_in_loop(bb, d->loop))
+      continue;
+    for (int j = 0; j < bb->irs->len; ++j) {
+      IR *ir = bb->irs->data[j];
+      if (ir->kind != IR_CMP)
+        continue;
+      int opr = test_operand(ivsr, d, bb, j);
+      if (opr == 0) {
+        free_vector(tests);
+        return false;
+      }
+      if (opr > 0) {
+        if (copied_from(ivsr, bb, opr == 1 ? ir->opr1 : ir->opr2) == iv->index)
+          ++index_uses;
+        else
+          ++next_uses;
+        vec_push(tests, bb);
+        vec_push(tests, ir);
+      }
+    }
+  }
+  if (tests->len == 0 || ivsr->use_counts[iv->index->virt] != index_uses ||
+      ivsr->use_counts[iv->next->virt] != next_uses) {
+    free_vector(tests);
+    return false;
+  }
+
+  Ssa *ssa = ivsr->ssa;
+  for (int i = 0; i < tests->len; i += 2) {
+    BB *bb = tests->data[i];
+    IR *cmp = tests->data[i + 1];
+    bool first = copied_from(ivsr, bb, cmp->opr1) == iv->index ||
+                 copied_from(ivsr, bb, cmp->opr1) == iv->next;
+    VReg **px = first ? &cmp->opr1 : &cmp->opr2;
+    VReg **pbound = first ? &cmp->opr2 : &cmp->opr1;
+    VReg *bound = constant_of(ivsr, *pbound);
+    VReg *limit = new_ssa_temp(ssa, d->cur->vtype);
+    emit_derived(ssa, d, bound != NULL ? bound : *pbound, limit);
+    *px = copied_from(ivsr, bb, *px) == iv->index ? d->cur : d->next;
+    *pbound = limit;
+    cmp->size = WORD_SIZE;
+  }
+  free_vector(tests);
+  iv->tested = true;
+  return true;
+}
+
+static void reduce_induction_variables(Ssa *ssa) {
+  Vector *loops = collect_loops(ssa);
+  if (loops->len == 0) {
+    free_vector(loops);
+    return;
+  }
+
+  Ivsr ivsr;
+  ivsr.ssa = ssa;
+  ivsr.derived = new_vector();
+  scan_defs_uses(&ivsr);
+  for (int i = 0; i < loops->len; ++i)
+    reduce_in_loop(&ivsr, loops->data[i]);
+  free_defs_uses(&ivsr);
+
+  if (ivsr.derived->len > 0) {
+    // Uses of indices are counted after removing the old computations of the addresses.
+    eliminate_dead_code(ssa);
+    scan_defs_uses(&ivsr);
+    bool replaced = false;
+    for (int i = 0; i < ivsr.derived->len; ++i) {
+      DerivedIv *d = ivsr.derived->data[i];
+      if (!d->iv->tested && replace_tests(&ivsr, d))
+        replaced = true;
+    }
+    free_defs_uses(&ivsr);
+    if (replaced)
+      eliminate_dead_code(ssa);
+  }
+
+  free_vector(ivsr.derived);
+  free_vector(loops);
+}
+
+// Coalescing: `t = op ...; x = MOV t` becomes `x = op ...`, if `t` is used only by the
+// move and `x` is not touched in between.  Parameters are spilled, and an operation can't
+// take both operands from the stack, so they are left.
+
+static bool touches_reg(const Ssa *ssa, IR *ir, VReg *orig) {
+  return ssa_orig(ssa, ir->dst) == orig || ssa_orig(ssa, ir->opr1) == orig ||
+         ssa_orig(ssa, ir->opr2) == orig;
+}
+
+static bool coalesce_copy(const Ssa *ssa, BB **def_bbs, BB *bb, int index) {
+  Vector *irs = bb->irs;
+  IR *mov = irs->data[index];
+  VReg *orig = ssa_orig(ssa, mov->dst);
+  for (int i = index; --i >= 0;) {
+    IR *ir = irs->data[i];
+    if (ir->dst == mov->opr1) {
+      if (ir->kind == IR_PHI || !is_same_vtype(ir->dst->vtype, mov->dst->vtype) ||
+          (ssa_orig(ssa, ir->opr1) == orig && !can_share_dst(ir, 1)) ||
+          ssa_orig(ssa, ir->opr2) == orig ||
+          (is_two_address(ir->kind) && may_spill(ssa, def_bbs, bb, mov->dst) &&
+           may_spill(ssa, def_bbs, bb, ir->opr2)))
+        return false;
+      ir->dst = mov->dst;
+      vec_remove_at(irs, index);
+      return true;
+    }
+    if (touches_reg(ssa, ir, orig))
+      return false;
+  }
+  return false;
+}
+
+static void coalesce_copies(Ssa *ssa) {
+  Vector *bbs = ssa->bbcon->bbs;
+  int nreg = ssa->ra->vregs->len;
+  int *use_counts = calloc(nreg, sizeof(*use_counts));
+  BB **def_bbs = calloc(nreg, sizeof(*def_bbs));
+  for (int i = 0; i < bbs->len; ++i) {
+    BB *bb = bbs->data[i];
+    for (int j = 0; j < bb->irs->len; ++j) {
+      IR *ir = bb->irs->data[j];
+      if (is_version(ssa, ir->dst))
+        def_bbs[ir->dst->virt] = bb;
+      if (ir->kind == IR_PHI) {
+        for (int k = 0; k < bb->preds->len; ++k) {
+          if (is_version(ssa, ir->phi.args[k]))
+            ++use_counts[ir->phi.args[k]->virt];
+        }
+      } else {
+        if (is_version(ssa, ir->opr1))
+          ++use_counts[ir->opr1->virt];
+        if (is_version(ssa, ir->opr2))
+          ++use_counts[ir->opr2->virt];
+      }
+    }
+  }
+
+  for (int i = 0; i < bbs->len; ++i) {
+    BB *bb = bbs->data[i];
+    for (int j = 0; j < bb->irs->len; ++j) {
+      IR *ir = bb->irs->data[j];
+      if (ir->kind == IR_MOV && is_version(ssa, ir->dst) && ir->dst->param_index < 0 &&
+          is_version(ssa, ir->opr1) &&
+          use_counts[ir->opr1->virt] == 1 && coalesce_copy(ssa, def_bbs, bb, j))
+        --j;
+    }
+  }
+  free(def_bbs);
+  free(use_counts);
+}
+
+// Splitting pairs: Only one operand of an instruction can be on the stack.  The allocator
+// spills the register which lives longest, so one which dies within two instructions of
+// its definition in the BB always gets a register.  Where neither operand is such, one of
+// them is copied to a new register just before.  Passes above keep pairs by `may_spill`,
+// but propagation can stretch a temporary register.
+
+#define SHORT_LIVE_RANGE  (2)
+
+typedef struct {
+  const Ssa *ssa;
+  int nreg;
+  BB **def_bbs;   // Indexed by `virt`
+  int *def_pos;   // Indexed by `virt`
+  int *last_pos;  // Indexed by `virt`: Last use in the BB of the definition, or -1.
+} LiveRanges;
+
+static bool is_short_lived(LiveRanges *lr, VReg *vreg) {
+  if (vreg == NULL || (vreg->flag & VRF_CONST))
+    return true;
+  if (!is_version(lr->ssa, vreg) || vreg->virt >= lr->nreg ||
+      (vreg->flag & (VRF_LOCAL | VRF_PARAM)) || lr->def_bbs[vreg->virt] == NULL)
+    return false;
+  int v = vreg->virt;
+  return lr->last_pos[v] >= 0 && lr->last_pos[v] - lr->def_pos[v] <= SHORT_LIVE_RANGE;
+}
+
+static void use_in(LiveRanges *lr, BB *bb, int pos, VReg *vreg) {
+  if (!is_version(lr->ssa, vreg))
+    return;
+  int v = vreg->virt;
+  if (lr->def_bbs[v] != bb)
+    lr->last_pos[v] = -1;
+  else if (lr->last_pos[v] >= 0 && lr->last_pos[v] < pos)
+    lr->last_pos[v] = pos;
+}
+
+static void split_spillable_pairs(Ssa *ssa) {
+  Vector *bbs = ssa->bbcon->bbs;
+  int nreg = ssa->ra->vregs->len;
+  LiveRanges lr;
+  lr.ssa = ssa;
+  lr.nreg = nreg;
+  lr.def_bbs = calloc(nreg, sizeof(*lr.def_bbs));
+  lr.def_pos = calloc(nreg, sizeof(*lr.def_pos));
+  lr.last_pos = calloc(nreg, sizeof(*lr.last_pos));
+  for (int i = 0; i < bbs->len; ++i) {
+    BB *bb = bbs->data[i];
+    for (int j = 0; j < bb->irs->len; ++j) {
+      IR *ir = bb->irs->data[j];
+      if (is_version(ssa, ir->dst) && ir->kind != IR_PHI) {
+        lr.def_bbs[ir->dst->virt] = bb;
+        lr.def_pos[ir->dst->virt] = lr.last_pos[ir->dst->virt] = j;
+      }
+    }
+  }
+  for (int i = 0; i < bbs->len; ++i) {
+    BB *bb = bbs->data[i];
+    for (int j = 0; j < bb->irs->len; ++j) {
+      IR *ir = bb->irs->data[j];
+      if (ir->kind == IR_PHI) {
+        for (int k = 0; k < bb->preds->len; ++k)
+          use_in(&lr, NULL, j, ir->phi.args[k]);
+      } else {
+        use_in(&lr, bb, j, ir->opr1);
+        use_in(&lr, bb, j, ir->opr2);
+      }
+    }
+  }
+
+  for (int i = 0; i < bbs->len; ++i) {
+    BB *bb = bbs->data[i];
+    Vector *irs = bb->irs;
+    for (int j = 0; j < irs->len; ++j) {
+      IR *ir = irs->data[j];
+      if (ir->kind == IR_PHI || ir->opr2 == NULL)
+        continue;
+      VReg *other = is_two_address(ir->kind) ? ir->dst : ir->opr1;
+      if (!is_short_lived(&lr, ir->opr2) && !is_short_lived(&lr, other))
+        ir->opr2 = copy_before(ssa, irs, j++, ir->opr2);
+    }
+  }
+
+  free(lr.last_pos);
+  free(lr.def_pos);
+  free(lr.def_bbs);
+}
+
+// Dead store elimination: A store to a local variable is removed if the same place is
+// overwritten in the BB before anything reads memory.  Addresses are compared by the
+// variable and the offset, so other stores don't hide them.
+
+static bool frame_address(IR **defs, VReg *vreg, VReg **pvar, intptr_t *poffset) {
+  intptr_t offset = 0;
+  IR *def = vreg->flag & VRF_CONST ? NULL : defs[vreg->virt];
+  if (def != NULL && def->kind == IR_ADD && (def->opr2->flag & VRF_CONST)) {
+    offset = def->opr2->fixnum;
+    def = def->opr1->flag & VRF_CONST ? NULL : defs[def->opr1->virt];
+  }
+  if (def == NULL || def->kind != IR_BOFS)
+    return false;
+  *pvar = def->opr1;
+  *poffset = offset;
+  return true;
+}
+
+static bool is_overwritten(IR **defs, Vector *irs, int index) {
+  IR *store = irs->data[index];
+  VReg *var;
+  intptr_t offset;
+  if (!frame_address(defs, store->opr2, &var, &offset))
+    return false;
+  for (int i = index + 1; i < irs->len; ++i) {
+    IR *ir = irs->data[i];
+    switch (ir->kind) {
+    case IR_STORE:
+      {
+        VReg *var2;
+        intptr_t offset2;
+        if (frame_address(defs, ir->opr2, &var2, &offset2) && var2 == var &&
+            offset2 <= offset && offset + store->size <= offset2 + ir->size)
+          return true;
+      }
+      break;
+    case IR_LOAD: case IR_INC: case IR_DEC: case IR_CALL: case IR_MEMCPY: case IR_CLEAR:
+    case IR_ASM:
+      return false;
+    default:
+      break;
+    }
+  }
+  return false;
+}
+
+static void eliminate_dead_stores(Ssa *ssa) {
+  Vector *bbs = ssa->bbcon->bbs;
+  int nreg = ssa->ra->vregs->len;
+  IR **defs = calloc(nreg, sizeof(*defs));
+  for (int i = 0; i < bbs->len; ++i) {
+    BB *bb = bbs->data[i];
+    for (int j = 0; j < bb->irs->len; ++j) {
+      IR *ir = bb->irs->data[j];
+      if (is_version(ssa, ir->dst))
+        defs[ir->dst->virt] = ir;
+    }
+  }
+
+  for (int i = 0; i < bbs->len; ++i) {
+    Vector *irs = ((BB*)bbs->data[i])->irs;
+    for (int j = 0; j < irs->len; ++j) {
+      IR *ir = irs->data[j];
+      if (ir->kind == IR_STORE && is_overwritten(defs, irs, j))
+        vec_remove_at(irs, j--);
+    }
+  }
+  free(defs);
+}
+
+//
+
+// Code after an unconditional jump (e.g. `goto`) is never executed.
+static void remove_unreachable_irs(BBContainer *bbcon) {
+  for (int i = 0; i < bbcon->bbs->len; ++i) {
+    BB *bb = bbcon->bbs->data[i];
+    Vector *irs = bb->irs;
+    for (int j = 0; j < irs->len - 1; ++j) {
+      IR *ir = irs->data[j];
+      if (ir->kind == IR_JMP && ir->jmp.cond == COND_ANY) {
+        irs->len = j + 1;
+        break;
+      }
+    }
+  }
+}
+
+static int count_irs(BBContainer *bbcon) {
+  int count = 0;
+  for (int i = 0; i < bbcon->bbs->len; ++i) {
+    BB *bb = bbcon->bbs->data[i];
+    count += bb->irs->len;
+  }
+  return count;
+}
+
+static void optimize_irs(RegAlloc *ra, BBContainer *bbcon) {
+  remove_unreachable_irs(bbcon);
+  if (!analyze_cfg(bbcon))
+    return;
+  remove_unreachable_bbs(bbcon);
+  BB *entry = bbcon->bbs->data[0];
+  if (entry->preds->len > 0)  // No room for incoming values of phis.
+    return;
+
+  Ssa ssa;
+  enter_ssa(&ssa, ra, bbcon);
+  propagate_consts(&ssa);
+  number_values(&ssa);
+  propagate_copies(&ssa);
+  eliminate_dead_stores(&ssa);
+  eliminate_dead_code(&ssa);
+  hoist_invariants(&ssa);
+  reduce_induction_variables(&ssa);
+  coalesce_copies(&ssa);
+  split_spillable_pairs(&ssa);
+  leave_ssa(&ssa);
+}
+
+void optimize(Function *func) {
+  int ir_count = count_irs(func->bbcon);
+  optimize_irs(func->ra, func->bbcon);
+  func->eliminated_ir_count = ir_count - count_irs(func->bbcon);
+}
@@ -0,0 +1,10 @@
+// Optimization over IR
+
+#pragma once
+
+typedef struct Function Function;
+
+extern int optimize_level;  // 0: none
+
+// Runs on IR of a function before register allocation.
+void optimize(Function *func);
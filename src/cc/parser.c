@@ -215,7 +215,7 @@ static Initializer *flatten_initializer(const Type *type, Initializer *init) {
   switch (type->kind) {
   case TY_STRUCT:
     if (init->kind == IK_MULTI) {
-      const StructInfo *sinfo = type->struct_.info;
+      StructInfo *sinfo = type->struct_.info;
       int n = sinfo->members->len;
       int m = init->multi->len;
       if (n <= 0) {
@@ -238,15 +238,13 @@ static Initializer *flatten_initializer(const Type *type, Initializer *init) {
 
         if (value->kind == IK_DOT) {
           const Name *name = value->dot.name;
-          index = var_find(sinfo->members, name);
-          if (index >= 0) {
+          const MemberPath *path = find_struct_member(sinfo, name);
+          if (path == NULL)
+            parse_error(value->token, "`%.*s' is not member of struct", name->bytes, name->chars);
+          index = (intptr_t)path->indices->data[0];
+          if (path->indices->len == 1) {
             value = value->dot.value;
           } else {
-            Vector *stack = new_vector();
-            if (search_from_anonymous(type, name, NULL, stack) == NULL)
-              parse_error(value->token, "`%.*s' is not member of struct", name->bytes, name->chars);
-
-            index = (intptr_t)stack->data[0];
             Vector *multi = new_vector();
             vec_push(multi, value);
             Initializer *init2 = malloc(sizeof(*init2));
@@ -1241,12 +1239,12 @@ static Declaration *parse_declaration(void) {
   return NULL;
 }
 
-void parse(Vector *decls) {
+void parse(Vector *decls, DeclHandler handler) {
   curscope = global_scope;
 
   while (!match(TK_EOF)) {
     Declaration *decl = parse_declaration();
-    if (decl != NULL)
+    if (decl != NULL && (handler == NULL || !(*handler)(decl)))
       vec_push(decls, decl);
   }
 }
@@ -22,7 +22,11 @@ extern Scope *curscope;
 extern Stmt *curswitch;
 extern Vector *toplevel;  // <Declaration*>
 
-void parse(Vector *decls);  // <Declaraion*>
+// Called for each declaration just after it is parsed.
+// Returns true if it consumes the declaration, then it is not added to `decls`.
+typedef bool (*DeclHandler)(Declaration *decl);
+
+void parse(Vector *decls, DeclHandler handler);  // <Declaraion*>
 
 //
 
@@ -90,6 +90,15 @@ bool check_cast(const Type *dst, const Type *src, bool zero, bool is_explicit, c
   return true;
 }
 
+// `(T2)(T1)x` is same as `(T2)x`, unless T1 drops bits which T2 keeps.
+static bool can_merge_casts(const Type *type, const Expr *cast) {
+  return type_size(type) <= type_size(cast->type)
+#ifndef __NO_FLONUM
+      && (!is_flonum(cast->type) || is_flonum(type))
+#endif
+      ;
+}
+
 Expr *make_cast(const Type *type, const Token *token, Expr *sub, bool is_explicit) {
   if (type->kind == TY_VOID || sub->type->kind == TY_VOID)
     parse_error(NULL, "cannot use `void' as a value");
@@ -140,7 +149,7 @@ Expr *make_cast(const Type *type, const Token *token, Expr *sub, bool is_explici
   }
 
   check_cast(type, sub->type, is_zero(sub), is_explicit, token);
-  if (sub->kind == EX_CAST) {
+  if (sub->kind == EX_CAST && can_merge_casts(type, sub)) {
     sub->type = type;
     return sub;
   }
@@ -656,19 +665,19 @@ static Expr *parse_member_access(Expr *target, Token *acctok) {
   }
 
   ensure_struct((Type*)type, ident, curscope);
-  int index = var_find(type->struct_.info->members, name);
-  if (index >= 0) {
-    const VarInfo *member = type->struct_.info->members->data[index];
-    const Type *type = qualified_type(member->type, target->type->qualifier);
+  const MemberPath *path = find_struct_member(type->struct_.info, name);
+  if (path == NULL)
+    parse_error(ident, "`%.*s' doesn't exist in the struct", name->bytes, name->chars);
+
+  Vector *indices = path->indices;
+  if (indices->len == 1) {
+    int index = (intptr_t)indices->data[0];
+    const Type *type = qualified_type(path->member->type, target->type->qualifier);
     return new_expr_member(acctok, type, target, ident, index);
   } else {
-    Vector *stack = new_vector();
-    const VarInfo *member = search_from_anonymous(type, ident->ident, ident, stack);
-    if (member == NULL)
-      parse_error(ident, "`%.*s' doesn't exist in the struct", name->bytes, name->chars);
     Expr *p = target;
-    for (int i = 0; i < stack->len; ++i) {
-      int index = (int)(long)stack->data[i];
+    for (int i = 0; i < indices->len; ++i) {
+      int index = (intptr_t)indices->data[i];
       const VarInfo *member = type->struct_.info->members->data[index];
       type = qualified_type(member->type, type->qualifier);
       p = new_expr_member(acctok, type, p, acctok, index);
@@ -968,17 +977,16 @@ static Type *parse_pointer(Type *type) {
     const Token *tok;
     if ((tok = match(TK_CONST)) != NULL ||
         (tok = match(TK_VOLATILE)) != NULL) {
-      // `type` might be pointing const value, so we cannot modify it.
+      // `type` might be shared, so we cannot modify it.
       // TODO: Manage primitive types.
-      // type->qualifier |= TQ_CONST;
       if (ptr_or_array(type))
-        type->qualifier |= tok->kind == TK_CONST ? TQ_CONST : TQ_VOLATILE;
+        type = (Type*)qualified_type(type, tok->kind == TK_CONST ? TQ_CONST : TQ_VOLATILE);
       continue;
     }
 
     if (!match(TK_MUL))
       break;
-    type = ptrof(type);
+    type = (Type*)ptrof(type);
   }
 
   return type;
@@ -1436,7 +1444,7 @@ static Expr *parse_cast_expr(void) {
 
       Expr *sub = parse_cast_expr();
       check_cast(type, sub->type, is_zero(sub), true, token);
-      if (sub->kind == EX_CAST) {
+      if (sub->kind == EX_CAST && type->kind != TY_VOID && can_merge_casts(type, sub)) {
         sub->type = type;
         return sub;
       }
@@ -1449,175 +1457,83 @@ static Expr *parse_cast_expr(void) {
   return parse_unary();
 }
 
-static Expr *parse_mul(void) {
-  Expr *expr = parse_cast_expr();
-
-  for (;;) {
-    enum ExprKind kind;
-    Token *tok;
-    if ((tok = match(TK_MUL)) != NULL)
-      kind = EX_MUL;
-    else if ((tok = match(TK_DIV)) != NULL)
-      kind = EX_DIV;
-    else if ((tok = match(TK_MOD)) != NULL)
-      kind = EX_MOD;
-    else
-      return expr;
-
-    Expr *lhs = expr, *rhs = parse_cast_expr();
-    expr = new_expr_num_bop(kind, tok, lhs, rhs, false);
-  }
-}
-
-static Expr *parse_add(void) {
-  Expr *expr = parse_mul();
+static Expr *new_expr_shift(enum ExprKind kind, const Token *tok, Expr *lhs, Expr *rhs) {
+  if (!is_fixnum(lhs->type->kind) ||
+      !is_fixnum(rhs->type->kind))
+    parse_error(tok, "Cannot use `%.*s' except numbers.", (int)(tok->end - tok->begin), tok->begin);
 
-  for (;;) {
-    enum ExprKind kind;
-    Token *tok;
-    if ((tok = match(TK_ADD)) != NULL)
-      kind = EX_ADD;
-    else if ((tok = match(TK_SUB)) != NULL)
-      kind = EX_SUB;
-    else
-      return expr;
-
-    Expr *lhs = expr, *rhs = parse_mul();
-    expr = new_expr_addsub(kind, tok, lhs, rhs, false);
-  }
-}
-
-static Expr *parse_shift(void) {
-  Expr *expr = parse_add();
-
-  for (;;) {
-    enum ExprKind kind;
-    Token *tok;
-    if ((tok = match(TK_LSHIFT)) != NULL)
-      kind = EX_LSHIFT;
-    else if ((tok = match(TK_RSHIFT)) != NULL)
-      kind = EX_RSHIFT;
-    else
-      return expr;
-
-    Expr *lhs = expr, *rhs = parse_add();
-    if (!is_fixnum(lhs->type->kind) ||
-        !is_fixnum(rhs->type->kind))
-      parse_error(tok, "Cannot use `%.*s' except numbers.", (int)(tok->end - tok->begin), tok->begin);
-
-    if (is_const(lhs) && is_const(rhs)) {
-      Fixnum value;
-      if (lhs->type->fixnum.is_unsigned) {
-        UFixnum lval = lhs->fixnum;
-        UFixnum rval = rhs->fixnum;
-        value = kind == EX_LSHIFT ? lval << rval : lval >> rval;
-      } else {
-        Fixnum lval = lhs->fixnum;
-        Fixnum rval = rhs->fixnum;
-        value = kind == EX_LSHIFT ? lval << rval : lval >> rval;
-      }
-      expr = new_expr_fixlit(lhs->type, tok, value);
+  if (is_const(lhs) && is_const(rhs)) {
+    Fixnum value;
+    if (lhs->type->fixnum.is_unsigned) {
+      UFixnum lval = lhs->fixnum;
+      UFixnum rval = rhs->fixnum;
+      value = kind == EX_LSHIFT ? lval << rval : lval >> rval;
     } else {
-      expr = new_expr_bop(kind, lhs->type, tok, lhs, rhs);
+      Fixnum lval = lhs->fixnum;
+      Fixnum rval = rhs->fixnum;
+      value = kind == EX_LSHIFT ? lval << rval : lval >> rval;
     }
+    return new_expr_fixlit(lhs->type, tok, value);
   }
+  return new_expr_bop(kind, lhs->type, tok, lhs, rhs);
 }
 
-static Expr *parse_cmp(void) {
-  Expr *expr = parse_shift();
-
-  for (;;) {
-    enum ExprKind kind;
-    Token *tok;
-    if ((tok = match(TK_LT)) != NULL)
-      kind = EX_LT;
-    else if ((tok = match(TK_GT)) != NULL)
-      kind = EX_GT;
-    else if ((tok = match(TK_LE)) != NULL)
-      kind = EX_LE;
-    else if ((tok = match(TK_GE)) != NULL)
-      kind = EX_GE;
-    else
-      return expr;
-
-    Expr *lhs = expr, *rhs = parse_shift();
-    expr = new_expr_cmp(kind, tok, lhs, rhs);
-  }
-}
-
-static Expr *parse_eq(void) {
-  Expr *expr = parse_cmp();
-
-  for (;;) {
-    enum ExprKind kind;
-    Token *tok;
-    if ((tok = match(TK_EQ)) != NULL)
-      kind = EX_EQ;
-    else if ((tok = match(TK_NE)) != NULL)
-      kind = EX_NE;
-    else
-      return expr;
-
-    Expr *lhs = expr, *rhs = parse_cmp();
-    expr = new_expr_cmp(kind, tok, lhs, rhs);
-  }
-}
-
-static Expr *parse_and(void) {
-  Expr *expr = parse_eq();
-  for (;;) {
-    Token *tok;
-    if ((tok = match(TK_AND)) == NULL)
-      return expr;
-
-    Expr *lhs = expr, *rhs = parse_eq();
-    expr = new_expr_int_bop(EX_BITAND, tok, lhs, rhs, false);
-  }
-}
-
-static Expr *parse_xor(void) {
-  Expr *expr = parse_and();
-  for (;;) {
-    Token *tok;
-    if ((tok = match(TK_HAT)) == NULL)
-      return expr;
+// Precedence of binary operators, indexed by token kind: higher binds tighter,
+// and 0 means the token is not a binary operator.
+static const int kBinaryPrec[] = {
+  [TK_LOGIOR] = 1,
+  [TK_LOGAND] = 2,
+  [TK_OR] = 3,
+  [TK_HAT] = 4,
+  [TK_AND] = 5,
+  [TK_EQ] = 6, [TK_NE] = 6,
+  [TK_LT] = 7, [TK_GT] = 7, [TK_LE] = 7, [TK_GE] = 7,
+  [TK_LSHIFT] = 8, [TK_RSHIFT] = 8,
+  [TK_ADD] = 9, [TK_SUB] = 9,
+  [TK_MUL] = 10, [TK_DIV] = 10, [TK_MOD] = 10,
+};
 
-    Expr *lhs = expr, *rhs = parse_and();
-    expr = new_expr_int_bop(EX_BITXOR, tok, lhs, rhs, false);
+static Expr *new_expr_binary(const Token *tok, Expr *lhs, Expr *rhs) {
+  switch (tok->kind) {
+  case TK_MUL:  return new_expr_num_bop(EX_MUL, tok, lhs, rhs, false);
+  case TK_DIV:  return new_expr_num_bop(EX_DIV, tok, lhs, rhs, false);
+  case TK_MOD:  return new_expr_num_bop(EX_MOD, tok, lhs, rhs, false);
+  case TK_ADD:  return new_expr_addsub(EX_ADD, tok, lhs, rhs, false);
+  case TK_SUB:  return new_expr_addsub(EX_SUB, tok, lhs, rhs, false);
+  case TK_LSHIFT:  return new_expr_shift(EX_LSHIFT, tok, lhs, rhs);
+  case TK_RSHIFT:  return new_expr_shift(EX_RSHIFT, tok, lhs, rhs);
+  case TK_LT:  return new_expr_cmp(EX_LT, tok, lhs, rhs);
+  case TK_GT:  return new_expr_cmp(EX_GT, tok, lhs, rhs);
+  case TK_LE:  return new_expr_cmp(EX_LE, tok, lhs, rhs);
+  case TK_GE:  return new_expr_cmp(EX_GE, tok, lhs, rhs);
+  case TK_EQ:  return new_expr_cmp(EX_EQ, tok, lhs, rhs);
+  case TK_NE:  return new_expr_cmp(EX_NE, tok, lhs, rhs);
+  case TK_AND:  return new_expr_int_bop(EX_BITAND, tok, lhs, rhs, false);
+  case TK_HAT:  return new_expr_int_bop(EX_BITXOR, tok, lhs, rhs, false);
+  case TK_OR:   return new_expr_int_bop(EX_BITOR, tok, lhs, rhs, false);
+  case TK_LOGAND:  return new_expr_bop(EX_LOGAND, &tyBool, tok, make_cond(lhs), make_cond(rhs));
+  case TK_LOGIOR:  return new_expr_bop(EX_LOGIOR, &tyBool, tok, make_cond(lhs), make_cond(rhs));
+  default:
+    assert(false);
+    return NULL;
   }
 }
 
-static Expr *parse_or(void) {
-  Expr *expr = parse_xor();
+// Precedence climbing: parses operators which bind at least as tight as `min_prec`,
+// left associative, so an operand needs only one call per nested operator.
+static Expr *parse_binary(int min_prec) {
+  Expr *expr = parse_cast_expr();
   for (;;) {
-    Token *tok;
-    if ((tok = match(TK_OR)) == NULL)
+    Token *tok = fetch_token();
+    if (tok->kind >= sizeof(kBinaryPrec) / sizeof(*kBinaryPrec))
       return expr;
-
-    Expr *lhs = expr, *rhs = parse_xor();
-    expr = new_expr_int_bop(EX_BITOR, tok, lhs, rhs, false);
-  }
-}
-
-static Expr *parse_logand(void) {
-  Expr *expr = parse_or();
-  for (;;) {
-    Token *tok;
-    if ((tok = match(TK_LOGAND)) != NULL)
-      expr = new_expr_bop(EX_LOGAND, &tyBool, tok, make_cond(expr), make_cond(parse_or()));
-    else
+    int prec = kBinaryPrec[tok->kind];
+    if (prec < min_prec)  // Also for non operators, because `min_prec` is at least 1.
       return expr;
-  }
-}
 
-static Expr *parse_logior(void) {
-  Expr *expr = parse_logand();
-  for (;;) {
-    Token *tok;
-    if ((tok = match(TK_LOGIOR)) != NULL)
-      expr = new_expr_bop(EX_LOGIOR, &tyBool, tok, make_cond(expr), make_cond(parse_logand()));
-    else
-      return expr;
+    match(tok->kind);
+    Expr *rhs = parse_binary(prec + 1);
+    expr = new_expr_binary(tok, expr, rhs);
   }
 }
 
@@ -1675,7 +1591,7 @@ static const Type *choose_type(Expr *tval, Expr *fval) {
 }
 
 static Expr *parse_conditional(void) {
-  Expr *expr = parse_logior();
+  Expr *expr = parse_binary(1);
   for (;;) {
     const Token *tok;
     if ((tok = match(TK_QUESTION)) == NULL)
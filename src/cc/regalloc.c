@@ -35,7 +35,7 @@ static void spill_vreg(RegAlloc *ra, VReg *vreg) {
 // Register allocator
 
 RegAlloc *new_reg_alloc(int phys_max) {
-  RegAlloc *ra = malloc(sizeof(*ra));
+  RegAlloc *ra = arena_alloc(ir_arena, sizeof(*ra));
   ra->vregs = new_vector();
   //ra->regno = 0;
   vec_clear(ra->vregs);
@@ -132,7 +132,7 @@ static void set_inout_interval(Vector *regs, LiveInterval *intervals, int nip) {
 
 static LiveInterval **check_live_interval(BBContainer *bbcon, int vreg_count,
                                           LiveInterval **pintervals) {
-  LiveInterval *intervals = malloc(sizeof(LiveInterval) * vreg_count);
+  LiveInterval *intervals = arena_alloc(ir_arena, sizeof(LiveInterval) * vreg_count);
   for (int i = 0; i < vreg_count; ++i) {
     LiveInterval *li = &intervals[i];
     li->virt = i;
@@ -166,7 +166,7 @@ static LiveInterval **check_live_interval(BBContainer *bbcon, int vreg_count,
   }
 
   // Sort by start, end
-  LiveInterval **sorted_intervals = malloc(sizeof(LiveInterval*) * vreg_count);
+  LiveInterval **sorted_intervals = arena_alloc(ir_arena, sizeof(LiveInterval*) * vreg_count);
   for (int i = 0; i < vreg_count; ++i)
     sorted_intervals[i] = &intervals[i];
   QSORT(sorted_intervals, vreg_count, sizeof(LiveInterval*), sort_live_interval);
@@ -294,6 +294,13 @@ static int insert_load_store_spilled(BBContainer *bbcon, Vector *vregs, const in
         load_size = WORD_SIZE;
         break;
 
+      case IR_INC:
+      case IR_DEC:
+      case IR_CLEAR:
+        flag = 1;
+        load_size = WORD_SIZE;
+        break;
+
       case IR_BOFS:
       case IR_IOFS:
       case IR_SOFS:
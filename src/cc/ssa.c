@@ -0,0 +1,572 @@
+#include "ssa.h"
+
+#include <assert.h>
+#include <stdlib.h>  // malloc
+
+#include "ir.h"
+#include "regalloc.h"
+#include "util.h"
+
+// Control flow graph
+
+static void add_cfg_edge(BB *bb, BB *succ) {
+  if (vec_contains(bb->succs, succ))
+    return;
+  vec_push(bb->succs, succ);
+  vec_push(succ->preds, bb);
+}
+
+bool analyze_cfg(BBContainer *bbcon) {
+  Vector *bbs = bbcon->bbs;
+  for (int i = 0; i < bbs->len; ++i) {
+    BB *bb = bbs->data[i];
+    bb->index = i;
+    if (bb->preds == NULL) {
+      bb->preds = new_vector();
+      bb->succs = new_vector();
+    } else {
+      vec_clear(bb->preds);
+      vec_clear(bb->succs);
+    }
+  }
+
+  for (int i = 0; i < bbs->len; ++i) {
+    BB *bb = bbs->data[i];
+    Vector *irs = bb->irs;
+    for (int j = 0; j < irs->len - 1; ++j) {
+      IR *ir = irs->data[j];
+      if (ir->kind == IR_JMP)
+        return false;
+    }
+
+    IR *jmp = irs->len > 0 ? irs->data[irs->len - 1] : NULL;
+    if (jmp != NULL && jmp->kind != IR_JMP)
+      jmp = NULL;
+    if ((jmp == NULL || jmp->jmp.cond != COND_ANY) && bb->next != NULL)
+      add_cfg_edge(bb, bb->next);
+    if (jmp != NULL)
+      add_cfg_edge(bb, jmp->jmp.bb);
+  }
+  return true;
+}
+
+void remove_cfg_edge(BB *bb, BB *succ) {
+  for (int i = 0; i < bb->succs->len; ++i) {
+    if (bb->succs->data[i] == succ) {
+      vec_remove_at(bb->succs, i);
+      break;
+    }
+  }
+
+  Vector *preds = succ->preds;
+  int index;
+  for (index = 0; index < preds->len; ++index) {
+    if (preds->data[index] == bb)
+      break;
+  }
+  assert(index < preds->len);
+  vec_remove_at(preds, index);
+
+  Vector *irs = succ->irs;
+  for (int i = 0; i < irs->len; ++i) {
+    IR *ir = irs->data[i];
+    if (ir->kind != IR_PHI)
+      break;
+    for (int j = index; j < preds->len; ++j)
+      ir->phi.args[j] = ir->phi.args[j + 1];
+  }
+}
+
+static bool *reachable_bbs(BBContainer *bbcon) {
+  Vector *bbs = bbcon->bbs;
+  bool *reachable = calloc(bbs->len, sizeof(*reachable));
+  Vector *stack = new_vector();
+  reachable[0] = true;
+  vec_push(stack, bbs->data[0]);
+  while (stack->len > 0) {
+    BB *bb = vec_pop(stack);
+    for (int i = 0; i < bb->succs->len; ++i) {
+      BB *succ = bb->succs->data[i];
+      if (!reachable[succ->index]) {
+        reachable[succ->index] = true;
+        vec_push(stack, succ);
+      }
+    }
+  }
+  free_vector(stack);
+  return reachable;
+}
+
+void remove_unreachable_bbs(BBContainer *bbcon) {
+  bool *reachable = reachable_bbs(bbcon);
+
+  Vector *bbs = bbcon->bbs;
+  int last = bbs->len - 1;
+  for (int i = last; i >= 0; --i) {
+    BB *bb = bbs->data[i];
+    if (reachable[bb->index])
+      continue;
+    while (bb->succs->len > 0)
+      remove_cfg_edge(bb, bb->succs->data[bb->succs->len - 1]);
+  }
+  for (int i = last; i >= 0; --i) {
+    BB *bb = bbs->data[i];
+    if (reachable[bb->index])
+      continue;
+    assert(bb->preds->len == 0);
+    if (i == last)
+      vec_clear(bb->irs);
+    else
+      remove_bb_at(bbcon, i);
+  }
+  free(reachable);
+
+  for (int i = 0; i < bbs->len; ++i) {
+    BB *bb = bbs->data[i];
+    bb->index = i;
+  }
+}
+
+static BB *intersect_dominators(BB *bb1, BB *bb2, const int *rpo_nums) {
+  while (bb1 != bb2) {
+    while (rpo_nums[bb1->index] > rpo_nums[bb2->index])
+      bb1 = bb1->idom;
+    while (rpo_nums[bb2->index] > rpo_nums[bb1->index])
+      bb2 = bb2->idom;
+  }
+  return bb1;
+}
+
+// "A Simple, Fast Dominance Algorithm" by Cooper, Harvey and Kennedy:
+// Iterate over BBs in reverse postorder until immediate dominators settle.
+void analyze_dominators(BBContainer *bbcon) {
+  Vector *bbs = bbcon->bbs;
+  int n = bbs->len;
+  int *rpo_nums = malloc(sizeof(*rpo_nums) * n);
+  BB **rpo = malloc(sizeof(*rpo) * n);
+  BB **stack = malloc(sizeof(*stack) * n);
+  int *edges = malloc(sizeof(*edges) * n);
+  for (int i = 0; i < n; ++i) {
+    BB *bb = bbs->data[i];
+    bb->idom = NULL;
+    rpo_nums[i] = -1;
+  }
+
+  // Depth first search, to put BBs in reverse postorder.
+  BB *entry = bbs->data[0];
+  int count = n;
+  int sp = 0;
+  stack[sp] = entry;
+  edges[sp++] = 0;
+  rpo_nums[entry->index] = n;
+  while (sp > 0) {
+    BB *bb = stack[sp - 1];
+    if (edges[sp - 1] < bb->succs->len) {
+      BB *succ = bb->succs->data[edges[sp - 1]++];
+      if (rpo_nums[succ->index] < 0) {
+        rpo_nums[succ->index] = n;
+        stack[sp] = succ;
+        edges[sp++] = 0;
+      }
+    } else {
+      rpo[--count] = bb;
+      --sp;
+    }
+  }
+  for (int i = count; i < n; ++i)
+    rpo_nums[rpo[i]->index] = i;
+
+  entry->idom = entry;
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (int i = count + 1; i < n; ++i) {
+      BB *bb = rpo[i];
+      BB *idom = NULL;
+      for (int j = 0; j < bb->preds->len; ++j) {
+        BB *pred = bb->preds->data[j];
+        if (pred->idom == NULL)  // Not processed yet.
+          continue;
+        idom = idom == NULL ? pred : intersect_dominators(pred, idom, rpo_nums);
+      }
+      if (bb->idom != idom) {
+        bb->idom = idom;
+        changed = true;
+      }
+    }
+  }
+  entry->idom = NULL;
+
+  free(edges);
+  free(stack);
+  free(rpo);
+  free(rpo_nums);
+}
+
+static bool dominates(BB *dom, BB *bb) {
+  for (; bb != NULL; bb = bb->idom) {
+    if (bb == dom)
+      return true;
+  }
+  return false;
+}
+
+bool is_in_loop(BB *bb, Loop *loop) {
+  for (Loop *p = bb->loop; p != NULL; p = p->parent) {
+    if (p == loop)
+      return true;
+  }
+  return false;
+}
+
+typedef struct {
+  Loop *loop;
+  Vector *bbs;  // <BB*>
+} LoopBody;
+
+static int compare_loop_size(const void *pa, const void *pb) {
+  const LoopBody *a = pa, *b = pb;
+  if (a->bbs->len != b->bbs->len)
+    return b->bbs->len - a->bbs->len;
+  return a->loop->header->index - b->loop->header->index;
+}
+
+// An edge to a BB which dominates the source is a back edge, and BBs which reach it without
+// passing through the header make the loop.  Natural loops are nested or disjoint, so
+// putting BBs into larger loops first leaves them in the innermost ones.
+//
+// Preheaders are not inserted here, because labels are allocated on the main thread:
+// `for`, `while` and `do` are entered from a BB which has the header as its only successor,
+// and that BB is taken as the preheader.
+void analyze_loops(BBContainer *bbcon) {
+  Vector *bbs = bbcon->bbs;
+  int nbb = bbs->len;
+  LoopBody *bodies = malloc(sizeof(*bodies) * nbb);
+  int nloop = 0;
+  int *marks = malloc(sizeof(*marks) * nbb);
+  Vector *work = new_vector();
+  for (int i = 0; i < nbb; ++i) {
+    BB *bb = bbs->data[i];
+    bb->loop = NULL;
+    marks[i] = -1;
+  }
+
+  for (int i = 0; i < nbb; ++i) {
+    BB *header = bbs->data[i];
+    Vector *body = NULL;
+    for (int j = 0; j < header->preds->len; ++j) {
+      BB *latch = header->preds->data[j];
+      if (!dominates(header, latch))
+        continue;
+      if (body == NULL) {
+        body = new_vector();
+        vec_push(body, header);
+        marks[header->index] = i;
+      }
+      vec_push(work, latch);
+      while (work->len > 0) {
+        BB *bb = vec_pop(work);
+        if (marks[bb->index] == i)
+          continue;
+        marks[bb->index] = i;
+        vec_push(body, bb);
+        for (int k = 0; k < bb->preds->len; ++k)
+          vec_push(work, bb->preds->data[k]);
+      }
+    }
+    if (body == NULL)
+      continue;
+
+    Loop *loop = arena_alloc(ir_arena, sizeof(*loop));
+    loop->header = header;
+    loop->preheader = NULL;
+    loop->parent = NULL;
+    loop->depth = 1;
+    bodies[nloop].loop = loop;
+    bodies[nloop++].bbs = body;
+  }
+
+  QSORT(bodies, nloop, sizeof(*bodies), compare_loop_size);
+  for (int i = 0; i < nloop; ++i) {
+    Loop *loop = bodies[i].loop;
+    Vector *body = bodies[i].bbs;
+    loop->parent = loop->header->loop;
+    if (loop->parent != NULL)
+      loop->depth = loop->parent->depth + 1;
+    for (int j = 0; j < body->len; ++j)
+      ((BB*)body->data[j])->loop = loop;
+  }
+
+  for (int i = 0; i < nloop; ++i) {
+    Loop *loop = bodies[i].loop;
+    BB *header = loop->header;
+    BB *preheader = NULL;
+    for (int j = 0; j < header->preds->len; ++j) {
+      BB *pred = header->preds->data[j];
+      if (is_in_loop(pred, loop))
+        continue;
+      if (preheader != NULL) {
+        preheader = NULL;
+        break;
+      }
+      preheader = pred;
+    }
+    if (preheader != NULL && preheader->succs->len == 1)
+      loop->preheader = preheader;
+    free_vector(bodies[i].bbs);
+  }
+
+  free_vector(work);
+  free(marks);
+  free(bodies);
+}
+
+// SSA
+
+bool is_ssa_reg(const VReg *vreg) {
+  return vreg != NULL && !(vreg->flag & (VRF_CONST | VRF_REF));
+}
+
+VReg *ssa_orig(const Ssa *ssa, VReg *vreg) {
+  if (vreg != NULL && vreg->virt < ssa->origs->len) {
+    VReg *orig = ssa->origs->data[vreg->virt];
+    if (orig != NULL)
+      return orig;
+  }
+  return vreg;
+}
+
+VReg *new_ssa_version(Ssa *ssa, VReg *orig) {
+  VReg *vreg = reg_alloc_spawn(ssa->ra, orig->vtype, orig->flag);
+  vreg->param_index = orig->param_index;
+  while (ssa->origs->len < vreg->virt)
+    vec_push(ssa->origs, NULL);
+  vec_push(ssa->origs, orig);
+  return vreg;
+}
+
+VReg *new_ssa_temp(Ssa *ssa, const VRegType *vtype) {
+  return new_ssa_version(ssa, reg_alloc_spawn(ssa->ra, vtype, 0));
+}
+
+static Vector **dominance_frontiers(BBContainer *bbcon) {
+  Vector *bbs = bbcon->bbs;
+  Vector **frontiers = malloc(sizeof(*frontiers) * bbs->len);
+  for (int i = 0; i < bbs->len; ++i)
+    frontiers[i] = new_vector();
+
+  for (int i = 0; i < bbs->len; ++i) {
+    BB *bb = bbs->data[i];
+    if (bb->preds->len < 2)
+      continue;
+    for (int j = 0; j < bb->preds->len; ++j) {
+      for (BB *runner = bb->preds->data[j]; runner != bb->idom; runner = runner->idom) {
+        if (!vec_contains(frontiers[runner->index], bb))
+          vec_push(frontiers[runner->index], bb);
+      }
+    }
+  }
+  return frontiers;
+}
+
+// Semi-pruned form: Only registers which are used across BBs get phis.
+static void insert_phis(Ssa *ssa) {
+  Vector *bbs = ssa->bbcon->bbs;
+  Vector *vregs = ssa->ra->vregs;
+  int nbb = bbs->len, nreg = vregs->len;
+
+  bool *global = ssa->globals = calloc(nreg, sizeof(*global));
+  int *killed = malloc(sizeof(*killed) * nreg);
+  Vector **def_bbs = calloc(nreg, sizeof(*def_bbs));
+  for (int i = 0; i < nreg; ++i)
+    killed[i] = -1;
+  for (int i = 0; i < nbb; ++i) {
+    BB *bb = bbs->data[i];
+    for (int j = 0; j < bb->irs->len; ++j) {
+      IR *ir = bb->irs->data[j];
+      VReg *oprs[] = {ir->opr1, ir->opr2};
+      for (int k = 0; k < 2; ++k) {
+        VReg *opr = oprs[k];
+        if (is_ssa_reg(opr) && killed[opr->virt] != i)
+          global[opr->virt] = true;
+      }
+      VReg *dst = ir->dst;
+      if (is_ssa_reg(dst)) {
+        killed[dst->virt] = i;
+        Vector *v = def_bbs[dst->virt];
+        if (v == NULL)
+          def_bbs[dst->virt] = v = new_vector();
+        if (v->len == 0 || v->data[v->len - 1] != bb)
+          vec_push(v, bb);
+      }
+    }
+  }
+
+  Vector **frontiers = dominance_frontiers(ssa->bbcon);
+  int *has_phi = malloc(sizeof(*has_phi) * nbb);
+  int *queued = malloc(sizeof(*queued) * nbb);
+  for (int i = 0; i < nbb; ++i)
+    has_phi[i] = queued[i] = -1;
+  for (int v = 0; v < nreg; ++v) {
+    Vector *work = def_bbs[v];
+    if (work == NULL)
+      continue;
+    if (global[v]) {
+      VReg *vreg = vregs->data[v];
+      for (int i = 0; i < work->len; ++i)
+        queued[((BB*)work->data[i])->index] = v;
+      while (work->len > 0) {
+        BB *bb = vec_pop(work);
+        Vector *frontier = frontiers[bb->index];
+        for (int i = 0; i < frontier->len; ++i) {
+          BB *f = frontier->data[i];
+          if (has_phi[f->index] == v)
+            continue;
+          has_phi[f->index] = v;
+          vec_insert(f->irs, 0, new_ir_phi(vreg, f->preds->len));
+          if (queued[f->index] != v) {
+            queued[f->index] = v;
+            vec_push(work, f);
+          }
+        }
+      }
+    }
+    free_vector(work);
+  }
+
+  free(queued);
+  free(has_phi);
+  for (int i = 0; i < nbb; ++i)
+    free_vector(frontiers[i]);
+  free(frontiers);
+  free(def_bbs);
+  free(killed);
+}
+
+typedef struct {
+  Ssa *ssa;
+  Vector **stacks;    // <VReg*>, indexed by original `virt`: Versions in scope.
+  Vector *pushed;     // <VReg*>: Originals, to pop at leaving a BB.
+  Vector **children;  // <BB*>: Dominator tree.
+} Renamer;
+
+static VReg *current_version(Renamer *renamer, VReg *vreg) {
+  Vector *stack = renamer->stacks[vreg->virt];
+  // No definition reaches: Use the original, which holds the incoming value of a parameter.
+  return stack != NULL && stack->len > 0 ? stack->data[stack->len - 1] : vreg;
+}
+
+static void rename_bb(Renamer *renamer, BB *bb) {
+  int pushed = renamer->pushed->len;
+  Vector *irs = bb->irs;
+  for (int i = 0; i < irs->len; ++i) {
+    IR *ir = irs->data[i];
+    if (ir->kind != IR_PHI) {
+      if (is_ssa_reg(ir->opr1))
+        ir->opr1 = current_version(renamer, ir->opr1);
+      if (is_ssa_reg(ir->opr2))
+        ir->opr2 = current_version(renamer, ir->opr2);
+    }
+    VReg *dst = ir->dst;
+    if (is_ssa_reg(dst)) {
+      Vector *stack = renamer->stacks[dst->virt];
+      if (stack == NULL)
+        renamer->stacks[dst->virt] = stack = new_vector();
+      ir->dst = new_ssa_version(renamer->ssa, dst);
+      vec_push(stack, ir->dst);
+      vec_push(renamer->pushed, dst);
+    }
+  }
+
+  for (int i = 0; i < bb->succs->len; ++i) {
+    BB *succ = bb->succs->data[i];
+    int index;
+    for (index = 0; succ->preds->data[index] != bb; ++index)
+      ;
+    for (int j = 0; j < succ->irs->len; ++j) {
+      IR *ir = succ->irs->data[j];
+      if (ir->kind != IR_PHI)
+        break;
+      ir->phi.args[index] = current_version(renamer, ssa_orig(renamer->ssa, ir->dst));
+    }
+  }
+
+  Vector *children = renamer->children[bb->index];
+  for (int i = 0; i < children->len; ++i)
+    rename_bb(renamer, children->data[i]);
+
+  while (renamer->pushed->len > pushed) {
+    VReg *orig = vec_pop(renamer->pushed);
+    vec_pop(renamer->stacks[orig->virt]);
+  }
+}
+
+void enter_ssa(Ssa *ssa, RegAlloc *ra, BBContainer *bbcon) {
+  ssa->ra = ra;
+  ssa->bbcon = bbcon;
+  ssa->origs = new_vector();
+
+  Vector *bbs = bbcon->bbs;
+  int nbb = bbs->len, nreg = ra->vregs->len;
+  analyze_dominators(bbcon);
+  insert_phis(ssa);
+
+  Renamer renamer;
+  renamer.ssa = ssa;
+  renamer.stacks = calloc(nreg, sizeof(*renamer.stacks));
+  renamer.pushed = new_vector();
+  renamer.children = malloc(sizeof(*renamer.children) * nbb);
+  for (int i = 0; i < nbb; ++i)
+    renamer.children[i] = new_vector();
+  for (int i = 1; i < nbb; ++i) {
+    BB *bb = bbs->data[i];
+    assert(bb->idom != NULL);
+    vec_push(renamer.children[bb->idom->index], bb);
+  }
+
+  rename_bb(&renamer, bbs->data[0]);
+
+  for (int i = 0; i < nbb; ++i)
+    free_vector(renamer.children[i]);
+  free(renamer.children);
+  free_vector(renamer.pushed);
+  for (int i = 0; i < nreg; ++i) {
+    if (renamer.stacks[i] != NULL)
+      free_vector(renamer.stacks[i]);
+  }
+  free(renamer.stacks);
+}
+
+void leave_ssa(Ssa *ssa) {
+  Vector *bbs = ssa->bbcon->bbs;
+  for (int i = 0; i < bbs->len; ++i) {
+    BB *bb = bbs->data[i];
+    Vector *irs = bb->irs;
+    for (int j = 0; j < irs->len; ++j) {
+      IR *ir = irs->data[j];
+      if (ir->kind == IR_PHI) {
+        vec_remove_at(irs, j--);
+        continue;
+      }
+      ir->dst = ssa_orig(ssa, ir->dst);
+      ir->opr1 = ssa_orig(ssa, ir->opr1);
+      ir->opr2 = ssa_orig(ssa, ir->opr2);
+    }
+  }
+
+  // Versions are gone, so renumber the remaining registers.
+  Vector *vregs = ssa->ra->vregs;
+  int n = 0;
+  for (int i = 0; i < vregs->len; ++i) {
+    if (ssa_orig(ssa, vregs->data[i]) != vregs->data[i])
+      continue;
+    VReg *vreg = vregs->data[i];
+    vreg->virt = n;
+    vregs->data[n++] = vreg;
+  }
+  vregs->len = n;
+
+  free_vector(ssa->origs);
+  ssa->origs = NULL;
+  free(ssa->globals);
+  ssa->globals = NULL;
+}
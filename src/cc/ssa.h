@@ -0,0 +1,55 @@
+// Static single assignment form
+
+#pragma once
+
+#include <stdbool.h>
+
+typedef struct BB BB;
+typedef struct BBContainer BBContainer;
+typedef struct Loop Loop;
+typedef struct RegAlloc RegAlloc;
+typedef struct VReg VReg;
+typedef struct VRegType VRegType;
+typedef struct Vector Vector;
+
+// Control flow graph
+
+// Sets `index`, `preds` and `succs` of each BB.
+// Returns false if a jump exists in the middle of a BB, which the graph cannot represent.
+bool analyze_cfg(BBContainer *bbcon);
+// Removes the edge, with its arguments of phis in `succ`.
+void remove_cfg_edge(BB *bb, BB *succ);
+// Removes BBs which are not reachable from the entry.  The last BB (return) is kept, but emptied.
+void remove_unreachable_bbs(BBContainer *bbcon);
+// Sets `idom` of each BB.
+void analyze_dominators(BBContainer *bbcon);
+// Sets `loop` of each BB.  Dominators must be analyzed.
+void analyze_loops(BBContainer *bbcon);
+// Whether the BB is in the loop, or in an inner one.
+bool is_in_loop(BB *bb, Loop *loop);
+
+// SSA
+
+// Each definition of a register gets its own version, and `IR_PHI` merges versions at joins.
+// Versions are spawned from `RegAlloc`, and are mapped back to their original register when
+// leaving SSA.  It is valid as long as live ranges of versions of a register don't overlap,
+// which holds unless registers are propagated.
+typedef struct Ssa {
+  RegAlloc *ra;
+  BBContainer *bbcon;
+  Vector *origs;  // <VReg*>, indexed by `virt`: original register of a version, or NULL.
+  bool *globals;  // Indexed by original `virt`: Used across BBs, so phis are placed at joins.
+} Ssa;
+
+bool is_ssa_reg(const VReg *vreg);
+// Returns the original register of a version, or `vreg` itself.
+VReg *ssa_orig(const Ssa *ssa, VReg *vreg);
+
+// Spawns a version of the original register.
+VReg *new_ssa_version(Ssa *ssa, VReg *orig);
+// Spawns a version of a new register, to hold a value temporarily.
+VReg *new_ssa_temp(Ssa *ssa, const VRegType *vtype);
+
+// CFG must be analyzed, and all BBs must be reachable from the entry.
+void enter_ssa(Ssa *ssa, RegAlloc *ra, BBContainer *bbcon);
+void leave_ssa(Ssa *ssa);
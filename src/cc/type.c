@@ -173,12 +173,165 @@ const Type *get_fixnum_type(enum FixnumKind kind, bool is_unsigned, int qualifie
   return &kFixnumTypeTable[is_unsigned][qualifier & 3][kind];
 }
 
-Type *ptrof(const Type *type) {
-  Type *ptr = malloc(sizeof(*ptr));
-  ptr->kind = TY_PTR;
-  ptr->qualifier = 0;
-  ptr->pa.ptrof = type;
-  return ptr;
+static Type *clone_type(const Type *type) {
+  Type *clone = malloc(sizeof(*clone));
+  memcpy(clone, type, sizeof(*clone));
+  return clone;
+}
+
+// Type table
+//
+// Open addressing with linear probing.  Keys are compared with the given function,
+// and the hash must be consistent with it.
+
+#define HASH_TYPE_MUL  (0x9e3779b1U)
+#define HASH_MIX(hash, value)  (((hash) ^ (uint32_t)(value)) * HASH_TYPE_MUL)
+#define HASH_PTR(hash, ptr)  HASH_MIX(hash, (uintptr_t)(ptr) >> 3)
+
+typedef bool (*TypeEqualFunc)(const Type *type1, const Type *type2);
+
+// Returns the entry for the key, or an empty one to put it.
+static TypeTableEntry *find_type_entry(const TypeTable *table, const Type *key, uint32_t hash,
+                                       TypeEqualFunc equal) {
+  uint32_t mask = table->capacity - 1;
+  for (uint32_t index = hash & mask; ; index = (index + 1) & mask) {
+    TypeTableEntry *entry = &table->entries[index];
+    if (entry->key == NULL || (entry->hash == hash && (*equal)(entry->key, key)))
+      return entry;
+  }
+}
+
+static TypeTableEntry *get_type_entry(const TypeTable *table, const Type *key, uint32_t hash,
+                                      TypeEqualFunc equal) {
+  if (table->count == 0)
+    return NULL;
+  TypeTableEntry *entry = find_type_entry(table, key, hash, equal);
+  return entry->key != NULL ? entry : NULL;
+}
+
+static void put_type_entry(TypeTable *table, const Type *key, uint32_t hash, void *value,
+                           TypeEqualFunc equal) {
+  const int MIN_CAPACITY = 16;
+  if ((table->count + 1) * 4 > table->capacity * 3) {
+    int old_capacity = table->capacity;
+    TypeTableEntry *old_entries = table->entries;
+    table->capacity = old_capacity > 0 ? old_capacity * 2 : MIN_CAPACITY;
+    table->entries = calloc(table->capacity, sizeof(*table->entries));
+    for (int i = 0; i < old_capacity; ++i) {
+      TypeTableEntry *entry = &old_entries[i];
+      if (entry->key != NULL)
+        *find_type_entry(table, entry->key, entry->hash, equal) = *entry;
+    }
+    free(old_entries);
+  }
+
+  TypeTableEntry *entry = find_type_entry(table, key, hash, equal);
+  if (entry->key == NULL) {
+    entry->key = key;
+    entry->hash = hash;
+    ++table->count;
+  }
+  entry->value = value;
+}
+
+// Consistent with `same_type`: qualifiers are ignored.
+static uint32_t hash_type(const Type *type) {
+  uint32_t hash = type->kind;
+  for (;;) {
+    switch (type->kind) {
+    case TY_VOID:
+      return hash;
+    case TY_FIXNUM:
+      return HASH_MIX(HASH_MIX(hash, type->fixnum.kind), type->fixnum.is_unsigned);
+#ifndef __NO_FLONUM
+    case TY_FLONUM:
+      return HASH_MIX(hash, type->flonum.kind);
+#endif
+    case TY_ARRAY:
+      hash = HASH_MIX(hash, type->pa.length);
+      // Fallthrough
+    case TY_PTR:
+      type = type->pa.ptrof;
+      hash = HASH_MIX(hash, type->kind);
+      continue;
+    case TY_FUNC:
+      {
+        hash = HASH_MIX(HASH_MIX(hash, hash_type(type->func.ret)), type->func.vaargs);
+        const Vector *param_types = type->func.param_types;
+        if (param_types == NULL)
+          return hash;
+        hash = HASH_MIX(hash, param_types->len + 1);
+        for (int i = 0, len = param_types->len; i < len; ++i)
+          hash = HASH_MIX(hash, hash_type(param_types->data[i]));
+        return hash;
+      }
+    case TY_STRUCT:
+      // Same named struct is same even if either is not defined yet.
+      if (type->struct_.name != NULL)
+        return HASH_MIX(hash, type->struct_.name->hash);
+      return HASH_PTR(hash, type->struct_.info);
+    }
+  }
+}
+
+void type_table_init(TypeTable *table) {
+  table->entries = NULL;
+  table->count = table->capacity = 0;
+}
+
+bool type_table_try_get(TypeTable *table, const Type *key, void **output) {
+  TypeTableEntry *entry = get_type_entry(table, key, hash_type(key), same_type);
+  if (entry == NULL)
+    return false;
+  *output = entry->value;
+  return true;
+}
+
+void type_table_put(TypeTable *table, const Type *key, void *value) {
+  put_type_entry(table, key, hash_type(key), value, same_type);
+}
+
+// Interning
+//
+// Pointer types, and struct types whose info is known, are never modified after creation,
+// so identical ones are shared.  Their components are compared by pointers.
+
+static TypeTable interned_types;
+
+static bool is_internable(const Type *type) {
+  return type->kind == TY_PTR || (type->kind == TY_STRUCT && type->struct_.info != NULL);
+}
+
+static bool identical_type(const Type *type1, const Type *type2) {
+  if (type1->kind != type2->kind || type1->qualifier != type2->qualifier)
+    return false;
+  if (type1->kind == TY_PTR)
+    return type1->pa.ptrof == type2->pa.ptrof;
+  return type1->struct_.info == type2->struct_.info && type1->struct_.name == type2->struct_.name;
+}
+
+static uint32_t hash_identical(const Type *type) {
+  uint32_t hash = HASH_MIX(type->kind, type->qualifier);
+  if (type->kind == TY_PTR)
+    return HASH_PTR(hash, type->pa.ptrof);
+  return HASH_PTR(hash, type->struct_.info);
+}
+
+static const Type *intern_type(const Type *type) {
+  assert(is_internable(type));
+  uint32_t hash = hash_identical(type);
+  TypeTableEntry *entry = get_type_entry(&interned_types, type, hash, identical_type);
+  if (entry != NULL)
+    return entry->key;
+  const Type *interned = clone_type(type);
+  put_type_entry(&interned_types, interned, hash, NULL, identical_type);
+  return interned;
+}
+
+const Type *ptrof(const Type *type) {
+  Type ptr = {.kind = TY_PTR, .qualifier = 0};
+  ptr.pa.ptrof = type;
+  return intern_type(&ptr);
 }
 
 const Type *array_to_ptr(const Type *type) {
@@ -210,10 +363,14 @@ const Type *qualified_type(const Type *type, int additional) {
   int modified = type->qualifier | additional;
   if (modified == type->qualifier)
     return type;
-  Type *ctype = malloc(sizeof(*ctype));
-  memcpy(ctype, type, sizeof(*ctype));
-  ctype->qualifier = modified;
-  return ctype;
+  Type ctype;
+  memcpy(&ctype, type, sizeof(ctype));
+  ctype.qualifier = modified;
+  if (is_internable(&ctype))
+    return intern_type(&ctype);
+  if (type->kind == TY_FIXNUM && type->fixnum.kind != FX_ENUM)
+    return get_fixnum_type(type->fixnum.kind, type->fixnum.is_unsigned, modified);
+  return clone_type(&ctype);
 }
 
 // Struct
@@ -221,6 +378,7 @@ const Type *qualified_type(const Type *type, int additional) {
 StructInfo *create_struct_info(Vector *members, bool is_union) {
   StructInfo *sinfo = malloc(sizeof(*sinfo));
   sinfo->members = members;
+  sinfo->member_table = NULL;
   sinfo->is_union = is_union;
   sinfo->size = -1;
   sinfo->align = 0;
@@ -229,12 +387,13 @@ StructInfo *create_struct_info(Vector *members, bool is_union) {
 }
 
 Type *create_struct_type(StructInfo *sinfo, const Name *name, int qualifier) {
-  Type *type = malloc(sizeof(*type));
-  type->kind = TY_STRUCT;
-  type->qualifier = qualifier;
-  type->struct_.name = name;
-  type->struct_.info = sinfo;
-  return type;
+  Type type = {.kind = TY_STRUCT, .qualifier = qualifier};
+  type.struct_.name = name;
+  type.struct_.info = sinfo;
+  // Struct type without info is filled by `ensure_struct` later, so it cannot be shared.
+  if (is_internable(&type))
+    return (Type*)intern_type(&type);
+  return clone_type(&type);
 }
 
 // Enum
@@ -251,6 +410,8 @@ Type *create_enum_type(const Name *name) {
 
 bool same_type(const Type *type1, const Type *type2) {
   for (;;) {
+    if (type1 == type2)
+      return true;
     if (type1->kind != type2->kind)
       return false;
 
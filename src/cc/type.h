@@ -9,6 +9,7 @@
 #include <sys/types.h>  // ssize_t
 
 typedef struct Name Name;
+typedef struct Table Table;
 typedef struct Vector Vector;
 
 // Fixnum
@@ -51,6 +52,7 @@ enum {
 
 typedef struct StructInfo {
   Vector *members;  // <VarInfo*>
+  Table *member_table;  // <MemberPath*>, built at the first lookup.
   ssize_t size;
   int align;
   bool is_union;
@@ -118,7 +120,7 @@ bool is_char_type(const Type *type);
 bool is_void_ptr(const Type *type);
 bool ptr_or_array(const Type *type);
 const Type *get_fixnum_type(enum FixnumKind kind, bool is_unsigned, int qualifier);
-Type *ptrof(const Type *type);
+const Type *ptrof(const Type *type);
 const Type *array_to_ptr(const Type *type);
 Type *arrayof(const Type *type, ssize_t length);
 Type *new_func_type(const Type *ret, const Vector *params, const Vector *param_types, bool vaargs);
@@ -134,6 +136,23 @@ Type *create_enum_type(const Name *name);
 bool same_type(const Type *type1, const Type *type2);
 bool can_cast(const Type *dst, const Type *src, bool zero, bool is_explicit);
 
+// Table keyed by type, which finds the value for a type that `same_type` matches.
+typedef struct TypeTableEntry {
+  const Type *key;
+  void *value;
+  uint32_t hash;
+} TypeTableEntry;
+
+typedef struct TypeTable {
+  TypeTableEntry *entries;
+  int capacity;  // Power of 2
+  int count;
+} TypeTable;
+
+void type_table_init(TypeTable *table);
+bool type_table_try_get(TypeTable *table, const Type *key, void **output);
+void type_table_put(TypeTable *table, const Type *key, void *value);
+
 //
 
 void print_type(FILE *fp, const Type *type);
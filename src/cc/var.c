@@ -10,6 +10,7 @@
 #include "util.h"
 
 static VarInfo *define_global(const Name *name, const Type *type, int storage, const Token *ident);
+static VarInfo *scope_find_var(Scope *scope, const Name *name);
 
 int var_find(const Vector *vars, const Name *name) {
   for (int i = 0, len = vars->len; i < len; ++i) {
@@ -20,6 +21,16 @@ int var_find(const Vector *vars, const Name *name) {
   return -1;
 }
 
+static VarInfo *new_varinfo(const Name *name, const Type *type, int storage) {
+  VarInfo *varinfo = calloc(1, sizeof(*varinfo));
+  varinfo->name = name;
+  varinfo->type = type;
+  varinfo->storage = storage;
+  if (storage & VS_STATIC)
+    varinfo->static_.gvar = define_global(alloc_label(), type, storage, NULL);
+  return varinfo;
+}
+
 VarInfo *var_add(Vector *vars, const Name *name, const Type *type, int storage,
                  const Token *ident) {
   if (name != NULL) {
@@ -28,12 +39,7 @@ VarInfo *var_add(Vector *vars, const Name *name, const Type *type, int storage,
       parse_error(ident, "`%.*s' already defined", name->bytes, name->chars);
   }
 
-  VarInfo *varinfo = calloc(1, sizeof(*varinfo));
-  varinfo->name = name;
-  varinfo->type = type;
-  varinfo->storage = storage;
-  if (storage & VS_STATIC)
-    varinfo->static_.gvar = define_global(alloc_label(), type, storage, NULL);
+  VarInfo *varinfo = new_varinfo(name, type, storage);
   vec_push(vars, varinfo);
   return varinfo;
 }
@@ -50,7 +56,7 @@ void init_global(void) {
 
 static VarInfo *define_global(const Name *name, const Type *type, int storage, const Token *ident) {
   assert(name != NULL);
-  VarInfo *varinfo = scope_find(global_scope, name, NULL);
+  VarInfo *varinfo = scope_find_var(global_scope, name);
   if (varinfo != NULL) {
     if (!(varinfo->storage & VS_EXTERN)) {
       if (!(storage & VS_EXTERN))
@@ -63,8 +69,9 @@ static VarInfo *define_global(const Name *name, const Type *type, int storage, c
     varinfo->global.init = NULL;
   } else {
     // `static' is different meaning for global and local variable.
-    varinfo = var_add(global_scope->vars, name, type, storage & ~VS_STATIC, ident);
+    varinfo = new_varinfo(name, type, storage & ~VS_STATIC);
     varinfo->storage = storage;
+    vec_push(global_scope->vars, varinfo);
   }
   return varinfo;
 }
@@ -75,6 +82,8 @@ Scope *new_scope(Scope *parent, Vector *vars) {
   Scope *scope = malloc(sizeof(*scope));
   scope->parent = parent;
   scope->vars = vars;
+  scope->var_table = NULL;
+  scope->var_table_count = 0;
   scope->struct_table = NULL;
   scope->typedef_table = NULL;
   scope->enum_table = NULL;
@@ -86,18 +95,38 @@ bool is_global_scope(Scope *scope) {
   return scope->parent == NULL;
 }
 
+// Small scope is searched linearly, and larger one through the hash table.
+#define SCOPE_TABLE_MIN  (8)
+
+static VarInfo *scope_find_var(Scope *scope, const Name *name) {
+  Vector *vars = scope->vars;
+  if (vars == NULL)
+    return NULL;
+  if (vars->len < SCOPE_TABLE_MIN) {
+    int idx = var_find(vars, name);
+    return idx >= 0 ? vars->data[idx] : NULL;
+  }
+
+  // Variables can be pushed to `vars` directly, so put ones not indexed yet.
+  Table *table = scope->var_table;
+  if (table == NULL) {
+    scope->var_table = table = malloc(sizeof(*table));
+    table_init(table);
+  }
+  for (; scope->var_table_count < vars->len; ++scope->var_table_count) {
+    VarInfo *varinfo = vars->data[scope->var_table_count];
+    if (varinfo->name != NULL && table_get(table, varinfo->name) == NULL)  // First one wins.
+      table_put(table, varinfo->name, varinfo);
+  }
+  return table_get(table, name);
+}
+
 VarInfo *scope_find(Scope *scope, const Name *name, Scope **pscope) {
   VarInfo *varinfo = NULL;
-  for (;; scope = scope->parent) {
-    if (scope == NULL)
+  for (; scope != NULL; scope = scope->parent) {
+    varinfo = scope_find_var(scope, name);
+    if (varinfo != NULL)
       break;
-    if (scope->vars != NULL) {
-      int idx = var_find(scope->vars, name);
-      if (idx >= 0) {
-        varinfo = scope->vars->data[idx];
-        break;
-      }
-    }
   }
   if (pscope != NULL)
     *pscope = scope;
@@ -111,7 +140,12 @@ VarInfo *scope_add(Scope *scope, const Token *ident, const Type *type, int stora
 
   if (scope->vars == NULL)
     scope->vars = new_vector();
-  return var_add(scope->vars, ident->ident, type, storage, ident);
+  const Name *name = ident->ident;
+  if (name != NULL && scope_find_var(scope, name) != NULL)
+    parse_error(ident, "`%.*s' already defined", name->bytes, name->chars);
+  VarInfo *varinfo = new_varinfo(name, type, storage);
+  vec_push(scope->vars, varinfo);
+  return varinfo;
 }
 
 StructInfo *find_struct(Scope *scope, const Name *name, Scope **pscope) {
@@ -195,35 +229,63 @@ void ensure_struct(Type *type, const Token *token, Scope *scope) {
       parse_error(token, "Accessing unknown struct(%.*s)'s member", type->struct_.name->bytes,
                   type->struct_.name->chars);
     type->struct_.info = sinfo;
+
+    // Recursively.  Member types are ensured when the struct is parsed,
+    // so this is needed only once for the type.
+    for (int i = 0; i < sinfo->members->len; ++i) {
+      VarInfo *varinfo = sinfo->members->data[i];
+      if (varinfo->type->kind == TY_STRUCT)
+        ensure_struct((Type*)varinfo->type, token, scope);
+    }
   }
+}
 
-  // Recursively.
-  StructInfo *sinfo = type->struct_.info;
-  for (int i = 0; i < sinfo->members->len; ++i) {
-    VarInfo *varinfo = sinfo->members->data[i];
-    if (varinfo->type->kind == TY_STRUCT)
-      ensure_struct((Type*)varinfo->type, token, scope);
+static void add_member_path(Table *table, const VarInfo *member, const Vector *outer, int index) {
+  if (table_get(table, member->name) != NULL)  // Former one is found first.
+    return;
+  MemberPath *path = malloc(sizeof(*path));
+  path->member = member;
+  path->indices = new_vector();
+  if (outer != NULL) {
+    for (int i = 0; i < outer->len; ++i)
+      vec_push(path->indices, outer->data[i]);
   }
+  vec_push(path->indices, (void*)(intptr_t)index);
+  table_put(table, member->name, path);
 }
 
-const VarInfo *search_from_anonymous(const Type *type, const Name *name, const Token *ident,
-                                     Vector *stack) {
-  assert(type->kind == TY_STRUCT);
-  const Vector *members = type->struct_.info->members;
+// Flattens members in anonymous structs and unions, in depth first order.
+static void add_anonymous_members(Table *table, const StructInfo *sinfo, Vector *outer) {
+  const Vector *members = sinfo->members;
   for (int i = 0, len = members->len; i < len; ++i) {
     const VarInfo *member = members->data[i];
     if (member->name != NULL) {
-      if (equal_name(member->name, name)) {
-        vec_push(stack, (void*)(long)i);
-        return member;
-      }
+      if (outer->len > 0)
+        add_member_path(table, member, outer, i);
     } else if (member->type->kind == TY_STRUCT) {
-      vec_push(stack, (void*)(intptr_t)i);
-      const VarInfo *submember = search_from_anonymous(member->type, name, ident, stack);
-      if (submember != NULL)
-        return submember;
-      vec_pop(stack);
+      vec_push(outer, (void*)(intptr_t)i);
+      add_anonymous_members(table, member->type->struct_.info, outer);
+      vec_pop(outer);
     }
   }
-  return NULL;
+}
+
+const MemberPath *find_struct_member(StructInfo *sinfo, const Name *name) {
+  Table *table = sinfo->member_table;
+  if (table == NULL) {
+    sinfo->member_table = table = malloc(sizeof(*table));
+    table_init(table);
+
+    // Direct members precede ones in anonymous structs.
+    const Vector *members = sinfo->members;
+    for (int i = 0, len = members->len; i < len; ++i) {
+      const VarInfo *member = members->data[i];
+      if (member->name != NULL)
+        add_member_path(table, member, NULL, i);
+    }
+    Vector *outer = new_vector();
+    add_anonymous_members(table, sinfo, outer);
+    free_vector(outer);
+  }
+  return table_get(table, name);
 }
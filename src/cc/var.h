@@ -60,7 +60,9 @@ VarInfo *var_add(Vector *vars, const Name *name, const Type *type, int storage,
 
 typedef struct Scope {
   struct Scope *parent;
-  Vector *vars;  // <VarInfo*>
+  Vector *vars;  // <VarInfo*>, in declaration order.
+  Table *var_table;  // <VarInfo*>, index of `vars` for a large scope.
+  int var_table_count;  // Number of `vars` put into `var_table`.
   Table *struct_table;  // <StructInfo*>
   Table *typedef_table;  // <Type*>
   Table *enum_table;  // <Type*>
@@ -84,5 +86,11 @@ Type *define_enum(Scope *scope, const Name *name);
 
 // Call before accessing struct member to ensure that struct is declared.
 void ensure_struct(Type *type, const Token *token, Scope *scope);
-const VarInfo *search_from_anonymous(const Type *type, const Name *name, const Token *ident,
-                                     Vector *stack);
+
+// Member of struct, which might be inside anonymous structs or unions.
+typedef struct MemberPath {
+  const VarInfo *member;
+  Vector *indices;  // <intptr_t>, member index at each level, from the outermost struct.
+} MemberPath;
+
+const MemberPath *find_struct_member(StructInfo *sinfo, const Name *name);
@@ -237,4 +237,8 @@
 
 #define CVTSD2SS(o1, o2)  EMIT_ASM2("cvtsd2ss", o1, o2)  // double->single
 #define CVTSS2SD(o1, o2)  EMIT_ASM2("cvtss2sd", o1, o2)  // single->double
+
+// Copies a whole register:  `movsd` and `movss` between registers keep the upper part of
+// the destination, so they wait for its last writer.
+#define MOVAPS(o1, o2)  EMIT_ASM2("movaps", o1, o2)
 #endif
@@ -1,25 +1,40 @@
+#include <stdbool.h>
 #include <string.h>
 
 #include "preprocessor.h"
 #include "util.h"
 
-int main(int argc, char *argv[]) {
-  FILE *ofp = stdout;
-  init_preprocessor(ofp);
+static const char TIME_REPORT[] = "--time-report";
+static const char PRECOMPILE[] = "--precompile=";
 
-  // Predefeined macros.
-  define_macro_simple("__XCC");
+static bool warmed_up;
+
+// Keep macros and `#pragma once` files defined so far for following `run_cpp`.
+void warm_up_cpp(void) {
+  warmed_up = true;
+}
+
+int run_cpp(int argc, char *argv[], FILE *ofp) {
+  if (warmed_up) {
+    set_preprocessor_output(ofp);
+  } else {
+    init_preprocessor(ofp);
+
+    // Predefeined macros.
+    define_macro_simple("__XCC");
 #if defined(__XV6)
-  define_macro_simple("__XV6");
+    define_macro_simple("__XV6");
 #elif defined(__linux__)
-  define_macro_simple("__linux__");
+    define_macro_simple("__linux__");
 #elif defined(__APPLE__)
-  define_macro_simple("__APPLE__");
+    define_macro_simple("__APPLE__");
 #endif
 #if defined(__NO_FLONUM)
-  define_macro_simple("__NO_FLONUM");
+    define_macro_simple("__NO_FLONUM");
 #endif
+  }
 
+  const char *pch_path = NULL;
   int iarg = 1;
   for (; iarg < argc; ++iarg) {
     char *arg = argv[iarg];
@@ -30,6 +45,15 @@ int main(int argc, char *argv[]) {
       add_system_inc_path(argv[iarg] + 2);
     } else if (starts_with(argv[iarg], "-D")) {
       define_macro(argv[iarg] + 2);
+    } else if (starts_with(arg, TIME_REPORT) &&
+               (arg[sizeof(TIME_REPORT) - 1] == '\0' || arg[sizeof(TIME_REPORT) - 1] == '=')) {
+      const char *output = arg[sizeof(TIME_REPORT) - 1] == '=' ? &arg[sizeof(TIME_REPORT)] : NULL;
+      if (!init_time_report("cpp", output)) {
+        fprintf(stderr, "option not supported: %s\n", arg);
+        return 1;
+      }
+    } else if (starts_with(arg, PRECOMPILE)) {
+      pch_path = &arg[sizeof(PRECOMPILE) - 1];
     } else if (strcmp(arg, "--version") == 0) {
       show_version("cpp");
       return 0;
@@ -39,6 +63,19 @@ int main(int argc, char *argv[]) {
     }
   }
 
+  if (pch_path != NULL) {
+    if (argc - iarg != 1) {
+      fprintf(stderr, "Precompile requires one header\n");
+      return 1;
+    }
+    if (!precompile_header(argv[iarg], pch_path)) {
+      fprintf(stderr, "Failed to precompile: %s\n", argv[iarg]);
+      return 1;
+    }
+    return 0;
+  }
+
+  time_report_begin("preprocess");
   if (iarg < argc) {
     for (int i = iarg; i < argc; ++i) {
       const char *filename = argv[i];
@@ -52,5 +89,8 @@ int main(int argc, char *argv[]) {
   } else {
     preprocess(stdin, "*stdin*");
   }
+  time_report_end();
+
+  finish_time_report();
   return 0;
 }
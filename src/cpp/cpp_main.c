@@ -0,0 +1,7 @@
+#include <stdio.h>
+
+extern int run_cpp(int argc, char *argv[], FILE *ofp);
+
+int main(int argc, char *argv[]) {
+  return run_cpp(argc, argv, stdout);
+}
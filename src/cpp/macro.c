@@ -1,89 +1,553 @@
 #include "macro.h"
 
-#include <assert.h>
+#include <ctype.h>
 #include <stdlib.h>  // malloc
 #include <string.h>
 
-#include "lexer.h"  // parse_error
+#include "lexer.h"
+#include "pp_parser.h"
 #include "table.h"
 #include "util.h"
 
-Macro *new_macro(Vector *params, bool va_args, Vector *segments) {
+extern Table macro_table;
+
+static const char kSpace[] = " ";
+static const char kNewline[] = "\n";
+static const char kDquote[] = "\"";
+
+static const Name *key_va_args;
+static const Name *key_line;
+static const Name *key_defined;
+
+static void init_keys(void) {
+  if (key_va_args != NULL)
+    return;
+  key_va_args = alloc_name("__VA_ARGS__", NULL, false);
+  key_line = alloc_name("__LINE__", NULL, false);
+  key_defined = alloc_name("defined", NULL, false);
+}
+
+// HideSet
+
+static const HideSet *hs_add(const HideSet *hs, const Name *name) {
+  HideSet *p = malloc(sizeof(*p));
+  p->name = name;
+  p->next = hs;
+  return p;
+}
+
+static bool hs_contains(const HideSet *hs, const Name *name) {
+  for (; hs != NULL; hs = hs->next) {
+    if (equal_name(hs->name, name))
+      return true;
+  }
+  return false;
+}
+
+static const HideSet *hs_union(const HideSet *a, const HideSet *b) {
+  for (; a != NULL; a = a->next) {
+    if (!hs_contains(b, a->name))
+      b = hs_add(b, a->name);
+  }
+  return b;
+}
+
+static const HideSet *hs_intersect(const HideSet *a, const HideSet *b) {
+  const HideSet *result = NULL;
+  for (; a != NULL; a = a->next) {
+    if (hs_contains(b, a->name))
+      result = hs_add(result, a->name);
+  }
+  return result;
+}
+
+// Token
+
+static PpToken *new_pptoken(const Token *token, const HideSet *hideset, int param, char space) {
+  PpToken *t = malloc(sizeof(*t));
+  t->token = token;
+  t->hideset = hideset;
+  t->param = param;
+  t->space = space;
+  return t;
+}
+
+static Token *new_token(enum TokenKind kind, const char *begin, const char *end,
+                        const Token *base) {
+  Token *tok = malloc(sizeof(*tok));
+  tok->kind = kind;
+  tok->line = base->line;
+  tok->begin = begin;
+  tok->end = end;
+  return tok;
+}
+
+// Macro
+
+Macro *new_macro(Vector *params, bool va_args, Vector *body) {
   Macro *macro = malloc(sizeof(*macro));
   macro->params = params;
   macro->va_args = va_args;
-  macro->segments = segments;
+  macro->body = body != NULL ? body : new_vector();
   return macro;
 }
 
 Macro *new_macro_single(const char *text) {
-  Vector *segments = new_vector();
-  Segment *seg = malloc(sizeof(*seg));
-  seg->kind = SK_TEXT;
-  seg->text = text;
-  vec_push(segments, seg);
-  return new_macro(NULL, false, segments);
+  return new_macro(NULL, false, parse_macro_body(text, NULL, false, NULL, -1));
 }
 
-bool expand(Macro *macro, const Token *token, Vector *args, const Name *name, StringBuffer *sb) {
-  if (macro->params != NULL) {
-    if (args == NULL)
-      return false;
+Vector *parse_macro_body(const char *p, const Vector *params, bool va_args, const char *filename,
+                         int lineno) {
+  init_keys();
+  Vector *body = new_vector();
+  set_source_string(p, filename, lineno);
+  int param_len = params != NULL ? params->len : 0;
+  const char *prev_end = NULL;
+  for (;;) {
+    Token *tok = match(-1);
+    if (tok->kind == TK_EOF)
+      break;
 
-    if ((!macro->va_args && args->len != macro->params->len) ||
-        (macro->va_args && args->len <= macro->params->len)) {
-      const char *cmp = args->len < macro->params->len ? "few" : "many";
-      parse_error(token, "Too %s arguments for macro `%.*s'", cmp, name->bytes, name->chars);
+    int param = -1;
+    if (tok->kind == TK_IDENT) {
+      if (va_args && equal_name(tok->ident, key_va_args)) {
+        param = param_len;
+      } else {
+        for (int i = 0; i < param_len; ++i) {
+          if (equal_name(tok->ident, params->data[i])) {
+            param = i;
+            break;
+          }
+        }
+      }
     }
-  } else {
-    if (args != NULL) {
-      parse_error(token, "Illegal argument for macro `%.*s'", name->bytes, name->chars);
+    char space = prev_end != NULL && tok->begin != prev_end ? ' ' : '\0';
+    vec_push(body, new_pptoken(tok, NULL, param, space));
+    prev_end = tok->end;
+  }
+  return body;
+}
+
+void spell_macro_body(const Macro *macro, StringBuffer *sb) {
+  for (int i = 0; i < macro->body->len; ++i) {
+    const PpToken *t = macro->body->data[i];
+    if (i > 0 && t->space != '\0')
+      sb_append(sb, kSpace, NULL);
+    sb_append(sb, t->token->begin, t->token->end);
+  }
+}
+
+// Output
+
+void init_pp_output(PpOutput *out, FILE *fp, StringBuffer *sb) {
+  out->fp = fp;
+  out->sb = sb;
+  out->last = '\0';
+  out->after_token = false;
+}
+
+static void output(PpOutput *out, const char *begin, const char *end) {
+  if (out->fp != NULL)
+    fwrite(begin, end - begin, 1, out->fp);
+  else
+    sb_append(out->sb, begin, end);
+  out->last = end[-1];
+}
+
+static bool is_ident_char(char c) {
+  return isalnum(c) || c == '_';
+}
+
+// Whether two characters might be read as one token if they are adjacent.
+static bool would_paste(char a, char b) {
+  static const char kPuncts[] = "+-*/%&|^<>=!#.:";
+  if (a == '\0' || b == '\0')
+    return false;
+  return (is_ident_char(a) && is_ident_char(b)) ||
+      (strchr(kPuncts, a) != NULL && strchr(kPuncts, b) != NULL) ||
+      (isdigit(a) && b == '.') || (a == '.' && isdigit(b));
+}
+
+void pp_write(PpOutput *out, const char *begin, const char *end) {
+  if (end == NULL)
+    end = begin + strlen(begin);
+  if (begin == end)
+    return;
+  if (out->after_token && would_paste(out->last, *begin))
+    output(out, kSpace, kSpace + 1);
+  output(out, begin, end);
+  out->after_token = false;
+}
+
+// Expander
+
+typedef struct {
+  Vector *pending;  // <PpToken*>, stack: the last one comes next.
+  bool use_lexer;  // Read tokens from the lexer after `pending`.
+  Stream *stream;  // Read following lines for arguments, if not NULL.
+  const char *lex_end;  // End of the last token from the lexer, NULL at the top of a line.
+  int lineno;
+  bool in_condition;  // In `#if`: operands of `defined` are not expanded.
+  PpOutput *out;
+  Vector *tokens;  // <PpToken*>, output tokens instead of `out` if not NULL.
+  int lines_read;  // Lines read for arguments.
+  int newlines;  // Newlines written for them.
+} Expander;
+
+static void init_expander(Expander *ex, PpOutput *out, Vector *tokens) {
+  ex->pending = new_vector();
+  ex->use_lexer = false;
+  ex->stream = NULL;
+  ex->lex_end = NULL;
+  ex->lineno = 0;
+  ex->in_condition = false;
+  ex->out = out;
+  ex->tokens = tokens;
+  ex->lines_read = ex->newlines = 0;
+}
+
+static PpToken *pull(Expander *ex) {
+  if (ex->pending->len > 0)
+    return vec_pop(ex->pending);
+  if (!ex->use_lexer)
+    return NULL;
+
+  Token *tok;
+  while ((tok = match(-1))->kind == TK_EOF) {
+    if (ex->stream == NULL)
+      return NULL;
+    char *line;
+    if (source_getline(ex->stream->src, &line) == -1)
+      return NULL;
+    ex->lineno = ++ex->stream->lineno;
+    ++ex->lines_read;
+    set_source_string(line, ex->stream->filename, ex->stream->lineno);
+    ex->lex_end = NULL;
+  }
+
+  char space = ex->lex_end == NULL ? '\n' : tok->begin != ex->lex_end ? ' ' : '\0';
+  ex->lex_end = tok->end;
+  return new_pptoken(tok, NULL, -1, space);
+}
+
+static void put_token(Expander *ex, PpToken *t) {
+  if (ex->tokens != NULL) {
+    vec_push(ex->tokens, t);
+    return;
+  }
+
+  PpOutput *out = ex->out;
+  const Token *tok = t->token;
+  if (t->space == '\n' && ex->newlines < ex->lines_read) {
+    // Keep the line count, for the line numbers after the invocation.
+    output(out, kNewline, kNewline + 1);
+    ++ex->newlines;
+  } else if (t->space != '\0' || would_paste(out->last, *tok->begin)) {
+    output(out, kSpace, kSpace + 1);
+  }
+  output(out, tok->begin, tok->end);
+  out->after_token = true;
+}
+
+static void run(Expander *ex);
+
+static Vector *expand_arg(Expander *ex, Vector *arg) {
+  int i;
+  for (i = 0; i < arg->len; ++i) {
+    const Token *tok = ((PpToken*)arg->data[i])->token;
+    if (tok->kind == TK_IDENT && table_get(&macro_table, tok->ident) != NULL)
+      break;
+  }
+  if (i >= arg->len)
+    return arg;  // No macro to expand.
+
+  Expander sub;
+  init_expander(&sub, NULL, new_vector());
+  sub.lineno = ex->lineno;
+  for (int i = arg->len; --i >= 0; )
+    vec_push(sub.pending, arg->data[i]);
+  run(&sub);
+  free_vector(sub.pending);
+  return sub.tokens;
+}
+
+static Token *stringify(Vector *arg, const Token *base) {
+  StringBuffer sb;
+  sb_init(&sb);
+  for (int i = 0; i < arg->len; ++i) {
+    const PpToken *t = arg->data[i];
+    if (i > 0 && t->space != '\0')
+      sb_append(&sb, kSpace, NULL);
+    sb_append(&sb, t->token->begin, t->token->end);
+  }
+  char *text = sb_steal(&sb);
+
+  sb_append(&sb, kDquote, NULL);
+  escape_string(text, strlen(text), &sb);
+  sb_append(&sb, kDquote, NULL);
+  free(text);
+  size_t len = sb.size;
+  char *str = sb_steal(&sb);
+  return new_token(TK_STR, str, str + len, base);
+}
+
+static Token *paste(const Token *lhs, const Token *rhs) {
+  size_t llen = lhs->end - lhs->begin, rlen = rhs->end - rhs->begin;
+  char *text = malloc(llen + rlen + 1);
+  memcpy(text, lhs->begin, llen);
+  memcpy(text + llen, rhs->begin, rlen);
+  text[llen + rlen] = '\0';
+  const char *end = text + (llen + rlen);
+  if (read_ident(text) == end)
+    return alloc_ident(alloc_name(text, end, false), text, end);
+  return new_token(PPTK_OTHER, text, end, lhs);
+}
+
+// Appends `tokens[from..]` with `hs`, and the first one has `space`.
+static void append_tokens(Vector *result, Vector *tokens, int from, const HideSet *hs,
+                          char space) {
+  // Adjacent tokens mostly share the same hide-set, so reuse the last union.
+  const HideSet *last = NULL, *last_union = hs;
+  for (int i = from; i < tokens->len; ++i) {
+    const PpToken *t = tokens->data[i];
+    if (t->hideset != last) {
+      last = t->hideset;
+      last_union = hs_union(last, hs);
     }
+    vec_push(result, new_pptoken(t->token, last_union, -1, i == from ? space : t->space));
   }
+}
 
-  // __VA_ARGS__
-  if (macro->va_args) {
-    // Concat.
-    StringBuffer sb;
-    sb_init(&sb);
-    int plen = macro->params->len;
-    for (int i = plen; i < args->len; ++i) {
-      if (i > plen)
-        sb_append(&sb, ",", NULL);
-      sb_append(&sb, (char*)args->data[i], NULL);
+// Replaces parameters in the body, and applies `#` and `##`.
+static Vector *subst(Expander *ex, const Macro *macro, Vector *args, const HideSet *hs) {
+  Vector *result = new_vector();
+  Vector **expanded = args != NULL ? calloc(args->len + 1, sizeof(*expanded)) : NULL;
+  int va_index = macro->va_args ? macro->params->len : -1;
+  Vector *body = macro->body;
+  bool lhs_empty = false;  // Left operand of `##` has no token (placemarker).
+  Vector single;  // For a token which is not a parameter.
+  void *single_data[1];
+  single.data = single_data;
+  single.capacity = single.len = 1;
+  for (int i = 0; i < body->len; ++i) {
+    const PpToken *t = body->data[i];
+    const PpToken *next = i + 1 < body->len ? body->data[i + 1] : NULL;
+    enum TokenKind kind = t->token->kind;
+
+    if (kind == PPTK_STRINGIFY && args != NULL && next != NULL && next->param >= 0) {
+      vec_push(result, new_pptoken(stringify(args->data[next->param], t->token), hs, -1,
+                                   t->space));
+      lhs_empty = false;
+      ++i;
+      continue;
+    }
+
+    if (kind == PPTK_CONCAT && i > 0 && next != NULL) {
+      ++i;
+      Vector *rhs;
+      if (next->param >= 0) {
+        rhs = args->data[next->param];
+      } else {
+        single.data[0] = (void*)next;
+        rhs = &single;
+      }
+      if (next->param == va_index && !lhs_empty && result->len > 0 &&
+          ((PpToken*)result->data[result->len - 1])->token->kind == TK_COMMA) {
+        // GNU extension: `, ## __VA_ARGS__` removes the comma for empty arguments.
+        if (rhs->len == 0)
+          --result->len;
+        else
+          append_tokens(result, rhs, 0, hs, next->space);
+        continue;
+      }
+      if (rhs->len == 0)
+        continue;
+      if (lhs_empty || result->len == 0) {
+        append_tokens(result, rhs, 0, hs, next->space);
+      } else {
+        PpToken *lhs = result->data[result->len - 1];
+        result->data[result->len - 1] = new_pptoken(
+            paste(lhs->token, ((PpToken*)rhs->data[0])->token), hs, -1, lhs->space);
+        if (rhs->len > 1)
+          append_tokens(result, rhs, 1, hs, ((PpToken*)rhs->data[1])->space);
+      }
+      lhs_empty = false;
+      continue;
+    }
+
+    if (t->param >= 0) {
+      Vector *tokens;
+      if (next != NULL && next->token->kind == PPTK_CONCAT) {
+        tokens = args->data[t->param];  // Operand of `##` is not expanded.
+      } else {
+        if (expanded[t->param] == NULL)
+          expanded[t->param] = expand_arg(ex, args->data[t->param]);
+        tokens = expanded[t->param];
+      }
+      append_tokens(result, tokens, 0, hs, t->space);
+      lhs_empty = tokens->len == 0;
+      continue;
     }
-    char *vaargs = sb_to_string(&sb);
 
-    if (args->len <= plen)
-      vec_push(args, vaargs);
-    else
-      args->data[plen] = vaargs;
+    vec_push(result, new_pptoken(t->token, hs, -1, t->space));
+    lhs_empty = false;
+  }
+  if (args != NULL) {
+    for (int i = 0; i < args->len; ++i) {
+      if (expanded[i] != NULL && expanded[i] != args->data[i])
+        free_vector(expanded[i]);
+    }
+    free(expanded);
   }
+  return result;
+}
 
-  if (macro->segments != NULL) {
-    for (int i = 0; i < macro->segments->len; ++i) {
-      Segment *seg = macro->segments->data[i];
-      switch (seg->kind) {
-      case SK_TEXT:
-        sb_append(sb, seg->text, NULL);
-        break;
-      case SK_PARAM:
-        sb_append(sb, (char*)args->data[seg->param], NULL);
-        break;
-      case SK_STRINGIFY:
-        {
-          static const char DQUOTE[] = "\"";
-          sb_append(sb, DQUOTE, NULL);
-          const char *text = args->data[seg->param];
-          escape_string(text, strlen(text), sb);
-          sb_append(sb, DQUOTE, NULL);
-        }
-        break;
-      default:
-        assert(false);
+static Vector *collect_args(Expander *ex, const Macro *macro, const Token *name,
+                            PpToken **prpar) {
+  int param_len = macro->params->len;
+  Vector *args = new_vector();
+  Vector *arg = new_vector();
+  int paren = 0;
+  for (;;) {
+    PpToken *t = pull(ex);
+    if (t == NULL)
+      parse_error(name, "`)' expected");
+    enum TokenKind kind = t->token->kind;
+    if (paren == 0) {
+      if (kind == TK_RPAR) {
+        *prpar = t;
         break;
       }
+      if (kind == TK_COMMA && (!macro->va_args || args->len < param_len)) {
+        vec_push(args, arg);
+        arg = new_vector();
+        continue;
+      }
+    }
+    if (kind == TK_LPAR)
+      ++paren;
+    else if (kind == TK_RPAR)
+      --paren;
+    vec_push(arg, t);
+  }
+  vec_push(args, arg);
+
+  if (param_len == 0 && args->len == 1 && arg->len == 0 && !macro->va_args)
+    args->len = 0;  // `F()`
+  if (macro->va_args && args->len == param_len)
+    vec_push(args, new_vector());  // Empty `__VA_ARGS__`.
+  int expected = param_len + (macro->va_args ? 1 : 0);
+  if (args->len != expected) {
+    const char *cmp = args->len < expected ? "few" : "many";
+    parse_error(name, "Too %s arguments for macro `%.*s'", cmp, name->ident->bytes,
+                name->ident->chars);
+  }
+  return args;
+}
+
+// Expands `t` if it is a macro invocation, and pushes the result to be rescanned.
+static bool try_expand(Expander *ex, PpToken *t) {
+  const Token *tok = t->token;
+  if (tok->kind != TK_IDENT || hs_contains(t->hideset, tok->ident))
+    return false;
+  Macro *macro = table_get(&macro_table, tok->ident);
+  if (macro == NULL)
+    return false;
+
+  if (equal_name(tok->ident, key_line)) {
+    char buf[sizeof(int) * 3 + 1];
+    snprintf(buf, sizeof(buf), "%d", ex->lineno);
+    char *text = strdup_(buf);
+    Token *num = new_token(TK_INTLIT, text, text + strlen(text), tok);
+    num->fixnum = ex->lineno;
+    put_token(ex, new_pptoken(num, t->hideset, -1, t->space));
+    return true;
+  }
+
+  const HideSet *hs;
+  Vector *args = NULL;
+  if (macro->params == NULL) {
+    hs = hs_add(t->hideset, tok->ident);
+  } else {
+    PpToken *lpar = pull(ex);
+    if (lpar == NULL || lpar->token->kind != TK_LPAR) {
+      if (lpar != NULL)
+        vec_push(ex->pending, lpar);
+      return false;
     }
+    PpToken *rpar;
+    args = collect_args(ex, macro, tok, &rpar);
+    hs = hs_add(hs_intersect(t->hideset, rpar->hideset), tok->ident);
+  }
+
+  Vector *result = subst(ex, macro, args, hs);
+  if (result->len > 0)
+    ((PpToken*)result->data[0])->space = t->space;
+  for (int i = result->len; --i >= 0; )
+    vec_push(ex->pending, result->data[i]);
+  // Tokens are copied, so vectors are not referenced any more.
+  free_vector(result);
+  if (args != NULL) {
+    for (int i = 0; i < args->len; ++i)
+      free_vector(args->data[i]);
+    free_vector(args);
   }
   return true;
 }
+
+static void run(Expander *ex) {
+  while (ex->pending->len > 0) {
+    PpToken *t = vec_pop(ex->pending);
+    if (ex->in_condition && t->token->kind == TK_IDENT &&
+        equal_name(t->token->ident, key_defined)) {
+      put_token(ex, t);
+      PpToken *operand = pull(ex);
+      if (operand != NULL && operand->token->kind == TK_LPAR) {
+        put_token(ex, operand);
+        operand = pull(ex);
+      }
+      if (operand != NULL)
+        put_token(ex, operand);
+      continue;
+    }
+    if (!try_expand(ex, t))
+      put_token(ex, t);
+  }
+}
+
+void expand_macro(Token *ident, Stream *stream, PpOutput *out) {
+  init_keys();
+  Expander ex;
+  init_expander(&ex, out, NULL);
+  ex.use_lexer = true;
+  ex.stream = stream;
+  ex.lex_end = ident->end;
+  ex.lineno = stream->lineno;
+  vec_push(ex.pending, new_pptoken(ident, NULL, -1, '\0'));
+  run(&ex);
+  for (; ex.newlines < ex.lines_read; ++ex.newlines)
+    output(out, kNewline, kNewline + 1);
+  out->after_token = true;  // Keep separated from the following text, even if empty.
+}
+
+char *expand_condition(const char *p, const char *filename, int lineno) {
+  init_keys();
+  StringBuffer sb;
+  sb_init(&sb);
+  PpOutput out;
+  init_pp_output(&out, NULL, &sb);
+  Expander ex;
+  init_expander(&ex, &out, NULL);
+  ex.use_lexer = true;
+  ex.lineno = lineno;
+  ex.in_condition = true;
+
+  set_source_string(p, filename, lineno);
+  ex.lex_end = get_lex_p();
+  PpToken *t;
+  while ((t = pull(&ex)) != NULL) {
+    vec_push(ex.pending, t);
+    run(&ex);
+  }
+  return sb_steal(&sb);
+}
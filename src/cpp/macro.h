@@ -1,33 +1,54 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdio.h>  // FILE
 
 typedef struct Name Name;
+typedef struct Stream Stream;
 typedef struct StringBuffer StringBuffer;
 typedef struct Token Token;
 typedef struct Vector Vector;
 
-enum SegmentKind {
-  SK_TEXT,
-  SK_PARAM,
-  SK_STRINGIFY,
-};
+// Set of macro names which must not be expanded for a token (Prosser's algorithm).
+typedef struct HideSet {
+  const Name *name;
+  const struct HideSet *next;
+} HideSet;
 
 typedef struct {
-  enum SegmentKind kind;
-  union {
-    const char *text;
-    int param;
-  };
-} Segment;
+  const Token *token;
+  const HideSet *hideset;
+  int param;  // Parameter index in a macro body (`__VA_ARGS__` is the last one), or -1.
+  char space;  // Preceding white space: ' ', '\n' or '\0'.
+} PpToken;
 
 typedef struct {
-  Vector *params;  // <const char*>
+  Vector *params;  // <const Name*>, NULL for object-like macro
   bool va_args;
-  Vector *segments;  // <Segment*>
+  Vector *body;  // <PpToken*>
 } Macro;
 
-Macro *new_macro(Vector *params, bool va_args, Vector *segments);
+Macro *new_macro(Vector *params, bool va_args, Vector *body);
 Macro *new_macro_single(const char *text);
+// Tokenizes a replacement list. Uses the lexer, so call it only while handling a directive.
+Vector *parse_macro_body(const char *p, const Vector *params, bool va_args, const char *filename,
+                         int lineno);
+// Writes the replacement list back to text, which gives the same tokens.
+void spell_macro_body(const Macro *macro, StringBuffer *sb);
 
-bool expand(Macro *macro, const Token *token, Vector *args, const Name *name, StringBuffer *sb);
+// Destination of the preprocessed text: `fp` if not NULL, otherwise `sb`.
+typedef struct {
+  FILE *fp;
+  StringBuffer *sb;
+  char last;  // Last output character, to keep adjacent tokens separated.
+  bool after_token;
+} PpOutput;
+
+void init_pp_output(PpOutput *out, FILE *fp, StringBuffer *sb);
+void pp_write(PpOutput *out, const char *begin, const char *end);  // end == NULL => strlen
+
+// Expands a macro invocation starting with `ident`, which is just read from the lexer.
+// Arguments can span following lines in `stream`.
+void expand_macro(Token *ident, Stream *stream, PpOutput *out);
+// Expands macros in the expression of `#if`, except the operands of `defined`.
+char *expand_condition(const char *p, const char *filename, int lineno);
@@ -0,0 +1,318 @@
+#include "pch.h"
+
+#if !defined(SELF_HOSTING) && !defined(__XV6)
+
+#include <fcntl.h>  // open
+#include <stdlib.h>  // malloc
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>  // close
+
+#include "macro.h"
+#include "table.h"
+#include "util.h"
+
+extern Table macro_table;
+
+static const char PCH_MAGIC[8] = "XCCPCH3";
+
+// Image layout: PchHeader, words, strings (NUL terminated), text.
+//   Included file: path(offset), mtime(lo, hi), size(lo, hi)
+//   Macro: name(offset, len), param count (NO_PARAMS for object-like), va_args,
+//          params(offset, len)..., body text(offset), which is tokenized again on load.
+//   Undefined macro: name(offset, len)
+//   `#pragma once` file: offset
+typedef struct {
+  char magic[8];
+  uint64_t signature;
+  int64_t mtime;  // of the header
+  int64_t size;
+  uint32_t lineno;
+  uint32_t include_count;
+  uint32_t macro_count;
+  uint32_t undef_count;
+  uint32_t once_count;
+  uint32_t words_offset;
+  uint32_t strings_offset;
+  uint32_t text_offset;
+  uint64_t text_size;
+} PchHeader;
+
+#define NO_PARAMS  ((uint32_t)-1)
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t size) {
+  const unsigned char *p = data;
+  for (size_t i = 0; i < size; ++i)
+    hash = (hash ^ p[i]) * 0x100000001b3ULL;
+  return hash;
+}
+
+// `__FILE__` and `__LINE__` are changed by each file.
+static bool is_persistent_macro(const Name *name, const Macro *macro) {
+  static const Name *key_file, *key_line;
+  if (key_file == NULL) {
+    key_file = alloc_name("__FILE__", NULL, false);
+    key_line = alloc_name("__LINE__", NULL, false);
+  }
+  return macro != NULL && !equal_name(name, key_file) && !equal_name(name, key_line);
+}
+
+static char *macro_body_text(const Macro *macro) {
+  StringBuffer sb;
+  sb_init(&sb);
+  spell_macro_body(macro, &sb);
+  return sb_steal(&sb);
+}
+
+static uint64_t hash_macro(const Name *name, const Macro *macro) {
+  uint64_t hash = fnv1a(0xcbf29ce484222325ULL, name->chars, name->bytes);
+  uint32_t param_count = macro->params != NULL ? (uint32_t)macro->params->len : NO_PARAMS;
+  hash = fnv1a(hash, &param_count, sizeof(param_count));
+  hash = fnv1a(hash, &macro->va_args, sizeof(macro->va_args));
+  if (macro->params != NULL) {
+    for (int i = 0; i < macro->params->len; ++i) {
+      const Name *param = macro->params->data[i];
+      hash = fnv1a(hash, param->chars, param->bytes);
+      hash = fnv1a(hash, "", 1);  // Separator
+    }
+  }
+  char *text = macro_body_text(macro);
+  hash = fnv1a(hash, text, strlen(text) + 1);
+  free(text);
+  return hash;
+}
+
+// Sum of hashes for each macro, to be independent from the order in the table.
+uint64_t pch_signature(const Vector *inc_paths) {
+  uint64_t signature = 0;
+  const Name *name;
+  Macro *macro;
+  for (int it = 0; (it = table_iterate(&macro_table, it, &name, (void**)&macro)) != -1; ) {
+    if (is_persistent_macro(name, macro))
+      signature += hash_macro(name, macro);
+  }
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (int i = 0; i < inc_paths->len; ++i) {
+    const char *path = inc_paths->data[i];
+    hash = fnv1a(hash, path, strlen(path) + 1);
+  }
+  return signature ^ hash;
+}
+
+// Save
+
+static void put_word(FILE *fp, uint32_t value) {
+  fwrite(&value, sizeof(value), 1, fp);
+}
+
+static uint32_t put_string(FILE *fp, const char *s, size_t len) {
+  uint32_t offset = ftell(fp);
+  fwrite(s, 1, len, fp);
+  fputc('\0', fp);
+  return offset;
+}
+
+static void put_word64(FILE *fp, uint64_t value) {
+  put_word(fp, value);
+  put_word(fp, value >> 32);
+}
+
+static void put_name(FILE *words, FILE *strings, const Name *name) {
+  put_word(words, put_string(strings, name->chars, name->bytes));
+  put_word(words, name->bytes);
+}
+
+bool save_pch(const char *path, const char *header, uint64_t signature, int lineno,
+              const char *text, size_t size, const Vector *includes, const Vector *undefs,
+              const Vector *once_files) {
+  struct stat st;
+  if (stat(header, &st) != 0)
+    return false;
+
+  char *words_buf, *strings_buf;
+  size_t words_size, strings_size;
+  FILE *words = open_memstream(&words_buf, &words_size);
+  FILE *strings = open_memstream(&strings_buf, &strings_size);
+
+  for (int i = 0; i < includes->len; ++i) {
+    const char *fn = includes->data[i];
+    struct stat inc_st;
+    if (stat(fn, &inc_st) != 0) {
+      fclose(words);
+      fclose(strings);
+      free(words_buf);
+      free(strings_buf);
+      return false;
+    }
+    put_word(words, put_string(strings, fn, strlen(fn)));
+    put_word64(words, inc_st.st_mtime);
+    put_word64(words, inc_st.st_size);
+  }
+  uint32_t macro_count = 0;
+  const Name *name;
+  Macro *macro;
+  for (int it = 0; (it = table_iterate(&macro_table, it, &name, (void**)&macro)) != -1; ) {
+    if (!is_persistent_macro(name, macro))
+      continue;
+    put_name(words, strings, name);
+    put_word(words, macro->params != NULL ? (uint32_t)macro->params->len : NO_PARAMS);
+    put_word(words, macro->va_args);
+    if (macro->params != NULL) {
+      for (int i = 0; i < macro->params->len; ++i)
+        put_name(words, strings, macro->params->data[i]);
+    }
+    char *text = macro_body_text(macro);
+    put_word(words, put_string(strings, text, strlen(text)));
+    free(text);
+    ++macro_count;
+  }
+  for (int i = 0; i < undefs->len; ++i)
+    put_name(words, strings, undefs->data[i]);
+  for (int i = 0; i < once_files->len; ++i) {
+    const char *fn = once_files->data[i];
+    put_word(words, put_string(strings, fn, strlen(fn)));
+  }
+  fclose(words);
+  fclose(strings);
+
+  PchHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, PCH_MAGIC, sizeof(h.magic));
+  h.signature = signature;
+  h.mtime = st.st_mtime;
+  h.size = st.st_size;
+  h.lineno = lineno;
+  h.include_count = includes->len;
+  h.macro_count = macro_count;
+  h.undef_count = undefs->len;
+  h.once_count = once_files->len;
+  h.words_offset = sizeof(h);
+  h.strings_offset = h.words_offset + words_size;
+  h.text_offset = h.strings_offset + strings_size;
+  h.text_size = size;
+
+  FILE *fp = fopen(path, "wb");
+  if (fp == NULL)
+    return false;
+  bool ok = fwrite(&h, sizeof(h), 1, fp) == 1 &&
+            fwrite(words_buf, 1, words_size, fp) == words_size &&
+            fwrite(strings_buf, 1, strings_size, fp) == strings_size &&
+            fwrite(text, 1, size, fp) == size;
+  ok = fclose(fp) == 0 && ok;
+  free(words_buf);
+  free(strings_buf);
+  return ok;
+}
+
+// Load
+
+static const char *map_file(const char *path, size_t *psize) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+  struct stat st;
+  void *p = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(PchHeader))
+    p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED)
+    return NULL;
+  *psize = st.st_size;
+  return p;
+}
+
+static uint64_t get_word64(const uint32_t **pw) {
+  uint64_t lo = *(*pw)++;
+  uint64_t hi = *(*pw)++;
+  return lo | hi << 32;
+}
+
+// Whether files included from the header are not modified since precompiling.
+static bool check_includes(const uint32_t **pw, const char *strings, uint32_t count) {
+  bool ok = true;
+  for (uint32_t i = 0; i < count; ++i) {
+    const char *fn = &strings[*(*pw)++];
+    int64_t mtime = get_word64(pw);
+    int64_t size = get_word64(pw);
+    struct stat st;
+    if (ok && (stat(fn, &st) != 0 || st.st_mtime != mtime || st.st_size != size))
+      ok = false;
+  }
+  return ok;
+}
+
+int load_pch(const char *path, const char *header, uint64_t signature, Vector *once_files,
+             FILE *ofp) {
+  size_t file_size;
+  const char *image = map_file(path, &file_size);
+  if (image == NULL)
+    return -1;
+
+  const PchHeader *h = (const PchHeader*)image;
+  struct stat st;
+  if (memcmp(h->magic, PCH_MAGIC, sizeof(h->magic)) != 0 || h->signature != signature ||
+      h->text_offset + h->text_size != file_size ||
+      stat(header, &st) != 0 || st.st_mtime != h->mtime || st.st_size != h->size) {
+    munmap((void*)image, file_size);
+    return -1;
+  }
+
+  // Names and texts point to the mapped image, which is kept until the end.
+  const uint32_t *w = (const uint32_t*)(image + h->words_offset);
+  const char *strings = image + h->strings_offset;
+  if (!check_includes(&w, strings, h->include_count)) {
+    munmap((void*)image, file_size);
+    return -1;
+  }
+
+  for (uint32_t i = 0; i < h->macro_count; ++i) {
+    const char *chars = &strings[*w++];
+    const Name *name = alloc_name(chars, chars + *w++, false);
+    uint32_t param_count = *w++;
+    bool va_args = *w++ != 0;
+
+    Vector *params = NULL;
+    if (param_count != NO_PARAMS) {
+      params = new_vector();
+      for (uint32_t j = 0; j < param_count; ++j) {
+        const char *param = &strings[*w++];
+        vec_push(params, alloc_name(param, param + *w++, false));
+      }
+    }
+    Vector *body = parse_macro_body(&strings[*w++], params, va_args, header, -1);
+    table_put(&macro_table, name, new_macro(params, va_args, body));
+  }
+  for (uint32_t i = 0; i < h->undef_count; ++i) {
+    const char *chars = &strings[*w++];
+    table_delete(&macro_table, alloc_name(chars, chars + *w++, false));
+  }
+  for (uint32_t i = 0; i < h->once_count; ++i)
+    vec_push(once_files, &strings[*w++]);
+
+  fwrite(image + h->text_offset, 1, h->text_size, ofp);
+  return h->lineno;
+}
+
+#else
+
+uint64_t pch_signature(const Vector *inc_paths) {
+  (void)inc_paths;
+  return 0;
+}
+
+bool save_pch(const char *path, const char *header, uint64_t signature, int lineno,
+              const char *text, size_t size, const Vector *includes, const Vector *undefs,
+              const Vector *once_files) {
+  (void)path; (void)header; (void)signature; (void)lineno; (void)text; (void)size;
+  (void)includes; (void)undefs; (void)once_files;
+  return false;
+}
+
+int load_pch(const char *path, const char *header, uint64_t signature, Vector *once_files,
+             FILE *ofp) {
+  (void)path; (void)header; (void)signature; (void)once_files; (void)ofp;
+  return -1;
+}
+
+#endif
@@ -0,0 +1,26 @@
+// Precompiled header
+//
+// An image holds the macro table and `#pragma once` files after preprocessing
+// a header, and the preprocessed text of the header.  The image is valid only
+// when the macros and include paths before the header are the same, and none of
+// the header and files included from it is modified.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>  // size_t
+#include <stdint.h>  // uint64_t
+#include <stdio.h>  // FILE
+
+typedef struct Vector Vector;
+
+uint64_t pch_signature(const Vector *inc_paths);
+// includes: <const char*>, files included from the header.
+// undefs: <const Name*>, macros defined before the header and undefined by it.
+bool save_pch(const char *path, const char *header, uint64_t signature, int lineno,
+              const char *text, size_t size, const Vector *includes, const Vector *undefs,
+              const Vector *once_files);
+// Restores macros and `#pragma once` files, and outputs the text to `ofp`.
+// Returns the line count of the header, or -1 if the image is not available.
+int load_pch(const char *path, const char *header, uint64_t signature, Vector *once_files,
+             FILE *ofp);
@@ -6,7 +6,6 @@
 #include <string.h>
 
 #include "lexer.h"
-#include "macro.h"
 #include "table.h"
 #include "type.h"
 #include "util.h"
@@ -18,31 +17,6 @@ static PpResult pp_cast_expr(void);
 
 //
 
-static PpResult expand_ident(const Token *ident) {
-  Macro *macro = table_get(&macro_table, ident->ident);
-  if (macro == NULL) {
-    //parse_error(ident, "`%.s' not defined", ident->ident->bytes, ident->ident->chars);
-    return 0;
-  }
-
-  Vector *args = NULL;
-  if (macro->params != NULL)
-    args = pp_funargs(NULL);
-
-  StringBuffer sb;
-  sb_init(&sb);
-  expand(macro, ident, args, ident->ident, &sb);
-
-  const char *left = get_lex_p();
-  if (left != NULL)
-    sb_append(&sb, left, NULL);
-  char *expanded = sb_to_string(&sb);
-
-  set_source_string(expanded, NULL, -1);
-
-  return pp_prim();
-}
-
 static PpResult parse_defined(void) {
   bool lpar = match(TK_LPAR) != NULL;
   Token *ident = consume(TK_IDENT, "Ident expected");
@@ -75,11 +49,10 @@ static PpResult pp_prim(void) {
   //  return new_expr_str(tok, tok->str.buf, tok->str.size);
 
   Token *ident = consume(TK_IDENT, "Number or Ident or open paren expected");
-  if (equal_name(ident->ident, alloc_name("defined", NULL, false))) {
+  if (equal_name(ident->ident, alloc_name("defined", NULL, false)))
     return parse_defined();
-  } else {
-    return expand_ident(ident);
-  }
+  // Macros are already expanded, so remaining identifiers are replaced with 0.
+  return 0;
 }
 
 static PpResult pp_postfix(void) {
@@ -312,87 +285,3 @@ PpResult pp_expr(void) {
   }
   return result;
 }
-
-static Token *match2(enum TokenKind kind, Stream *stream) {
-  while (match(TK_EOF)) {
-    char *line = NULL;
-    size_t capa = 0;
-    ssize_t len = getline(&line, &capa, stream->fp);
-    if (len == -1)
-      return NULL;
-    ++stream->lineno;
-    set_source_string(line, stream->filename, stream->lineno);
-  }
-  return match(kind);
-}
-
-Vector *pp_funargs(Stream *stream) {
-  Vector *args = NULL;
-  if (match2(TK_LPAR, stream)) {
-    args = new_vector();
-    if (!match2(TK_RPAR, stream)) {
-      StringBuffer sb;
-      sb_init(&sb);
-      const char *start = NULL;
-      const char *end = NULL;
-      int paren = 0;
-      for (;;) {
-        Token *tok;
-        for (;;) {
-          tok = match(-1);
-          if (tok->kind != TK_EOF)
-            break;
-
-          if (start != end)
-            sb_append(&sb, start, end);
-          if (!sb_empty(&sb))
-            sb_append(&sb, "\n", NULL);
-          start = end = NULL;
-
-          ssize_t len = -1;
-          char *line = NULL;
-          if (stream != NULL) {
-            size_t capa = 0;
-            len = getline(&line, &capa, stream->fp);
-          }
-          if (len == -1) {
-            parse_error(NULL, "`)' expected");
-            return NULL;
-          }
-          ++stream->lineno;
-          set_source_string(line, stream->filename, stream->lineno);
-        }
-
-        if (tok->kind == TK_COMMA || tok->kind == TK_RPAR) {
-          if (paren <= 0) {
-            if (sb_empty(&sb)) {
-              if (start == end)
-                parse_error(tok, "expression expected");
-              vec_push(args, strndup_(start, end - start));
-            } else {
-              if (start != end)
-                sb_append(&sb, start, end);
-              vec_push(args, sb_to_string(&sb));
-              sb_clear(&sb);
-            }
-            start = end = NULL;
-
-            if (tok->kind == TK_RPAR)
-              break;
-            else
-              continue;
-          }
-
-          if (tok->kind == TK_RPAR)
-            --paren;
-        } else if (tok->kind == TK_LPAR) {
-          ++paren;
-        }
-        if (start == NULL)
-          start = tok->begin;
-        end = tok->end;
-      }
-    }
-  }
-  return args;
-}
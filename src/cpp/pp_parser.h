@@ -1,17 +1,15 @@
 #pragma once
 
 #include <stdint.h>  // intptr_t
-#include <stdio.h>  // FILE
 
-typedef struct Vector Vector;
+typedef struct SourceBuffer SourceBuffer;
 
 typedef intptr_t PpResult;
 
-typedef struct {
+typedef struct Stream {
   const char *filename;
-  FILE *fp;
+  SourceBuffer *src;
   int lineno;
 } Stream;
 
 PpResult pp_expr(void);
-Vector *pp_funargs(Stream *stream);
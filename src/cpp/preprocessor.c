@@ -8,10 +8,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "lexer.h"
 #include "macro.h"
+#include "pch.h"
 #include "pp_parser.h"
 #include "table.h"
 #include "type.h"
@@ -35,6 +37,35 @@ const char *keyword(const char *s, const char *word) {
   return skip_whitespaces(s + (len + 1));
 }
 
+// Whether the line has only whitespaces and comments.  A block comment may continue to
+// following lines, which are examined without consuming them, and the rest of the line
+// where it ends must be blank, too.
+static bool is_blank_line(const char *line, const SourceBuffer *src) {
+  const char *p = line, *end = line + strlen(line);
+  bool following = false;
+  for (;;) {
+    while (p < end && *p != '\n' && isspace(*p))
+      ++p;
+    if (p >= end || *p == '\n')
+      return true;
+    if (p + 1 >= end || p[0] != '/' || (p[1] != '/' && p[1] != '*'))
+      return false;
+    if (p[1] == '/')
+      return true;
+
+    for (p += 2; p + 1 >= end || p[0] != '*' || p[1] != '/'; ++p) {
+      if (p + 1 >= end) {
+        if (following)
+          return true;  // Not closed until the end of file.
+        p = src->p - 1;
+        end = src->end;
+        following = true;
+      }
+    }
+    p += 2;
+  }
+}
+
 const char *find_directive(const char *line) {
   const char *p = skip_whitespaces(line);
   if (*p != '#')
@@ -46,20 +77,64 @@ Table macro_table;  // <Name, Macro*>
 
 static FILE *pp_ofp;
 static Vector *sys_inc_paths;  // <const char*>
-static Vector *pragma_once_files;  // <const char*>
-
-static Stream *s_stream;
+static Vector *pragma_once_files;  // <const char*>, for precompiled header
+static bool try_pch;  // Precompiled header is available only for the first `#include`.
+static Vector *pch_includes;  // <const char*>, files read while precompiling, or NULL.
+
+// Included files are identified by device and inode, so that different paths to the same file
+// are treated as one.  Files with `#pragma once` or a multiple-include guard are not opened again.
+typedef struct {
+  const Name *guard;  // Skip if this macro is defined.
+  bool once;
+} IncludeInfo;
+
+static Table include_files;  // <Name (file identity), IncludeInfo*>
+
+static const Name *file_identity(const char *filename) {
+#if !defined(SELF_HOSTING) && !defined(__XV6)
+  struct stat st;
+  if (stat(filename, &st) != 0)
+    return NULL;
+  char buf[sizeof(st.st_dev) * 2 + sizeof(st.st_ino) * 2 + 2];
+  snprintf(buf, sizeof(buf), "%lx:%lx", (unsigned long)st.st_dev, (unsigned long)st.st_ino);
+  return alloc_name(buf, NULL, true);
+#else
+  if (!is_fullpath(filename))
+    filename = fullpath(filename);
+  return alloc_name(filename, NULL, false);
+#endif
+}
 
-bool registered_pragma_once(const char *filename) {
-  for (int i = 0, len = pragma_once_files->len; i < len; ++i) {
-    const char *fn = pragma_once_files->data[i];
-    if (strcmp(fn, filename) == 0)
-      return true;
+static IncludeInfo *get_include_info(const Name *id) {
+  IncludeInfo *info = table_get(&include_files, id);
+  if (info == NULL) {
+    info = calloc(1, sizeof(*info));
+    table_put(&include_files, id, info);
   }
-  return false;
+  return info;
+}
+
+static bool skip_include(const Name *id) {
+  IncludeInfo *info = table_get(&include_files, id);
+  return info != NULL &&
+      (info->once || (info->guard != NULL && table_get(&macro_table, info->guard) != NULL));
+}
+
+// Whether including the file again would have no effect, in the current state.
+bool is_include_skipped(const char *filename) {
+  const Name *id = file_identity(filename);
+  return id != NULL && skip_include(id);
 }
 
 void register_pragma_once(const char *filename) {
+  const Name *id = file_identity(filename);
+  if (id == NULL)
+    return;
+  IncludeInfo *info = get_include_info(id);
+  if (info->once)
+    return;
+  info->once = true;
+
   if (!is_fullpath(filename))
     filename = fullpath(filename);
   vec_push(pragma_once_files, filename);
@@ -89,19 +164,24 @@ void handle_include(const char *p, const char *srcname) {
 
   char *path = strndup_(p, q - p);
   char *fn = NULL;
+  const Name *id = NULL;
   FILE *fp = NULL;
   // Search from current directory.
   if (!sys) {
     fn = cat_path_cwd(dirname(strdup_(srcname)), path);
-    if (registered_pragma_once(fn))
-      return;
-    fp = fopen(fn, "r");
+    if ((id = file_identity(fn)) != NULL) {
+      if (skip_include(id))
+        return;
+      fp = fopen(fn, "r");
+    }
   }
   if (fp == NULL) {
     // Search from system include directries.
     for (int i = 0; i < sys_inc_paths->len; ++i) {
       fn = cat_path_cwd(sys_inc_paths->data[i], path);
-      if (registered_pragma_once(fn))
+      if ((id = file_identity(fn)) == NULL)
+        continue;
+      if (skip_include(id))
         return;
       fp = fopen(fn, "r");
       if (fp != NULL)
@@ -114,7 +194,25 @@ void handle_include(const char *p, const char *srcname) {
   }
 
   fprintf(pp_ofp, "# 1 \"%s\" 1\n", fn);
-  int lineno = preprocess(fp, fn);
+  int lineno = -1;
+  if (try_pch) {
+    try_pch = false;
+    int once_count = pragma_once_files->len;
+    lineno = load_pch(change_ext(fn, "pch"), fn, pch_signature(sys_inc_paths), pragma_once_files,
+                      pp_ofp);
+    // Register files restored from the image.
+    Vector *loaded = new_vector();
+    for (int i = once_count; i < pragma_once_files->len; ++i)
+      vec_push(loaded, pragma_once_files->data[i]);
+    pragma_once_files->len = once_count;
+    for (int i = 0; i < loaded->len; ++i)
+      register_pragma_once(loaded->data[i]);
+  }
+  if (lineno < 0) {
+    if (pch_includes != NULL)
+      vec_push(pch_includes, fn);
+    lineno = preprocess(fp, fn);
+  }
   fprintf(pp_ofp, "# %d \"%s\" 2\n", lineno, fn);
   fclose(fp);
 }
@@ -123,105 +221,12 @@ void handle_pragma(const char *p, const char *filename) {
   const char *begin = p;
   const char *end = read_ident(p);
   if ((end - begin) == 4 && strncmp(begin, "once", 4) == 0) {
-    if (!registered_pragma_once(filename))
-      register_pragma_once(filename);
+    register_pragma_once(filename);
   } else {
     fprintf(stderr, "Warning: unhandled #pragma: %s\n", p);
   }
 }
 
-static void push_text_segment(Vector *segments, const char *start, const char *token_begin) {
-  if (token_begin > start) {
-    Segment *seg = malloc(sizeof(*seg));
-    seg->kind = SK_TEXT;
-    seg->text = strndup_(start, token_begin - start);
-    vec_push(segments, seg);
-  }
-}
-
-Vector *parse_macro_body(const char *p, const Vector *params, bool va_args, Stream *stream) {
-  Vector *segments = new_vector();
-  set_source_string(p, stream->filename, stream->lineno);
-  int param_len = params != NULL ? params->len : 0;
-  const Name *key_va_args = alloc_name("__VA_ARGS__", NULL, false);
-  const char *start = p;
-  const char *end = start;
-  for (;;) {
-    Token *tok = match(-1);
-    if (tok->kind == TK_EOF)
-      break;
-    switch (tok->kind) {
-    case TK_IDENT:
-      {
-        int param_index = -1;
-        if (va_args && equal_name(tok->ident, key_va_args)) {
-          param_index = param_len;
-        } else {
-          for (int i = 0; i < param_len; ++i) {
-            if (equal_name(tok->ident, params->data[i])) {
-              param_index = i;
-              break;
-            }
-          }
-        }
-        if (param_index >= 0) {
-          push_text_segment(segments, start, tok->begin);
-
-          Segment *seg = malloc(sizeof(*seg));
-          seg->kind = SK_PARAM;
-          seg->param = param_index;
-          vec_push(segments, seg);
-
-          start = end = tok->end;
-          continue;
-        }
-      }
-      break;
-    case PPTK_CONCAT:
-      push_text_segment(segments, start, end);
-
-      start = end = skip_whitespaces(tok->end);
-      continue;
-    case PPTK_STRINGIFY:
-      {
-        Token *ident;
-        if ((ident = match(TK_IDENT)) != NULL) {
-          int param_index = -1;
-          for (int i = 0; i < param_len; ++i) {
-            if (equal_name(ident->ident, params->data[i])) {
-              param_index = i;
-              break;
-            }
-          }
-          if (param_index >= 0) {
-            push_text_segment(segments, start, tok->begin);
-
-            Segment *seg = malloc(sizeof(*seg));
-            seg->kind = SK_STRINGIFY;
-            seg->param = param_index;
-            vec_push(segments, seg);
-
-            start = end = ident->end;
-            continue;
-          }
-      }
-      }
-      break;
-    default:
-      break;
-    }
-    end = tok->end;
-  }
-
-  if (start != end) {
-    Segment *seg = malloc(sizeof(*seg));
-    seg->kind = SK_TEXT;
-    seg->text = strndup_(start, end - start);
-    vec_push(segments, seg);
-  }
-  return segments;
-}
-
 void handle_define(const char *p, Stream *stream) {
   const char *begin = p;
   const char *end = read_ident(p);
@@ -255,12 +260,9 @@ void handle_define(const char *p, Stream *stream) {
     p = get_lex_p();
   }
 
-  Vector *segments = NULL;
-  p = skip_whitespaces(p);
-  if (*p != '\0') {
-    segments = parse_macro_body(skip_whitespaces(p), params, va_args, stream);
-  }
-  table_put(&macro_table, name, new_macro(params, va_args, segments));
+  Vector *body = parse_macro_body(skip_whitespaces(p), params, va_args, stream->filename,
+                                  stream->lineno);
+  table_put(&macro_table, name, new_macro(params, va_args, body));
 }
 
 void handle_undef(const char *p) {
@@ -273,7 +275,7 @@ void handle_undef(const char *p) {
   table_delete(&macro_table, name);
 }
 
-bool handle_block_comment(const char *begin, const char **pp, Stream *stream) {
+bool handle_block_comment(const char *begin, const char **pp, Stream *stream, PpOutput *out) {
   const char *p = skip_whitespaces(*pp);
   if (*p != '/' || p[1] != '*')
     return false;
@@ -281,12 +283,11 @@ bool handle_block_comment(const char *begin, const char **pp, Stream *stream) {
   p += 2;
   for (;;) {
     if (*p == '\0') {
-      fwrite(begin, p - begin, 1, pp_ofp);
-      fputc('\n', pp_ofp);
+      pp_write(out, begin, p);
+      pp_write(out, "\n", NULL);
 
-      char *line = NULL;
-      size_t capa = 0;
-      ssize_t len = getline(&line, &capa, stream->fp);
+      char *line;
+      ssize_t len = source_getline(stream->src, &line);
       if (len == -1) {
         *pp = p;
         return true;
@@ -298,7 +299,7 @@ bool handle_block_comment(const char *begin, const char **pp, Stream *stream) {
 
     if (*p == '*' && p[1] == '/') {
       p += 2;
-      fwrite(begin, p - begin, 1, pp_ofp);
+      pp_write(out, begin, p);
       *pp = p;
       return true;
     }
@@ -310,11 +311,14 @@ bool handle_block_comment(const char *begin, const char **pp, Stream *stream) {
 void process_line(const char *line, Stream *stream) {
   set_source_string(line, stream->filename, stream->lineno);
 
+  // Text without macros is copied as is, to keep spaces and comments.
+  PpOutput out;
+  init_pp_output(&out, pp_ofp, NULL);
   const char *begin = get_lex_p();
   for (;;) {
     const char *p = get_lex_p();
     if (p != NULL) {
-      if (handle_block_comment(begin, &p, stream)) {
+      if (handle_block_comment(begin, &p, stream, &out)) {
         begin = p;
         set_source_string(begin, stream->filename, stream->lineno);
       }
@@ -324,35 +328,20 @@ void process_line(const char *line, Stream *stream) {
       break;
 
     Token *ident = match(TK_IDENT);
-    Macro *macro;
-    if (ident != NULL && (macro = table_get(&macro_table, ident->ident)) != NULL) {
-      s_stream = stream;
-      Vector *args = NULL;
-      if (macro->params != NULL)
-        args = pp_funargs(s_stream);
-
-      StringBuffer sb;
-      sb_init(&sb);
-      if (!expand(macro, ident, args, ident->ident, &sb))
-        continue;
-
-      if (ident->begin != begin)
-        fwrite(begin, ident->begin - begin, 1, pp_ofp);
-
-      const char *left = get_lex_p();
-      if (left != NULL)
-        sb_append(&sb, left, NULL);
-      char *expanded = sb_to_string(&sb);
-
-      set_source_string(expanded, NULL, -1);
+    if (ident != NULL && table_get(&macro_table, ident->ident) != NULL) {
+      pp_write(&out, begin, ident->begin);
+      expand_macro(ident, stream, &out);
       begin = get_lex_p();
       continue;
     }
 
-    match(-1);
+    if (ident == NULL)
+      match(-1);
   }
 
-  fprintf(pp_ofp, "%s\n", begin);
+  if (begin != NULL)
+    pp_write(&out, begin, NULL);
+  pp_write(&out, "\n", NULL);
 }
 
 bool handle_ifdef(const char *p) {
@@ -365,7 +354,8 @@ bool handle_ifdef(const char *p) {
 }
 
 bool handle_if(const char *p, Stream *stream) {
-  set_source_string(p, stream->filename, stream->lineno);
+  char *expanded = expand_condition(p, stream->filename, stream->lineno);
+  set_source_string(expanded, stream->filename, stream->lineno);
   return pp_expr() != 0;
 }
 
@@ -388,15 +378,94 @@ void init_preprocessor(FILE *ofp) {
   pp_ofp = ofp;
   sys_inc_paths = new_vector();
   pragma_once_files = new_vector();
+  table_init(&include_files);
+  try_pch = true;
 
   init_lexer();
 }
 
+bool precompile_header(const char *header, const char *pch_path) {
+#if !defined(SELF_HOSTING) && !defined(__XV6)
+  FILE *fp = fopen(header, "r");
+  if (fp == NULL)
+    error("Cannot open file: %s\n", header);
+  header = fullpath(header);  // Same as the name in `handle_include`.
+
+  uint64_t signature = pch_signature(sys_inc_paths);
+  Vector *defined = new_vector();
+  const Name *name;
+  for (int it = 0; (it = table_iterate(&macro_table, it, &name, NULL)) != -1; )
+    vec_push(defined, name);
+
+  char *buf;
+  size_t size;
+  FILE *ofp = pp_ofp;
+  pp_ofp = open_memstream(&buf, &size);
+  try_pch = false;
+  pch_includes = new_vector();
+  int lineno = preprocess(fp, header);
+  fclose(pp_ofp);
+  pp_ofp = ofp;
+  fclose(fp);
+
+  Vector *undefs = new_vector();
+  for (int i = 0; i < defined->len; ++i) {
+    if (table_get(&macro_table, defined->data[i]) == NULL)
+      vec_push(undefs, defined->data[i]);
+  }
+
+  bool result = save_pch(pch_path, header, signature, lineno, buf, size, pch_includes, undefs,
+                         pragma_once_files);
+  pch_includes = NULL;
+  free(buf);
+  return result;
+#else
+  (void)header;
+  (void)pch_path;
+  return false;
+#endif
+}
+
+void set_preprocessor_output(FILE *ofp) {
+  pp_ofp = ofp;
+}
+
+// Skip lines in a disabled region, without parsing except nesting directives.
+// Outputs a newline for each line as the normal path does, and returns the next `#elif`,
+// `#else` or `#endif` line at the same level in `*pline`.
+static ssize_t skip_disabled_lines(Stream *stream, char **pline) {
+  int depth = 0;
+  bool continued = false;
+  for (;; ++stream->lineno) {
+    ssize_t len = source_getline(stream->src, pline);
+    if (len == -1)
+      return -1;
+
+    const char *line = *pline;
+    if (!continued) {
+      const char *p = skip_whitespaces(line);
+      if (*p == '#') {
+        p = skip_whitespaces(p + 1);
+        if (p[0] == 'i' && p[1] == 'f') {  // if, ifdef, ifndef
+          ++depth;
+        } else if (strncmp(p, "el", 2) == 0 || strncmp(p, "endif", 5) == 0) {  // else, elif, endif
+          if (depth == 0)
+            return len;
+          if (p[1] == 'n')
+            --depth;
+        }
+      }
+      fputc('\n', pp_ofp);
+    }
+
+    continued = len > 0 && line[len - 1] == '\\';
+  }
+}
+
 int preprocess(FILE *fp, const char *filename) {
   Vector *condstack = new_vector();
   bool enable = true;
   int satisfy = 0;  // #if condition: 0=not satisfied, 1=satisfied, 2=else
-  char linenobuf[sizeof(int) * 3 + 1];  // Buffer for __LINE__
 
   const Name *key_file = alloc_name("__FILE__", NULL, false);
   const Name *key_line = alloc_name("__LINE__", NULL, false);
@@ -405,37 +474,35 @@ int preprocess(FILE *fp, const char *filename) {
   Macro *old_line_macro = table_get(&macro_table, key_line);
 
   define_file_macro(filename, key_file);
-  table_put(&macro_table, key_line, new_macro_single(linenobuf));
+  table_put(&macro_table, key_line, new_macro(NULL, false, NULL));  // Expanded in `expand_macro`.
 
   Stream stream;
   stream.filename = filename;
-  stream.fp = fp;
+  stream.src = read_source(fp);
+
+  // Multiple-include guard: `#ifndef X` as the first directive, and its `#endif` at the end.
+  enum {
+    GUARD_NONE,
+    GUARD_BEFORE,  // Before the first directive.
+    GUARD_INSIDE,
+    GUARD_AFTER,  // After the `#endif`.
+  } guard_state = GUARD_BEFORE;
+  const Name *guard = NULL;
 
   for (stream.lineno = 1;; ++stream.lineno) {
-    char *line = NULL;
-    size_t capa = 0;
-    ssize_t len = getline(&line, &capa, fp);
+    char *line;
+    ssize_t len = enable ? source_getline(stream.src, &line)
+                         : skip_disabled_lines(&stream, &line);
     if (len == -1)
       break;
-
-    snprintf(linenobuf, sizeof(linenobuf), "%d", stream.lineno);
-
-    for (;;) {
-      if (len > 0 && line[len - 1] == '\n')
-        line[--len] = '\0';
-      if (len < 1 || line[len - 1] != '\\')
-        break;
-      // Continue line.
-      ++stream.lineno;
-      line[--len] = '\0';
-      ssize_t nextlen = getline_cat(&line, &capa, fp, len);
-      if (nextlen != -1)
-        len = nextlen;
-    }
+    source_join_lines(stream.src, line, len, &stream.lineno);
 
     // Find '#'
     const char *directive = find_directive(line);
     if (directive == NULL) {
+      if ((guard_state == GUARD_BEFORE || guard_state == GUARD_AFTER) &&
+          !is_blank_line(line, stream.src))
+        guard_state = GUARD_NONE;
       if (enable)
         process_line(line, &stream);
       else
@@ -445,6 +512,29 @@ int preprocess(FILE *fp, const char *filename) {
     fprintf(pp_ofp, "\n");
 
     const char *next;
+    switch (guard_state) {
+    case GUARD_BEFORE:
+      guard_state = GUARD_NONE;
+      if ((next = keyword(directive, "ifndef")) != NULL) {
+        const char *end = read_ident(next);
+        if (end != NULL) {
+          guard = alloc_name(next, end, false);
+          guard_state = GUARD_INSIDE;
+        }
+      }
+      break;
+    case GUARD_INSIDE:
+      if (condstack->len == 1 &&
+          (keyword(directive, "else") != NULL || keyword(directive, "elif") != NULL))
+        guard_state = GUARD_NONE;
+      break;
+    case GUARD_AFTER:
+      guard_state = GUARD_NONE;
+      break;
+    default:
+      break;
+    }
+
     if ((next = keyword(directive, "ifdef")) != NULL) {
       vec_push(condstack, (void*)cond_value(enable, satisfy));
       bool defined = handle_ifdef(next);
@@ -511,10 +601,18 @@ int preprocess(FILE *fp, const char *filename) {
         error("unknown directive: %s", directive);
       }
     }
+    if (guard_state == GUARD_INSIDE && condstack->len == 0)
+      guard_state = GUARD_AFTER;
   }
 
   if (condstack->len > 0)
     error("#if not closed");
+  // Recorded also for main files, so that a later `#include` of the same file is skipped.
+  if (guard_state == GUARD_AFTER) {
+    const Name *id = file_identity(filename);
+    if (id != NULL)
+      get_include_info(id)->guard = guard;
+  }
 
   table_put(&macro_table, key_file, old_file_macro);
   table_put(&macro_table, key_line, old_line_macro);
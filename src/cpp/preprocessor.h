@@ -1,9 +1,13 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdio.h>  // FILE*
 
 void init_preprocessor(FILE *ofp);
+void set_preprocessor_output(FILE *ofp);
 int preprocess(FILE *fp, const char *filename);
+bool precompile_header(const char *header, const char *pch_path);
+bool is_include_skipped(const char *filename);
 
 void define_macro(const char *arg);
 void define_macro_simple(const char *label);
@@ -3,36 +3,111 @@
 #include <stdlib.h>  // malloc
 #include <string.h>
 
+#include "util.h"  // Arena
+
 // Hash
+//
+// Mixes a word (8 bytes) at a time.  A short key is read with two overlapping loads,
+// and the length is mixed first, so the overlap does not make collisions.
+
+#define HASH_MUL  (0x9e3779b97f4a7c15ULL)
+#define HASH_MIX(hash, word)  ((((hash) << 27 | (hash) >> 37) ^ (word)) * HASH_MUL)
+
+static uint64_t load64(const unsigned char *p) {
+  uint64_t word;
+  memcpy(&word, p, sizeof(word));
+  return word;
+}
+
+static uint32_t load32(const unsigned char *p) {
+  uint32_t word;
+  memcpy(&word, p, sizeof(word));
+  return word;
+}
 
 static uint32_t hash_string(const char *key, int length) {
-  const unsigned char *u = (const unsigned char*)key;
-  // FNV1a
-  uint32_t hash = 2166136261u;
-  for (int i = 0; i < length; ++i)
-    hash = (hash ^ u[i]) * 16777619u;
-  return hash;
+  const unsigned char *p = (const unsigned char*)key;
+  uint64_t hash = (uint64_t)length * HASH_MUL;
+  if (length > 8) {
+    for (; length > 8; p += 8, length -= 8)
+      hash = HASH_MIX(hash, load64(p));
+    hash = HASH_MIX(hash, load64(p + length - 8));
+  } else if (length >= 4) {
+    hash = HASH_MIX(hash, (uint64_t)load32(p) << 32 | load32(p + length - 4));
+  } else if (length > 0) {
+    hash = HASH_MIX(hash, (uint64_t)p[0] << 16 | (uint64_t)p[length >> 1] << 8 | p[length - 1]);
+  }
+  // Tables use lower bits, so bring upper bits down.
+  hash ^= hash >> 32;
+  hash *= HASH_MUL;
+  return (uint32_t)(hash >> 32);
 }
 
+// Both tables are open addressing with power of 2 capacity, and use Robin Hood hashing:
+// an entry far from its home slot takes over the slot from one nearer to its home,
+// so a search can stop as soon as it passes the distance of a stored entry.
+
+#define PROBE_DISTANCE(index, hash, mask)  (((index) - (hash)) & (mask))
+
 // Name
 
-static Table name_table;
+// The hash is held also in the entry, so that probing does not touch the names.
+typedef struct {
+  const Name *name;
+  uint32_t hash;
+} NameEntry;
+
+static struct {
+  NameEntry *entries;
+  uint32_t capacity;
+  uint32_t count;
+} name_table;
+static Arena name_arena;  // Names and their copied strings are kept until the end.
+
+static void insert_name(NameEntry *entries, uint32_t mask, const Name *name) {
+  NameEntry entry = {name, name->hash};
+  for (uint32_t index = entry.hash & mask, dist = 0; ; index = (index + 1) & mask, ++dist) {
+    NameEntry *other = &entries[index];
+    if (other->name == NULL) {
+      *other = entry;
+      return;
+    }
+    uint32_t other_dist = PROBE_DISTANCE(index, other->hash, mask);
+    if (other_dist < dist) {
+      NameEntry tmp = *other;
+      *other = entry;
+      entry = tmp;
+      dist = other_dist;
+    }
+  }
+}
+
+static void grow_name_table(void) {
+  uint32_t new_capacity = name_table.capacity > 0 ? name_table.capacity * 2 : 256;
+  NameEntry *new_entries = calloc(new_capacity, sizeof(*new_entries));
+  for (uint32_t i = 0; i < name_table.capacity; ++i) {
+    const Name *name = name_table.entries[i].name;
+    if (name != NULL)
+      insert_name(new_entries, new_capacity - 1, name);
+  }
+  free(name_table.entries);
+  name_table.entries = new_entries;
+  name_table.capacity = new_capacity;
+}
 
 static const Name *find_name_table(const char *chars, int bytes, uint32_t hash) {
-  const Table *table = &name_table;
-  if (table->count == 0)
+  if (name_table.count == 0)
     return NULL;
 
-  for (uint32_t index = hash % table->capacity; ; index = (index + 1) % table->capacity) {
-    TableEntry *entry = &table->entries[index];
-    const Name *key = entry->key;
-    if (key == NULL) {
-      if (entry->value == NULL)
-        return NULL;
-    } else if (key->bytes == bytes &&
-               key->hash == hash &&
-               memcmp(key->chars, chars, bytes) == 0) {
-      return key;
+  uint32_t mask = name_table.capacity - 1;
+  for (uint32_t index = hash & mask, dist = 0; ; index = (index + 1) & mask, ++dist) {
+    const NameEntry *entry = &name_table.entries[index];
+    if (entry->name == NULL || PROBE_DISTANCE(index, entry->hash, mask) < dist)
+      return NULL;
+    if (entry->hash == hash) {
+      const Name *key = entry->name;
+      if (key->bytes == bytes && memcmp(key->chars, chars, bytes) == 0)
+        return key;
     }
   }
 }
@@ -42,16 +117,24 @@ const Name *alloc_name(const char *begin, const char *end, bool make_copy) {
   uint32_t hash = hash_string(begin, bytes);
   const Name *name = find_name_table(begin, bytes, hash);
   if (name == NULL) {
+    Name *new_name;
     if (make_copy) {
-      char *new_str = malloc(bytes);
+      // Characters are placed just after the name.
+      new_name = arena_alloc(&name_arena, sizeof(*new_name) + bytes);
+      char *new_str = (char*)(new_name + 1);
       memcpy(new_str, begin, bytes);
       begin = new_str;
+    } else {
+      new_name = arena_alloc(&name_arena, sizeof(*new_name));
     }
-    Name *new_name = malloc(sizeof(*new_name));
     new_name->chars = begin;
     new_name->bytes = bytes;
     new_name->hash = hash;
-    table_put(&name_table, new_name, new_name);
+
+    if ((name_table.count + 1) * 4 > name_table.capacity * 3)
+      grow_name_table();
+    insert_name(name_table.entries, name_table.capacity - 1, new_name);
+    ++name_table.count;
     name = new_name;
   }
   return name;
@@ -63,49 +146,53 @@ bool equal_name(const Name *name1, const Name *name2) {
 
 // Table
 
-static TableEntry *find_entry(TableEntry *entries, int capacity, const Name *key) {
-  TableEntry *tombstone = NULL;
-  for (uint32_t index = key->hash % capacity; ; index = (index + 1) % capacity) {
+static int find_entry(const Table *table, const Name *key) {
+  if (table->count == 0)
+    return -1;
+
+  uint32_t mask = table->capacity - 1;
+  for (uint32_t index = key->hash & mask, dist = 0; ; index = (index + 1) & mask, ++dist) {
+    const Name *other = table->entries[index].key;
+    if (other == key)
+      return index;
+    if (other == NULL || PROBE_DISTANCE(index, other->hash, mask) < dist)
+      return -1;
+  }
+}
+
+static void insert_entry(TableEntry *entries, uint32_t mask, const Name *key, void *value) {
+  for (uint32_t index = key->hash & mask, dist = 0; ; index = (index + 1) & mask, ++dist) {
     TableEntry *entry = &entries[index];
     if (entry->key == NULL) {
-      if (entry->value == NULL) {
-        return tombstone != NULL ? tombstone : entry;
-      } else {  // Tombstone.
-        if (tombstone == NULL)
-          tombstone = entry;
-      }
-    } else if (entry->key == key) {
-      return entry;
+      entry->key = key;
+      entry->value = value;
+      return;
+    }
+    uint32_t other_dist = PROBE_DISTANCE(index, entry->key->hash, mask);
+    if (other_dist < dist) {
+      TableEntry tmp = *entry;
+      entry->key = key;
+      entry->value = value;
+      key = tmp.key;
+      value = tmp.value;
+      dist = other_dist;
     }
   }
 }
 
 static void adjust_capacity(Table *table, int new_capacity) {
-  TableEntry *new_entries = malloc(sizeof(TableEntry) * new_capacity);
-  for (int i = 0; i < new_capacity; ++i) {
-    TableEntry *entry = &new_entries[i];
-    entry->key = NULL;
-    entry->value = NULL;
-  }
-
+  TableEntry *new_entries = calloc(new_capacity, sizeof(*new_entries));
   TableEntry *old_entries = table->entries;
   int old_capacity = table->capacity;
-  int new_count = 0;
   for (int i = 0; i < old_capacity; ++i) {
     TableEntry *entry = &old_entries[i];
-    if (entry->key == NULL)
-      continue;
-
-    TableEntry *dest = find_entry(new_entries, new_capacity, entry->key);
-    dest->key = entry->key;
-    dest->value = entry->value;
-    ++new_count;
+    if (entry->key != NULL)
+      insert_entry(new_entries, new_capacity - 1, entry->key, entry->value);
   }
 
   free(old_entries);
   table->entries = new_entries;
   table->capacity = new_capacity;
-  table->count = new_count;
 }
 
 void table_init(Table *table) {
@@ -114,59 +201,54 @@ void table_init(Table *table) {
 }
 
 void *table_get(Table *table, const Name *key) {
-  if (table->count == 0)
-    return NULL;
-
-  TableEntry *entry = find_entry(table->entries, table->capacity, key);
-  if (entry->key == NULL)
-    return NULL;
-
-  return entry->value;
+  int index = find_entry(table, key);
+  return index >= 0 ? table->entries[index].value : NULL;
 }
 
 bool table_try_get(Table *table, const Name *key, void **output) {
-  if (table->count == 0)
+  int index = find_entry(table, key);
+  if (index < 0)
     return false;
 
-  TableEntry *entry = find_entry(table->entries, table->capacity, key);
-  if (entry->key == NULL)
-    return false;
-
-  *output = entry->value;
+  *output = table->entries[index].value;
   return true;
 }
 
 bool table_put(Table *table, const Name *key, void *value) {
-  const int MIN_CAPACITY = 15;
-  if (table->count >= table->capacity / 2) {
-    int capacity = table->capacity * 2 - 1;  // Keep odd.
-    if (capacity < MIN_CAPACITY)
-      capacity = MIN_CAPACITY;
-    adjust_capacity(table, capacity);
+  const int MIN_CAPACITY = 16;
+  int index = find_entry(table, key);
+  if (index >= 0) {
+    table->entries[index].value = value;
+    return false;
   }
 
-  TableEntry *entry = find_entry(table->entries, table->capacity, key);
-  bool is_new_key = entry->key == NULL;
-  if (is_new_key && entry->value == NULL)
-    ++table->count;
-
-  entry->key = key;
-  entry->value = value;
-  return is_new_key;
+  if ((table->count + 1) * 4 > table->capacity * 3)
+    adjust_capacity(table, table->capacity > 0 ? table->capacity * 2 : MIN_CAPACITY);
+  insert_entry(table->entries, table->capacity - 1, key, value);
+  ++table->count;
+  return true;
 }
 
 bool table_delete(Table *table, const Name *key) {
-  if (table->count == 0)
+  int index = find_entry(table, key);
+  if (index < 0)
     return false;
 
-  TableEntry *entry = find_entry(table->entries, table->capacity, key);
-  if (entry->key == NULL)
-    return false;
-
-  // Put tombstone.
-  entry->key = NULL;
-  entry->value = entry;
-
+  // Shift following entries back, instead of leaving a tombstone.
+  uint32_t mask = table->capacity - 1;
+  TableEntry *entries = table->entries;
+  for (uint32_t i = index; ; ) {
+    uint32_t next = (i + 1) & mask;
+    const Name *moved = entries[next].key;
+    if (moved == NULL || PROBE_DISTANCE(next, moved->hash, mask) == 0) {
+      entries[i].key = NULL;
+      entries[i].value = NULL;
+      break;
+    }
+    entries[i] = entries[next];
+    i = next;
+  }
+  --table->count;
   return true;
 }
 
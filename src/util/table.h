@@ -25,7 +25,7 @@ typedef struct TableEntry {
 
 typedef struct Table {
   TableEntry *entries;
-  int capacity;
+  int capacity;  // Power of 2
   int count;
 } Table;
 
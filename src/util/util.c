@@ -42,26 +42,6 @@ void set_local_label_prefix(const char *prefix) {
   strncpy(label_prefix, prefix, sizeof(label_prefix));
 }
 
-ssize_t getline_cat(char **lineptr, size_t *n, FILE *stream, size_t curlen) {
-  char *nextline = NULL;
-  size_t capa = 0;
-  ssize_t len = getline(&nextline, &capa, stream);
-  if (len == -1)
-    return -1;
-  if (len > 0) {
-    char *oldline = *lineptr;
-    char *reallocated = realloc(oldline, curlen + len + 1);
-    if (reallocated == NULL)
-      return -1;
-
-    memcpy(reallocated + curlen, nextline, len + 1);
-    *lineptr = reallocated;
-    *n = curlen + len;  // '\0' is not included.
-    free(nextline);
-  }
-  return curlen + len;
-}
-
 bool is_fullpath(const char *filename) {
   if (*filename != '/')
     return false;
@@ -131,24 +111,15 @@ char *cat_path(const char *root, const char *path) {
   if (dirs->len == 0)
     return strdup_("/");
 
-  size_t total_len = 1;  // 1 for NUL-terminate.
-  for (int i = 0; i < dirs->len; i += 2) {
-    if (i != 0 || is_root)
-      total_len += 1;
-    total_len += ((char*)dirs->data[i + 1] - (char*)dirs->data[i]);
-  }
-
-  char *buf = malloc(total_len);
-  char *p = buf;
+  StringBuffer sb;
+  sb_init(&sb);
   for (int i = 0; i < dirs->len; i += 2) {
     if (i != 0 || is_root)
-      *p++ = '/';
-    size_t size = (char*)dirs->data[i + 1] - (char*)dirs->data[i];
-    memcpy(p, dirs->data[i], size);
-    p += size;
+      sb_append(&sb, "/", NULL);
+    sb_append(&sb, dirs->data[i], dirs->data[i + 1]);
   }
-  *p = '\0';
-  return buf;
+  free_vector(dirs);
+  return sb_steal(&sb);
 }
 
 char *change_ext(const char *path, const char *ext) {
@@ -159,7 +130,7 @@ char *change_ext(const char *path, const char *ext) {
   const char *q = strrchr(p, '.');
   size_t len = q != NULL ? (size_t)(q - path) : strlen(path);
   size_t ext_len = strlen(ext);
-  char *s = malloc(len + 1 + ext_len);
+  char *s = malloc(len + 1 + ext_len + 1);
   if (s != NULL) {
     memcpy(s, path, len);
     s[len] = '.';
@@ -329,52 +300,112 @@ bool vec_contains(Vector *vec, void *elem) {
   return false;
 }
 
+void free_vector(Vector *vec) {
+  free(vec->data);
+  free(vec);
+}
+
+// Arena
+
+#define ARENA_CHUNK_MIN  (4 * 1024)
+#define ARENA_CHUNK_MAX  (64 * 1024)
+#define ARENA_ALIGN      (8)
+
+typedef struct ArenaChunk {
+  struct ArenaChunk *next;
+  size_t size;
+} ArenaChunk;
+
+static char *new_arena_chunk(Arena *arena, size_t size) {
+  ArenaChunk *chunk = malloc(sizeof(*chunk) + size);
+  if (chunk == NULL)
+    error("not enough memory");
+  chunk->next = arena->chunks;
+  chunk->size = size;
+  arena->chunks = chunk;
+  return (char*)(chunk + 1);
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+  size = ALIGN(size, ARENA_ALIGN);
+  if (size > (size_t)(arena->end - arena->p)) {
+    if (size > ARENA_CHUNK_MAX / 4)  // Large object has its own chunk, and the current one is kept.
+      return new_arena_chunk(arena, size);
+    // Chunk size grows from small one, because many arenas (one for each function) stay small.
+    size_t chunk_size = arena->chunks == NULL ? ARENA_CHUNK_MIN
+                                              : MIN(arena->chunks->size * 2, ARENA_CHUNK_MAX);
+    chunk_size = MAX(chunk_size, ARENA_CHUNK_MIN) - sizeof(ArenaChunk);
+    arena->p = new_arena_chunk(arena, chunk_size);
+    arena->end = arena->p + chunk_size;
+  }
+  void *p = arena->p;
+  arena->p += size;
+  return p;
+}
+
+void arena_release(Arena *arena) {
+  for (ArenaChunk *chunk = arena->chunks, *next; chunk != NULL; chunk = next) {
+    next = chunk->next;
+    free(chunk);
+  }
+  arena->chunks = NULL;
+  arena->p = arena->end = NULL;
+}
+
 // StringBuffer
 
-typedef struct {
-  const char *start;
-  size_t len;
-} StringElement;
+#define SB_MIN  (16)
 
 void sb_init(StringBuffer *sb) {
-  sb->elems = new_vector();
+  sb->buf = NULL;
+  sb->size = sb->capa = 0;
 }
 
 void sb_clear(StringBuffer *sb) {
-  vec_clear(sb->elems);
+  sb->size = 0;
 }
 
 bool sb_empty(StringBuffer *sb) {
-  return sb->elems->len == 0;
+  return sb->size == 0;
+}
+
+void sb_reserve(StringBuffer *sb, size_t size) {
+  size_t required = sb->size + size + 1;  // +1 for NUL-terminate.
+  if (required <= sb->capa)
+    return;
+  size_t capa = MAX(sb->capa * 2, SB_MIN);
+  while (capa < required)
+    capa *= 2;
+  char *buf = realloc(sb->buf, capa);
+  if (buf == NULL)
+    error("not enough memory");
+  sb->buf = buf;
+  sb->capa = capa;
 }
 
 void sb_append(StringBuffer *sb, const char *start, const char *end) {
-  StringElement *elem = malloc(sizeof(*elem));
-  elem->start = start;
-  elem->len = end != NULL ? (size_t)(end - start) : strlen(start);
-  vec_push(sb->elems, elem);
+  size_t len = end != NULL ? (size_t)(end - start) : strlen(start);
+  sb_reserve(sb, len);
+  memcpy(sb->buf + sb->size, start, len);
+  sb->size += len;
 }
 
 char *sb_to_string(StringBuffer *sb) {
-  size_t total_len = 0;
-  int count = sb->elems->len;
-  for (int i = 0; i < count; ++i) {
-    StringElement *elem = sb->elems->data[i];
-    total_len += elem->len;
-  }
+  char *str = malloc(sb->size + 1);
+  memcpy(str, sb->buf, sb->size);
+  str[sb->size] = '\0';
+  return str;
+}
 
-  char *str = malloc(total_len + 1);
-  char *p = str;
-  for (int i = 0; i < count; ++i) {
-    StringElement *elem = sb->elems->data[i];
-    memcpy(p, elem->start, elem->len);
-    p += elem->len;
-  }
-  *p = '\0';
+char *sb_steal(StringBuffer *sb) {
+  sb_reserve(sb, 0);
+  sb->buf[sb->size] = '\0';
+  char *str = sb->buf;
+  sb_init(sb);
   return str;
 }
 
-static const char *escape(int c) {
+static const char *escape(int c, char hex[5]) {
   switch (c) {
   case '\0': return "\\0";
   case '\n': return "\\n";
@@ -384,9 +415,8 @@ static const char *escape(int c) {
   case '\\': return "\\\\";
   default:
     if (c < 0x20 || c >= 0x7f) {
-      char *s = malloc(5);
-      snprintf(s, 5, "\\x%02x", c & 0xff);
-      return s;
+      snprintf(hex, 5, "\\x%02x", c & 0xff);
+      return hex;
     }
     return NULL;
   }
@@ -395,8 +425,10 @@ static const char *escape(int c) {
 void escape_string(const char *str, size_t size, StringBuffer *sb) {
   const char *s, *p;
   const char *end = str + size;
+  char hex[5];
+  sb_reserve(sb, size);
   for (s = p = str; p < end; ++p) {
-    const char *e = escape(*p);
+    const char *e = escape(*p, hex);
     if (e == NULL)
       continue;
 
@@ -408,3 +440,309 @@ void escape_string(const char *str, size_t size, StringBuffer *sb) {
   if (p > s)
     sb_append(sb, s, p);
 }
+
+// Source buffer
+
+#if !defined(SELF_HOSTING) && !defined(__XV6)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>  // sysconf
+
+// Maps a regular file privately, so that lines can be terminated in place.
+// The rest of the last page is filled with zero, which terminates the buffer.
+static char *map_source(FILE *fp, size_t *psize) {
+  struct stat st;
+  int fd = fileno(fp);
+  if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 ||
+      st.st_size % sysconf(_SC_PAGESIZE) == 0 || ftell(fp) != 0)
+    return NULL;
+  void *p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if (p == MAP_FAILED)
+    return NULL;
+  *psize = st.st_size;
+  return p;
+}
+#endif
+
+SourceBuffer *read_source(FILE *fp) {
+  char *buf = NULL;
+  size_t size = 0;
+#if !defined(SELF_HOSTING) && !defined(__XV6)
+  buf = map_source(fp, &size);
+#endif
+  if (buf == NULL) {
+    // Pipes and memory streams are read in large blocks.
+    size_t capa = 0;
+    for (;;) {
+      if (size + 1 >= capa) {
+        capa = capa > 0 ? capa * 2 : 0x10000;
+        buf = realloc(buf, capa);
+      }
+      size_t n = fread(buf + size, 1, capa - size - 1, fp);
+      if (n == 0)
+        break;
+      size += n;
+    }
+    buf[size] = '\0';
+  }
+
+  SourceBuffer *src = malloc(sizeof(*src));
+  src->p = buf;
+  src->end = buf + size;
+  return src;
+}
+
+ssize_t source_getline(SourceBuffer *src, char **pline) {
+  char *line = src->p;
+  if (line >= src->end)
+    return -1;
+#if !defined(SELF_HOSTING)
+  // libc's memchr is vectorized.
+  char *q = memchr(line, '\n', src->end - line);
+  if (q == NULL)
+    q = src->end;
+#else
+  char *q = line;
+  while (q < src->end && *q != '\n')
+    ++q;
+#endif
+  src->p = q < src->end ? q + 1 : q;
+  *q = '\0';
+  *pline = line;
+  return q - line;
+}
+
+ssize_t source_join_lines(SourceBuffer *src, char *line, ssize_t len, int *pcount) {
+  while (len > 0 && line[len - 1] == '\\') {
+    line[--len] = '\0';
+    if (pcount != NULL)
+      ++*pcount;
+    char *next;
+    ssize_t nextlen = source_getline(src, &next);
+    if (nextlen < 0)
+      break;
+    // `next` follows `line` in the buffer, so it can be moved down.
+    memmove(line + len, next, nextlen + 1);
+    len += nextlen;
+  }
+  return len;
+}
+
+// Time report
+//
+// Phases are timed exclusively: while a nested phase runs, its parent is paused.
+// Records are appended to the output file as tab separated lines,
+//   phase <tool> <name> <wall sec> <cpu sec>
+//   stat <tool> <key> <value>
+// so that xcc can merge them from all tools into one table.
+
+#if !defined(SELF_HOSTING) && !defined(__XV6)
+#include <sys/resource.h>  // getrusage
+#include <time.h>  // clock_gettime
+
+#define MAX_PHASE_DEPTH  (8)
+
+typedef struct {
+  const char *name;
+  double wall, cpu;
+} PhaseTime;
+
+static struct {
+  const char *tool;
+  const char *output;
+  Vector *phases;  // <PhaseTime*>
+  PhaseTime *stack[MAX_PHASE_DEPTH];
+  int depth;
+  double last_wall, last_cpu;
+  long start_heap;
+} time_report;
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+#include <malloc.h>  // mallinfo2
+
+// Bytes in use by malloc, summed over all arenas, or -1 if unknown.
+static long heap_in_use(void) {
+  struct mallinfo2 mi = mallinfo2();
+  return mi.uordblks + mi.hblkhd;
+}
+#else
+static long heap_in_use(void) {
+  return -1;
+}
+#endif
+
+#if defined(COUNT_ALLOCS)
+// Linked with `-Wl,--wrap=malloc` and so on, which routes calls from this program here.
+// Counted only while the report is enabled, and on worker threads too.
+extern void *__real_malloc(size_t size);
+extern void *__real_calloc(size_t n, size_t size);
+extern void *__real_realloc(void *ptr, size_t size);
+
+static bool count_allocs;
+static long alloc_count;
+
+#define COUNT_ALLOC()  do { if (count_allocs) __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED); } while (0)
+
+void *__wrap_malloc(size_t size) {
+  COUNT_ALLOC();
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+  COUNT_ALLOC();
+  return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  if (ptr == NULL)
+    COUNT_ALLOC();
+  return __real_realloc(ptr, size);
+}
+
+static void start_alloc_count(void) {
+  alloc_count = 0;
+  count_allocs = true;
+}
+
+static long stop_alloc_count(void) {
+  count_allocs = false;
+  return alloc_count;
+}
+#else
+static void start_alloc_count(void) {
+}
+
+static long stop_alloc_count(void) {
+  return -1;
+}
+#endif
+
+static double clock_sec(clockid_t clk) {
+  struct timespec ts;
+  clock_gettime(clk, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Charge the time since the last event to the current phase.
+// CPU time is of the calling thread, and workers report theirs by `time_report_add`.
+static void charge_time_report(void) {
+  double wall = clock_sec(CLOCK_MONOTONIC);
+  double cpu = clock_sec(CLOCK_THREAD_CPUTIME_ID);
+  if (time_report.depth > 0) {
+    PhaseTime *phase = time_report.stack[time_report.depth - 1];
+    phase->wall += wall - time_report.last_wall;
+    phase->cpu += cpu - time_report.last_cpu;
+  }
+  time_report.last_wall = wall;
+  time_report.last_cpu = cpu;
+}
+
+bool init_time_report(const char *tool, const char *output) {
+  time_report.tool = tool;
+  time_report.output = output;
+  time_report.phases = new_vector();
+  time_report.depth = 0;
+  time_report.start_heap = heap_in_use();
+  start_alloc_count();
+  return true;
+}
+
+static PhaseTime *find_phase_time(const char *phase) {
+  for (int i = 0; i < time_report.phases->len; ++i) {
+    PhaseTime *p = time_report.phases->data[i];
+    if (strcmp(p->name, phase) == 0)
+      return p;
+  }
+  PhaseTime *pt = calloc(1, sizeof(*pt));
+  pt->name = phase;
+  vec_push(time_report.phases, pt);
+  return pt;
+}
+
+void time_report_begin(const char *phase) {
+  if (time_report.tool == NULL)
+    return;
+  charge_time_report();
+
+  assert(time_report.depth < MAX_PHASE_DEPTH);
+  time_report.stack[time_report.depth++] = find_phase_time(phase);
+}
+
+void time_report_end(void) {
+  if (time_report.tool == NULL)
+    return;
+  charge_time_report();
+  assert(time_report.depth > 0);
+  --time_report.depth;
+}
+
+// Must be called on the main thread.  Wall time from parallel threads adds up.
+void time_report_add(const char *phase, double wall, double cpu) {
+  if (time_report.tool == NULL)
+    return;
+  PhaseTime *pt = find_phase_time(phase);
+  pt->wall += wall;
+  pt->cpu += cpu;
+}
+
+void finish_time_report(void) {
+  const char *tool = time_report.tool;
+  if (tool == NULL)
+    return;
+  time_report.tool = NULL;
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  long heap = heap_in_use();
+  long heap_kb = heap >= 0 && time_report.start_heap >= 0
+      ? (heap - time_report.start_heap) / 1024 : -1;
+  long allocs = stop_alloc_count();
+
+  FILE *fp = stderr;
+  if (time_report.output != NULL) {
+    fp = fopen(time_report.output, "a");
+    if (fp == NULL)
+      return;
+    for (int i = 0; i < time_report.phases->len; ++i) {
+      PhaseTime *p = time_report.phases->data[i];
+      fprintf(fp, "phase\t%s\t%s\t%f\t%f\n", tool, p->name, p->wall, p->cpu);
+    }
+    fprintf(fp, "stat\t%s\tmaxrss_kb\t%ld\n", tool, usage.ru_maxrss);
+    fprintf(fp, "stat\t%s\theap_kb\t%ld\n", tool, heap_kb);
+    fprintf(fp, "stat\t%s\tallocs\t%ld\n", tool, allocs);
+    fclose(fp);
+  } else {
+    fprintf(fp, "%-4s %-24s %10s %10s\n", tool, "phase", "wall(ms)", "cpu(ms)");
+    for (int i = 0; i < time_report.phases->len; ++i) {
+      PhaseTime *p = time_report.phases->data[i];
+      fprintf(fp, "     %-24s %10.3f %10.3f\n", p->name, p->wall * 1000, p->cpu * 1000);
+    }
+    fprintf(fp, "     peak RSS: %ld KB, heap growth: %ld KB, allocations: %ld\n",
+            usage.ru_maxrss, heap_kb, allocs);
+  }
+}
+
+#else
+
+bool init_time_report(const char *tool, const char *output) {
+  UNUSED(tool);
+  UNUSED(output);
+  return false;
+}
+
+void time_report_begin(const char *phase) {
+  UNUSED(phase);
+}
+
+void time_report_end(void) {
+}
+
+void time_report_add(const char *phase, double wall, double cpu) {
+  UNUSED(phase);
+  UNUSED(wall);
+  UNUSED(cpu);
+}
+
+void finish_time_report(void) {
+}
+#endif
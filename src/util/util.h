@@ -14,6 +14,13 @@
 #define UNUSED(x)  ((void)(x))
 #define IS_POWER_OF_2(x)  (x > 0 && (x & (x - 1)) == 0)
 
+// Per thread globals, for code generation which runs on worker threads.
+#if !defined(SELF_HOSTING) && !defined(__XV6)
+#define THREAD_LOCAL  _Thread_local
+#else
+#define THREAD_LOCAL
+#endif
+
 #ifdef SELF_HOSTING
 #define QSORT  qsort
 #else
@@ -28,7 +35,6 @@ char *strndup_(const char *str, size_t size);
 bool starts_with(const char *str, const char *prefix);
 void set_local_label_prefix(const char *prefix);
 const Name *alloc_label(void);
-ssize_t getline_cat(char **lineptr, size_t *n, FILE *stream, size_t curlen);
 bool is_fullpath(const char *filename);
 char *cat_path(const char *root, const char *path);
 char *change_ext(const char *path, const char *ext);
@@ -65,17 +71,65 @@ void *vec_pop(Vector *vec);
 void vec_insert(Vector *vec, int pos, const void *elem);
 void vec_remove_at(Vector *vec, int index);
 bool vec_contains(Vector *vec, void *elem);
+void free_vector(Vector *vec);
+
+// Arena
+//
+// Bump pointer allocator: objects are not freed one by one, but released all at once.
+// Zero cleared arena is empty and ready to use.
+
+typedef struct Arena {
+  struct ArenaChunk *chunks;
+  char *p;
+  char *end;
+} Arena;
+
+void *arena_alloc(Arena *arena, size_t size);
+void arena_release(Arena *arena);
 
 // StringBuffer
+//
+// Contiguous buffer which grows geometrically.  Appended text is copied.
 
 typedef struct StringBuffer {
-  Vector *elems;
+  char *buf;
+  size_t size;
+  size_t capa;
 } StringBuffer;
 
 void sb_init(StringBuffer *sb);
 void sb_clear(StringBuffer *sb);
 bool sb_empty(StringBuffer *sb);
-void sb_append(StringBuffer *sb, const char *start, const char *end);
-char *sb_to_string(StringBuffer *sb);
+void sb_reserve(StringBuffer *sb, size_t size);  // Makes room to append `size` bytes.
+void sb_append(StringBuffer *sb, const char *start, const char *end);  // end == NULL => strlen
+char *sb_to_string(StringBuffer *sb);  // Returns a copy.
+// Hands the buffer (NUL terminated) over to the caller without copying, and `sb` gets empty.
+// The result can be passed to `alloc_name` without `make_copy`.
+char *sb_steal(StringBuffer *sb);
 
 void escape_string(const char *str, size_t size, StringBuffer *sb);
+
+// Source buffer
+//
+// Whole input is mapped or read at once, and lines are handed out as slices of
+// the buffer, which are terminated in place and live until the process ends.
+
+typedef struct SourceBuffer {
+  char *p;  // Next line.
+  char *end;
+} SourceBuffer;
+
+SourceBuffer *read_source(FILE *fp);
+// Returns the length of the next line without the newline, or -1 at the end.
+ssize_t source_getline(SourceBuffer *src, char **pline);
+// Joins following lines in place while `line` ends with a backslash,
+// and adds the number of joined lines to `*pcount` if it is not NULL.
+ssize_t source_join_lines(SourceBuffer *src, char *line, ssize_t len, int *pcount);
+
+// Time report
+
+bool init_time_report(const char *tool, const char *output);  // output == NULL => stderr
+void time_report_begin(const char *phase);
+void time_report_end(void);
+void time_report_add(const char *phase, double wall, double cpu);  // Measured on other threads
+void finish_time_report(void);
@@ -0,0 +1,233 @@
+#include "cache.h"
+
+#if !defined(SELF_HOSTING) && !defined(__XV6)
+
+#include <dirent.h>
+#include <stdint.h>  // uint64_t
+#include <stdlib.h>  // getenv
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>  // unlink
+#include <utime.h>
+
+#include "../version.h"
+#include "util.h"
+
+#define DEFAULT_MAX_SIZE  (64L * 1024 * 1024)
+
+static const char *cache_dir;
+static long cache_max_size;
+
+static char *cache_path(const char *name) {
+  return cat_path(cache_dir, name);
+}
+
+// Stats
+
+typedef struct {
+  long hits;
+  long misses;
+} CacheStats;
+
+static void load_stats(CacheStats *stats) {
+  stats->hits = stats->misses = 0;
+  FILE *fp = fopen(cache_path("stats"), "r");
+  if (fp == NULL)
+    return;
+  if (fscanf(fp, "hits %ld\nmisses %ld\n", &stats->hits, &stats->misses) != 2)
+    stats->hits = stats->misses = 0;
+  fclose(fp);
+}
+
+static void count_stats(bool hit) {
+  // Not locked: concurrent invocations might lose a count, but never the cached data.
+  CacheStats stats;
+  load_stats(&stats);
+  if (hit)
+    ++stats.hits;
+  else
+    ++stats.misses;
+
+  char *tmp = cache_path("stats.tmp");
+  FILE *fp = fopen(tmp, "w");
+  if (fp == NULL)
+    return;
+  fprintf(fp, "hits %ld\nmisses %ld\n", stats.hits, stats.misses);
+  fclose(fp);
+  rename(tmp, cache_path("stats"));
+}
+
+// Eviction
+
+typedef struct {
+  char *path;
+  long size;
+  time_t mtime;
+} CacheEntry;
+
+static int compare_entry_mtime(const void *pa, const void *pb) {
+  const CacheEntry *a = *(const CacheEntry**)pa;
+  const CacheEntry *b = *(const CacheEntry**)pb;
+  return a->mtime < b->mtime ? -1 : a->mtime > b->mtime ? 1 : 0;
+}
+
+static bool is_cache_file(const char *name) {
+  size_t len = strlen(name);
+  return len == CACHE_KEY_HEX_LEN + 2 && name[CACHE_KEY_HEX_LEN] == '.';
+}
+
+// Remove least recently used entries until the total size gets under the limit.
+static void evict(void) {
+  DIR *dir = opendir(cache_dir);
+  if (dir == NULL)
+    return;
+
+  Vector *entries = new_vector();
+  long total = 0;
+  for (struct dirent *ent; (ent = readdir(dir)) != NULL; ) {
+    if (!is_cache_file(ent->d_name))
+      continue;
+    char *path = cache_path(ent->d_name);
+    struct stat st;
+    if (stat(path, &st) != 0)
+      continue;
+    CacheEntry *entry = malloc(sizeof(*entry));
+    entry->path = path;
+    entry->size = st.st_size;
+    entry->mtime = st.st_mtime;
+    vec_push(entries, entry);
+    total += st.st_size;
+  }
+  closedir(dir);
+
+  if (total <= cache_max_size)
+    return;
+
+  QSORT(entries->data, entries->len, sizeof(*entries->data), compare_entry_mtime);
+  long target = cache_max_size - cache_max_size / 4;  // Leave some room.
+  for (int i = 0; i < entries->len && total > target; ++i) {
+    CacheEntry *entry = entries->data[i];
+    if (unlink(entry->path) == 0)
+      total -= entry->size;
+  }
+}
+
+//
+
+static bool copy_file(const char *src, const char *dst) {
+  FILE *ifp = fopen(src, "rb");
+  if (ifp == NULL)
+    return false;
+  FILE *ofp = fopen(dst, "wb");
+  if (ofp == NULL) {
+    fclose(ifp);
+    return false;
+  }
+
+  bool result = true;
+  char buf[4096];
+  for (size_t size; (size = fread(buf, 1, sizeof(buf), ifp)) > 0; ) {
+    if (fwrite(buf, 1, size, ofp) != size) {
+      result = false;
+      break;
+    }
+  }
+  fclose(ifp);
+  if (fclose(ofp) != 0)
+    result = false;
+  return result;
+}
+
+bool cache_init(void) {
+  const char *dir = getenv("XCC_CACHE_DIR");
+  if (dir == NULL || *dir == '\0')
+    return false;
+  if (mkdir(dir, 0755) != 0) {
+    struct stat st;
+    if (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode))
+      return false;
+  }
+  cache_dir = dir;
+
+  cache_max_size = DEFAULT_MAX_SIZE;
+  const char *size = getenv("XCC_CACHE_SIZE");
+  if (size != NULL) {
+    char *p;
+    long n = strtol(size, &p, 10);
+    switch (*p) {
+    case 'k': case 'K':  n *= 1024L; break;
+    case 'm': case 'M':  n *= 1024L * 1024; break;
+    case 'g': case 'G':  n *= 1024L * 1024 * 1024; break;
+    default: break;
+    }
+    if (n > 0)
+      cache_max_size = n;
+  }
+  return true;
+}
+
+static void hash_bytes(uint64_t h[2], const void *data, size_t size) {
+  const unsigned char *p = data;
+  uint64_t h0 = h[0], h1 = h[1];
+  for (size_t i = 0; i < size; ++i) {
+    h0 = (h0 ^ p[i]) * 0x100000001b3ULL;  // FNV-1a
+    h1 = (h1 + p[i]) * 0x9e3779b97f4a7c15ULL;
+    h1 ^= h1 >> 29;
+  }
+  h[0] = h0;
+  h[1] = h1;
+}
+
+void cache_make_key(CacheKey *key, const char *src, size_t size, const Vector *options,
+                    const char *ext) {
+  uint64_t h[2] = {0xcbf29ce484222325ULL, 0x84222325cbf29ce4ULL};
+  static const char kVersion[] = VERSION;
+  hash_bytes(h, kVersion, sizeof(kVersion));
+  hash_bytes(h, ext, strlen(ext) + 1);
+  for (int i = 0; i < options->len; ++i) {
+    const char *opt = options->data[i];
+    if (opt != NULL)
+      hash_bytes(h, opt, strlen(opt) + 1);
+  }
+  hash_bytes(h, src, size);
+  snprintf(key->hex, sizeof(key->hex), "%016llx%016llx", (unsigned long long)h[0],
+           (unsigned long long)h[1]);
+}
+
+static char *entry_path(const CacheKey *key, const char *ext) {
+  char name[CACHE_KEY_HEX_LEN + 8];
+  snprintf(name, sizeof(name), "%s.%s", key->hex, ext);
+  return cache_path(name);
+}
+
+bool cache_fetch(const CacheKey *key, const char *ext, const char *dst) {
+  char *path = entry_path(key, ext);
+  bool hit = copy_file(path, dst);
+  if (hit)
+    utime(path, NULL);  // Mark as recently used.
+  count_stats(hit);
+  return hit;
+}
+
+void cache_store(const CacheKey *key, const char *ext, const char *src) {
+  char *path = entry_path(key, ext);
+  char *tmp = change_ext(path, "tmp");
+  if (copy_file(src, tmp) && rename(tmp, path) == 0)
+    evict();
+  else
+    unlink(tmp);
+}
+
+void cache_show_stats(FILE *fp) {
+  CacheStats stats;
+  load_stats(&stats);
+  long total = stats.hits + stats.misses;
+  fprintf(fp, "cache directory: %s\n", cache_dir);
+  fprintf(fp, "max size:        %ld\n", cache_max_size);
+  fprintf(fp, "hits:            %ld\n", stats.hits);
+  fprintf(fp, "misses:          %ld\n", stats.misses);
+  if (total > 0)
+    fprintf(fp, "hit rate:        %.1f%%\n", stats.hits * 100.0 / total);
+}
+
+#endif
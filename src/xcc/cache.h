@@ -0,0 +1,26 @@
+// Compilation cache
+//
+// Outputs of `xcc -S` and `xcc -c` are stored under the directory given by
+// the `XCC_CACHE_DIR` environment variable, keyed by a hash of the
+// preprocessed source, the tool version and the options.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>  // size_t
+#include <stdio.h>  // FILE
+
+typedef struct Vector Vector;
+
+#define CACHE_KEY_HEX_LEN  (32)
+
+typedef struct {
+  char hex[CACHE_KEY_HEX_LEN + 1];
+} CacheKey;
+
+bool cache_init(void);  // false => cache disabled.
+void cache_make_key(CacheKey *key, const char *src, size_t size, const Vector *options,
+                    const char *ext);
+bool cache_fetch(const CacheKey *key, const char *ext, const char *dst);
+void cache_store(const CacheKey *key, const char *ext, const char *src);
+void cache_show_stats(FILE *fp);
@@ -24,6 +24,26 @@
 
 #endif
 
+#if !defined(SELF_HOSTING) && !defined(__XV6)
+
+#define PARALLEL_COMPILE
+
+#define TIME_REPORT
+
+#if !defined(AS_USE_CC)
+// cpp, cc1 and as are linked into xcc, and can be run without fork/exec.
+#define IN_PROCESS
+
+extern int run_cpp(int argc, char *argv[], FILE *ofp);
+extern int run_cc1(int argc, char *argv[], FILE *ifp, FILE *ofp);
+extern int run_as(int argc, char *argv[], FILE *ifp);
+
+#include "cache.h"
+#include "server.h"
+#endif
+
+#endif
+
 static char *get_ext(const char *filename) {
   const char *last_slash = strrchr(filename, '/');
   if (last_slash == NULL)
@@ -96,11 +116,7 @@ pid_t pipe_exec(char **command, int ofd, int fd[2]) {
   return pid;
 }
 
-static int cat(const char *filename, int ofd) {
-  int ifd = open(filename, O_RDONLY);
-  if (ifd < 0)
-    return 1;
-
+static int cat_fd(int ifd, int ofd) {
   const int SIZE = 4096;
   char *buf = malloc(SIZE);
   for (;;) {
@@ -116,9 +132,17 @@ static int cat(const char *filename, int ofd) {
       break;
   }
   free(buf);
+  return 0;
+}
+
+static int cat(const char *filename, int ofd) {
+  int ifd = open(filename, O_RDONLY);
+  if (ifd < 0)
+    return 1;
 
+  int res = cat_fd(ifd, ofd);
   close(ifd);
-  return 0;
+  return res;
 }
 
 static void create_local_label_prefix_option(int index, char *out, size_t n) {
@@ -193,6 +217,282 @@ static int compile(const char *src, Vector *cpp_cmd, Vector *cc1_cmd, int ofd) {
   return res;
 }
 
+static int process_source(int index, const char *src, Vector *cpp_cmd, Vector *cc1_cmd, int ofd) {
+  char *ext = get_ext(src);
+  if (strcasecmp(ext, "c") == 0) {
+    char prefix_option[32];
+    create_local_label_prefix_option(index, prefix_option, sizeof(prefix_option));
+    if (cc1_cmd != NULL)
+      cc1_cmd->data[cc1_cmd->len - 2] = prefix_option;
+
+    return compile(src, cpp_cmd, cc1_cmd, ofd);
+  } else if (strcasecmp(ext, "s") == 0) {
+    return cat(src, ofd);
+  } else {
+    fprintf(stderr, "Unsupported file type: %s\n", src);
+    return -1;
+  }
+}
+
+#if defined(PARALLEL_COMPILE)
+typedef struct {
+  const char *src;
+  pid_t pid;  // -1 => not forked, process when flushed.
+  int fd;     // Temporary output, already unlinked.
+} Job;
+
+static int open_temp_file(void) {
+  char path[] = "/tmp/xcc-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0)
+    error("Cannot create temporary file");
+  unlink(path);
+  return fd;
+}
+
+// Run up to `njobs` compilations at once, each into its own temporary file,
+// and concatenate the results to `ofd` in the original order.
+static int process_sources_parallel(char **srcs, int count, int njobs, Vector *cpp_cmd,
+                                    Vector *cc1_cmd, bool out_pp, int ofd) {
+  Job *jobs = malloc(sizeof(*jobs) * count);
+  int started = 0, finished = 0;
+  int res = 0;
+  while (finished < started || (res == 0 && started < count)) {
+    if (res == 0 && started < count && started - finished < njobs) {
+      Job *job = &jobs[started];
+      int index = started++;
+      job->src = srcs[index];
+      job->pid = -1;
+      job->fd = -1;
+      if (strcasecmp(get_ext(job->src), "c") == 0) {
+        job->fd = open_temp_file();
+        job->pid = fork1();
+        if (job->pid == 0) {
+          int r = process_source(index, job->src, cpp_cmd, out_pp ? NULL : cc1_cmd, job->fd);
+          exit(r == 0 ? 0 : 1);
+        }
+      }
+      continue;
+    }
+
+    // Wait for the oldest job so that the output keeps the argument order.
+    Job *job = &jobs[finished];
+    int index = finished++;
+    int r;
+    if (job->pid != -1) {
+      r = wait_process(job->pid);
+      if (r == 0 && res == 0) {
+        if (lseek(job->fd, 0, SEEK_SET) != 0)
+          error("lseek failed");
+        r = cat_fd(job->fd, ofd);
+      }
+      close(job->fd);
+    } else {
+      r = res == 0 ? process_source(index, job->src, cpp_cmd, out_pp ? NULL : cc1_cmd, ofd) : 0;
+    }
+    res |= r;
+  }
+  free(jobs);
+  return res;
+}
+#endif
+
+#if defined(IN_PROCESS)
+static bool use_cache;
+
+// Whether the option doesn't change the output, so it is excluded from the cache key.
+static bool is_output_neutral_option(const char *opt) {
+  return starts_with(opt, "--time-report");
+}
+
+// Options which affect the output of cc1 and as.
+static Vector *cache_key_options(Vector *cc1_cmd, Vector *as_cmd) {
+  Vector *options = new_vector();
+  for (int i = 1; i < cc1_cmd->len; ++i) {
+    const char *opt = cc1_cmd->data[i];
+    if (opt == NULL || !is_output_neutral_option(opt))
+      vec_push(options, opt);
+  }
+  if (as_cmd != NULL) {
+    for (int i = 1; i < as_cmd->len; ++i) {
+      const char *opt = as_cmd->data[i];
+      if (opt != NULL && !starts_with(opt, "-o") && !is_output_neutral_option(opt))
+        vec_push(options, opt);
+    }
+  }
+  return options;
+}
+
+// Output file of the running compilation, which is removed if the process exits on an error.
+static const char *partial_output;
+
+static void remove_partial_output(void) {
+  if (partial_output != NULL)
+    remove(partial_output);
+}
+
+// Body of `compile_in_process`, with the source already set in `cpp_cmd`.
+static int compile_to_output(Vector *cpp_cmd, Vector *cc1_cmd, Vector *as_cmd, const char *ofn) {
+  char *pp_buf;
+  size_t pp_size;
+  FILE *pp_fp = open_memstream(&pp_buf, &pp_size);
+  int res = run_cpp(cpp_cmd->len - 1, (char**)cpp_cmd->data, pp_fp);
+  fclose(pp_fp);
+  if (res != 0)
+    return res;
+
+  char prefix_option[32];
+  create_local_label_prefix_option(0, prefix_option, sizeof(prefix_option));
+  cc1_cmd->data[cc1_cmd->len - 2] = prefix_option;
+
+  const char *cache_ext = NULL;
+  CacheKey key;
+  if (use_cache && ofn != NULL) {
+    cache_ext = as_cmd == NULL ? "s" : "o";
+    Vector *options = cache_key_options(cc1_cmd, as_cmd);
+    cache_make_key(&key, pp_buf, pp_size, options, cache_ext);
+    free_vector(options);
+    if (cache_fetch(&key, cache_ext, ofn)) {
+      free(pp_buf);
+      return 0;
+    }
+  }
+
+  FILE *cc1_ifp = fmemopen(pp_buf, pp_size, "r");
+  if (as_cmd == NULL) {
+    FILE *ofp = stdout;
+    if (ofn != NULL) {
+      ofp = fopen(ofn, "w");
+      if (ofp == NULL) {
+        perror("Failed to open output file");
+        fclose(cc1_ifp);
+        free(pp_buf);
+        return 1;
+      }
+    }
+    res = run_cc1(cc1_cmd->len - 1, (char**)cc1_cmd->data, cc1_ifp, ofp);
+    fclose(cc1_ifp);
+    free(pp_buf);
+    if (ofp != stdout)
+      fclose(ofp);
+  } else {
+    char *asm_buf;
+    size_t asm_size;
+    FILE *asm_fp = open_memstream(&asm_buf, &asm_size);
+    res = run_cc1(cc1_cmd->len - 1, (char**)cc1_cmd->data, cc1_ifp, asm_fp);
+    fclose(cc1_ifp);
+    fclose(asm_fp);
+    free(pp_buf);
+    if (res != 0)
+      return res;
+
+    FILE *as_ifp = fmemopen(asm_buf, asm_size, "r");
+    res = run_as(as_cmd->len - 1, (char**)as_cmd->data, as_ifp);
+    fclose(as_ifp);
+    free(asm_buf);
+  }
+
+  if (res == 0 && cache_ext != NULL)
+    cache_store(&key, cache_ext, ofn);
+  return res;
+}
+
+// Run cpp, cc1 and as in this process, passing intermediate text through memory.
+// cc1_cmd == NULL => preprocess only, as_cmd == NULL => output assembly code.
+// ofn: Output file for assembly code or object file, which can be cached.
+static int compile_in_process(const char *src, Vector *cpp_cmd, Vector *cc1_cmd, Vector *as_cmd,
+                              const char *ofn) {
+  cpp_cmd->data[cpp_cmd->len - 2] = (void*)src;
+  if (cc1_cmd == NULL)
+    return run_cpp(cpp_cmd->len - 1, (char**)cpp_cmd->data, stdout);
+
+  // Errors in the tools call `exit`, so the output is removed also at exit.
+  static bool registered;
+  if (ofn != NULL && !registered) {
+    atexit(remove_partial_output);
+    registered = true;
+  }
+  partial_output = ofn;
+  int res = compile_to_output(cpp_cmd, cc1_cmd, as_cmd, ofn);
+  partial_output = NULL;
+  if (res != 0 && ofn != NULL)
+    remove(ofn);
+  return res;
+}
+#endif
+
+#if defined(TIME_REPORT)
+typedef struct {
+  char tool[8];
+  char name[32];
+  double wall, cpu;
+  long maxrss_kb, heap_kb, allocs;
+} ReportRow;
+
+static ReportRow *find_report_row(Vector *rows, const char *tool, const char *name) {
+  for (int i = 0; i < rows->len; ++i) {
+    ReportRow *row = rows->data[i];
+    if (strcmp(row->tool, tool) == 0 && strcmp(row->name, name) == 0)
+      return row;
+  }
+  ReportRow *row = calloc(1, sizeof(*row));
+  snprintf(row->tool, sizeof(row->tool), "%s", tool);
+  snprintf(row->name, sizeof(row->name), "%s", name);
+  vec_push(rows, row);
+  return row;
+}
+
+// Merge records written by each tool (see `finish_time_report`) into one table.
+static void print_time_report(const char *path) {
+  FILE *fp = fopen(path, "r");
+  if (fp == NULL)
+    return;
+
+  Vector *phases = new_vector();  // <ReportRow*>
+  Vector *stats = new_vector();  // <ReportRow*>, per tool
+  char *line = NULL;
+  size_t capa = 0;
+  while (getline(&line, &capa, fp) != -1) {
+    char kind[8], tool[8], name[32];
+    double a, b;
+    long value;
+    if (sscanf(line, "phase %7s %31s %lf %lf", tool, name, &a, &b) == 4) {
+      ReportRow *row = find_report_row(phases, tool, name);
+      row->wall += a;
+      row->cpu += b;
+    } else if (sscanf(line, "%7s %7s %31s %ld", kind, tool, name, &value) == 4 &&
+               strcmp(kind, "stat") == 0) {
+      ReportRow *row = find_report_row(stats, tool, "");
+      if (strcmp(name, "maxrss_kb") == 0)
+        row->maxrss_kb = MAX(row->maxrss_kb, value);
+      else if (strcmp(name, "heap_kb") == 0)
+        row->heap_kb += value;
+      else if (strcmp(name, "allocs") == 0)
+        row->allocs += value;
+    }
+  }
+  free(line);
+  fclose(fp);
+
+  double total_wall = 0, total_cpu = 0;
+  fprintf(stderr, "%-5s %-26s %10s %10s\n", "tool", "phase", "wall(ms)", "cpu(ms)");
+  for (int i = 0; i < phases->len; ++i) {
+    ReportRow *row = phases->data[i];
+    fprintf(stderr, "%-5s %-26s %10.3f %10.3f\n", row->tool, row->name, row->wall * 1000,
+            row->cpu * 1000);
+    total_wall += row->wall;
+    total_cpu += row->cpu;
+  }
+  fprintf(stderr, "%-5s %-26s %10.3f %10.3f\n", "", "total", total_wall * 1000, total_cpu * 1000);
+  fprintf(stderr, "\n%-5s %14s %14s %14s\n", "tool", "peak RSS(KB)", "heap(KB)", "allocations");
+  for (int i = 0; i < stats->len; ++i) {
+    ReportRow *row = stats->data[i];
+    fprintf(stderr, "%-5s %14ld %14ld %14ld\n", row->tool, row->maxrss_kb, row->heap_kb,
+            row->allocs);
+  }
+}
+#endif
+
 void usage(FILE *fp) {
   fprintf(
       fp,
@@ -204,6 +504,14 @@ void usage(FILE *fp) {
       "  -c                  Output object file\n"
       "  -S                  Output assembly code\n"
       "  -E                  Output preprocess result\n"
+      "  -O<level>           Optimize (0: none, 1: SSA-based constant and copy propagation,\n"
+      "                      local value numbering, loop invariant code motion,\n"
+      "                      strength reduction, dead code and store elimination)\n"
+      "  --precompile        Output precompiled header (Default: header.pch)\n"
+      "  -j<N>               Compile up to N files in parallel\n"
+      "  --cache-stats       Show statistics of the compilation cache\n"
+      "  --time-report       Show time and memory usage of each phase\n"
+      "  --server=<socket>   Run as a compile server with warm headers (given as files)\n"
   );
 }
 
@@ -213,6 +521,11 @@ int main(int argc, char *argv[]) {
   bool out_obj = false;
   bool out_asm = false;
   bool run_asm = true;
+  bool precompile = false;
+  bool time_report = false;
+  bool use_server = true;
+  const char *server_path = NULL;
+  int njobs = 1;
   int iarg;
 
   const char *root = dirname(strdup_(argv[0]));
@@ -251,17 +564,59 @@ int main(int argc, char *argv[]) {
     } else if (starts_with(arg, "-o")) {
       ofn = arg + 2;
       vec_push(as_cmd, arg);
+    } else if (starts_with(arg, "-j")) {
+      const char *num = arg[2] != '\0' ? &arg[2] : (iarg + 1 < argc ? argv[++iarg] : "");
+      njobs = atoi(num);
+      if (njobs <= 0) {
+        fprintf(stderr, "Illegal job count: %s\n", num);
+        return 1;
+      }
+    } else if (strcmp(arg, "--precompile") == 0) {
+      precompile = true;
+      run_asm = false;
     } else if (strcmp(arg, "-E") == 0) {
       out_pp = true;
       run_asm = false;
     } else if (strcmp(arg, "-S") == 0) {
       out_asm = true;
       run_asm = false;
+    } else if (starts_with(arg, "-O")) {
+      use_server = false;
+      vec_push(cc1_cmd, arg);
     } else if (strcmp(arg, "--dump-ir") == 0) {
       run_asm = false;
+      use_server = false;
       vec_push(cc1_cmd, arg);
     } else if (starts_with(arg, "--local-label-prefix")) {
+      use_server = false;
       vec_push(cc1_cmd, arg);
+    } else if (starts_with(arg, "--server=")) {
+#if defined(IN_PROCESS)
+      server_path = arg + 9;
+#else
+      fprintf(stderr, "option not supported: %s\n", arg);
+      return 1;
+#endif
+    } else if (strcmp(arg, "--time-report") == 0) {
+#if defined(TIME_REPORT)
+      time_report = true;
+      use_server = false;
+#else
+      fprintf(stderr, "option not supported: %s\n", arg);
+      return 1;
+#endif
+    } else if (strcmp(arg, "--cache-stats") == 0) {
+#if defined(IN_PROCESS)
+      if (!cache_init()) {
+        fprintf(stderr, "XCC_CACHE_DIR is not set\n");
+        return 1;
+      }
+      cache_show_stats(stdout);
+      return 0;
+#else
+      fprintf(stderr, "option not supported: %s\n", arg);
+      return 1;
+#endif
     } else if (strcmp(arg, "--help") == 0) {
       usage(stdout);
       return 0;
@@ -281,7 +636,9 @@ int main(int argc, char *argv[]) {
   }
 
   if (ofn == NULL) {
-    if (out_obj) {
+    if (precompile) {
+      ofn = change_ext(argv[iarg], "pch");
+    } else if (out_obj) {
       if (iarg < argc)
         ofn = change_ext(basename(argv[iarg]), "o");
       else
@@ -299,7 +656,38 @@ int main(int argc, char *argv[]) {
     sb_init(&sb);
     sb_append(&sb, "-o", NULL);
     sb_append(&sb, ofn, NULL);
-    vec_push(as_cmd, sb_to_string(&sb));
+    vec_push(as_cmd, sb_steal(&sb));
+  }
+
+  char *time_report_path = NULL;
+#if defined(TIME_REPORT)
+  if (time_report) {
+    char path[] = "/tmp/xcc-report-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+      error("Cannot create temporary file");
+    close(fd);
+    time_report_path = strdup_(path);
+
+    StringBuffer sb;
+    sb_init(&sb);
+    sb_append(&sb, "--time-report=", NULL);
+    sb_append(&sb, time_report_path, NULL);
+    char *option = sb_steal(&sb);
+    vec_push(cpp_cmd, option);
+    vec_push(cc1_cmd, option);
+#if !defined(AS_USE_CC)
+    vec_push(as_cmd, option);
+#endif
+  }
+#endif
+
+  if (precompile) {
+    StringBuffer sb;
+    sb_init(&sb);
+    sb_append(&sb, "--precompile=", NULL);
+    sb_append(&sb, ofn, NULL);
+    vec_push(cpp_cmd, sb_steal(&sb));
   }
 
   vec_push(cpp_cmd, NULL);  // Buffer for src.
@@ -311,6 +699,40 @@ int main(int argc, char *argv[]) {
 #endif
   vec_push(as_cmd, NULL);  // Terminator.
 
+  if (precompile) {
+    if (argc - iarg != 1) {
+      fprintf(stderr, "Precompile requires one header\n");
+      return 1;
+    }
+    return compile(argv[iarg], cpp_cmd, NULL, STDOUT_FILENO) == 0 ? 0 : 1;
+  }
+
+#if defined(IN_PROCESS)
+  if (server_path != NULL) {
+    return run_server(server_path, cpp_cmd, cc1_cmd, as_cmd, &argv[iarg], argc - iarg,
+                      compile_in_process);
+  }
+
+  if (argc - iarg == 1 && strcasecmp(get_ext(argv[iarg]), "c") == 0) {
+    const char *server = getenv("XCC_SERVER");
+    if (server != NULL && use_server && (out_asm || out_obj)) {
+      int res = request_server(server, argv[iarg], ofn, out_obj, cpp_cmd);
+      if (res >= 0)
+        return res == 0 ? 0 : 1;
+      // Fall back to compile by itself.
+    }
+
+    use_cache = cache_init();
+    int res = compile_in_process(argv[iarg], cpp_cmd, out_pp ? NULL : cc1_cmd,
+                                 run_asm ? as_cmd : NULL, out_asm || out_obj ? ofn : NULL);
+    if (time_report_path != NULL) {
+      print_time_report(time_report_path);
+      unlink(time_report_path);
+    }
+    return res == 0 ? 0 : 1;
+  }
+#endif
+
   int ofd = STDOUT_FILENO;
   int as_fd[2];
   pid_t as_pid = -1;
@@ -331,23 +753,18 @@ int main(int argc, char *argv[]) {
 
   int res = 0;
   if (iarg < argc) {
-    for (int i = iarg; i < argc; ++i) {
-      char *src = argv[i];
-      char *ext = get_ext(src);
-      if (strcasecmp(ext, "c") == 0) {
-        char prefix_option[32];
-        create_local_label_prefix_option(i - iarg, prefix_option, sizeof(prefix_option));
-        cc1_cmd->data[cc1_cmd->len - 2] = prefix_option;
-
-        res = compile(src, cpp_cmd, out_pp ? NULL : cc1_cmd, ofd);
-      } else if (strcasecmp(ext, "s") == 0) {
-        res = cat(src, ofd);
-      } else {
-        fprintf(stderr, "Unsupported file type: %s\n", src);
-        res = -1;
+#if defined(PARALLEL_COMPILE)
+    if (njobs > 1 && argc - iarg > 1) {
+      res = process_sources_parallel(&argv[iarg], argc - iarg, njobs, cpp_cmd, cc1_cmd, out_pp,
+                                     ofd);
+    } else
+#endif
+    {
+      for (int i = iarg; i < argc; ++i) {
+        res = process_source(i - iarg, argv[i], cpp_cmd, out_pp ? NULL : cc1_cmd, ofd);
+        if (res != 0)
+          break;
       }
-      if (res != 0)
-        break;
     }
   } else {
     // cpp is read from stdin.
@@ -372,5 +789,12 @@ int main(int argc, char *argv[]) {
 
     res = wait_process(as_pid);
   }
+
+#if defined(TIME_REPORT)
+  if (time_report_path != NULL) {
+    print_time_report(time_report_path);
+    unlink(time_report_path);
+  }
+#endif
   return res == 0 ? 0 : 1;
 }
@@ -0,0 +1,381 @@
+#include "server.h"
+
+#if !defined(SELF_HOSTING) && !defined(__XV6)
+
+#include <errno.h>
+#include <libgen.h>  // dirname
+#include <limits.h>  // PATH_MAX
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "util.h"
+
+extern int run_cpp(int argc, char *argv[], FILE *ofp);
+extern void warm_up_cpp(void);
+extern bool is_include_skipped(const char *filename);
+extern void warm_up_cc1(FILE *ifp, const char *filename);
+
+// Request:  Lines of "xcc-server", cwd, source, output, mode ("S" or "c"),
+//           followed by the options for cpp.
+// Response: Diagnostics, followed by a status byte.
+static const char MAGIC[] = "xcc-server";
+
+enum {
+  STATUS_OK,
+  STATUS_FAILED,
+  STATUS_REJECTED,  // Client should compile by itself.
+};
+
+static void append_line(StringBuffer *sb, const char *line) {
+  sb_append(sb, line, NULL);
+  sb_append(sb, "\n", NULL);
+}
+
+// Options for cpp are in `cpp_cmd[1 .. len - 2)`, the rest are buffers for the source.
+static void append_cpp_options(StringBuffer *sb, Vector *cpp_cmd) {
+  for (int i = 1; i < cpp_cmd->len - 2; ++i)
+    append_line(sb, (char*)cpp_cmd->data[i]);
+}
+
+static int open_socket(const char *sock_path, struct sockaddr_un *addr) {
+  if (strlen(sock_path) >= sizeof(addr->sun_path))
+    error("Socket path too long: %s", sock_path);
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  strcpy(addr->sun_path, sock_path);
+  return socket(AF_UNIX, SOCK_STREAM, 0);
+}
+
+static bool write_all(int fd, const char *buf, size_t size) {
+  while (size > 0) {
+    ssize_t n = write(fd, buf, size);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    buf += n;
+    size -= n;
+  }
+  return true;
+}
+
+static char *read_all(int fd, size_t *psize) {
+  size_t size = 0, capa = 256;
+  char *buf = malloc(capa);
+  for (;;) {
+    if (size + 1 >= capa)
+      buf = realloc(buf, capa *= 2);
+    ssize_t n = read(fd, buf + size, capa - size - 1);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    if (n == 0)
+      break;
+    size += n;
+  }
+  buf[size] = '\0';
+  *psize = size;
+  return buf;
+}
+
+// Server
+
+static Vector *server_cpp_cmd;
+static Vector *server_cc1_cmd;
+static Vector *server_as_cmd;
+static ServerCompileFunc server_compile;
+static char *server_options;
+static struct stat *warm_headers;  // Identities of the headers, in order.
+static int warm_header_count;
+static bool warm_usable;  // The warm state is usable only when all headers are guarded.
+
+// Skips whitespaces and comments.  `in_comment` tells a block comment continues across lines.
+static const char *skip_blank(const char *p, bool *in_comment) {
+  for (;;) {
+    if (*in_comment) {
+      const char *end = strstr(p, "*/");
+      if (end == NULL)
+        return p + strlen(p);
+      p = end + 2;
+      *in_comment = false;
+    }
+    p = skip_whitespaces(p);
+    if (p[0] == '/' && p[1] == '*') {
+      *in_comment = true;
+      p += 2;
+    } else if (p[0] == '/' && p[1] == '/') {
+      return p + strlen(p);
+    } else {
+      return p;
+    }
+  }
+}
+
+// Returns `#include`s (with delimiters, e.g. `<stdio.h>`) at the top of the source,
+// before any other line except blank or comment ones.
+static Vector *leading_includes(const char *src, int max) {
+  Vector *includes = new_vector();
+  FILE *fp = fopen(src, "r");
+  if (fp == NULL)
+    return includes;
+  char *line = NULL;
+  size_t capa = 0;
+  bool in_comment = false;
+  while (includes->len < max && getline(&line, &capa, fp) >= 0) {
+    const char *p = skip_blank(line, &in_comment);
+    if (*p == '\0')
+      continue;
+    if (*p != '#')
+      break;
+    p = skip_blank(p + 1, &in_comment);
+    if (strncmp(p, "include", 7) != 0)
+      break;
+    p = skip_blank(p + 7, &in_comment);
+    const char *q = *p == '<' ? strchr(p + 1, '>') : *p == '"' ? strchr(p + 1, '"') : NULL;
+    if (q == NULL)
+      break;
+    vec_push(includes, strndup_(p, q + 1 - p));
+    skip_blank(q + 1, &in_comment);
+  }
+  free(line);
+  fclose(fp);
+  return includes;
+}
+
+static bool stat_in(const char *dir, const char *path, struct stat *st) {
+  if (*path != '/') {
+    StringBuffer sb;
+    sb_init(&sb);
+    sb_append(&sb, dir, NULL);
+    sb_append(&sb, "/", NULL);
+    sb_append(&sb, path, NULL);
+    path = sb_steal(&sb);
+  }
+  return stat(path, st) == 0;
+}
+
+// Whether `#include` in the source finds the header, searching the same way as cpp.
+static bool includes_header(const char *include, const char *src, const struct stat *header) {
+  char *path = strndup_(include + 1, strlen(include) - 2);
+  struct stat st;
+  bool found = *include == '"' && stat_in(dirname(strdup_(src)), path, &st);
+  for (int i = 1; !found && i < server_cpp_cmd->len - 2; ++i) {
+    const char *opt = server_cpp_cmd->data[i];
+    if (starts_with(opt, "-I"))
+      found = stat_in(opt + 2, path, &st);
+  }
+  return found && st.st_dev == header->st_dev && st.st_ino == header->st_ino;
+}
+
+// The warm state is what the source would have after including the headers, so it is usable
+// only when the source starts with including just them, in the same order.
+static bool starts_with_warm_headers(const char *src) {
+  Vector *includes = leading_includes(src, warm_header_count);
+  if (includes->len != warm_header_count)
+    return false;
+  for (int i = 0; i < warm_header_count; ++i) {
+    if (!includes_header(includes->data[i], src, &warm_headers[i]))
+      return false;
+  }
+  return true;
+}
+
+static Vector *new_cmd(const char *path, const char *arg) {
+  Vector *cmd = new_vector();
+  vec_push(cmd, path);
+  vec_push(cmd, arg);
+  vec_push(cmd, NULL);  // Terminator.
+  return cmd;
+}
+
+static int handle_request(int conn, char *request) {
+  char *lines[5];
+  char *p = request;
+  for (int i = 0; i < 5; ++i) {
+    char *nl = strchr(p, '\n');
+    if (nl == NULL)
+      return STATUS_REJECTED;
+    *nl = '\0';
+    lines[i] = p;
+    p = nl + 1;
+  }
+  const char *cwd = lines[1], *src = lines[2], *ofn = lines[3], *mode = lines[4];
+  // The warm state is valid only for the same options.
+  if (strcmp(lines[0], MAGIC) != 0 || strcmp(p, server_options) != 0)
+    return STATUS_REJECTED;
+
+  // Other sources are compiled by the client itself, from a fresh state.
+  if (!warm_usable || chdir(cwd) != 0 || !starts_with_warm_headers(src))
+    return STATUS_REJECTED;
+
+  pid_t pid = fork();
+  if (pid < 0)
+    return STATUS_REJECTED;
+  if (pid == 0) {
+    dup2(conn, STDERR_FILENO);
+    Vector *as_cmd = NULL;
+    if (strcmp(mode, "c") == 0) {
+      StringBuffer sb;
+      sb_init(&sb);
+      sb_append(&sb, "-o", NULL);
+      sb_append(&sb, ofn, NULL);
+      as_cmd = new_cmd(server_as_cmd->data[0], "-c");
+      vec_insert(as_cmd, 2, sb_steal(&sb));
+    }
+    // Second elements are buffers for the source and the label prefix.
+    int res = server_compile(src, new_cmd(server_cpp_cmd->data[0], NULL),
+                             new_cmd(server_cc1_cmd->data[0], NULL), as_cmd, ofn);
+    fflush(stderr);
+    exit(res == 0 ? 0 : 1);
+  }
+
+  int status;
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR)
+      return STATUS_FAILED;
+  }
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? STATUS_OK : STATUS_FAILED;
+}
+
+static void warm_up(Vector *cpp_cmd, char **headers, int header_count) {
+  Vector *argv = new_vector();
+  for (int i = 0; i < cpp_cmd->len - 2; ++i)
+    vec_push(argv, cpp_cmd->data[i]);
+  for (int i = 0; i < header_count; ++i)
+    vec_push(argv, headers[i]);
+  vec_push(argv, NULL);
+
+  char *pp_buf;
+  size_t pp_size;
+  FILE *pp_fp = open_memstream(&pp_buf, &pp_size);
+  int res = run_cpp(argv->len - 1, (char**)argv->data, pp_fp);
+  fclose(pp_fp);
+  if (res != 0)
+    exit(1);
+
+  FILE *ifp = fmemopen(pp_buf, pp_size, "r");
+  warm_up_cc1(ifp, "*prelude*");
+  fclose(ifp);
+  warm_up_cpp();
+}
+
+int run_server(const char *sock_path, Vector *cpp_cmd, Vector *cc1_cmd, Vector *as_cmd,
+               char **headers, int header_count, ServerCompileFunc compile) {
+  server_cpp_cmd = cpp_cmd;
+  server_cc1_cmd = cc1_cmd;
+  server_as_cmd = as_cmd;
+  server_compile = compile;
+  {
+    StringBuffer sb;
+    sb_init(&sb);
+    append_cpp_options(&sb, cpp_cmd);
+    server_options = sb_steal(&sb);
+  }
+
+  warm_header_count = header_count;
+  warm_headers = calloc(header_count, sizeof(*warm_headers));
+  for (int i = 0; i < header_count; ++i) {
+    if (stat(headers[i], &warm_headers[i]) != 0)
+      error("Cannot open file: %s", headers[i]);
+  }
+  warm_up(cpp_cmd, headers, header_count);
+
+  // The source includes the headers again on the warm state, which redefines
+  // their contents unless they have an include guard or `#pragma once`.
+  warm_usable = true;
+  for (int i = 0; i < header_count; ++i) {
+    if (!is_include_skipped(headers[i])) {
+      fprintf(stderr, "Warning: %s has no include guard, all requests are rejected\n",
+              headers[i]);
+      warm_usable = false;
+    }
+  }
+
+  struct sockaddr_un addr;
+  int sock = open_socket(sock_path, &addr);
+  unlink(sock_path);
+  // Requests make the server write files, so only the owner may connect.
+  mode_t mask = umask(077);
+  int bound = sock >= 0 ? bind(sock, (struct sockaddr*)&addr, sizeof(addr)) : -1;
+  umask(mask);
+  if (bound < 0 || listen(sock, 16) < 0) {
+    perror(sock_path);
+    return 1;
+  }
+  signal(SIGCHLD, SIG_IGN);  // Reap handlers automatically.
+
+  for (;;) {
+    int conn = accept(sock, NULL, NULL);
+    if (conn < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("accept");
+      return 1;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+      close(sock);
+      signal(SIGCHLD, SIG_DFL);  // To wait the compiling process.
+      size_t size;
+      char *request = read_all(conn, &size);
+      char status = handle_request(conn, request);
+      write_all(conn, &status, 1);
+      exit(0);
+    }
+    close(conn);
+  }
+}
+
+// Client
+
+int request_server(const char *sock_path, const char *src, const char *ofn, bool out_obj,
+                   Vector *cpp_cmd) {
+  struct sockaddr_un addr;
+  int sock = open_socket(sock_path, &addr);
+  if (sock < 0)
+    return -1;
+  if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+    close(sock);
+    return -1;
+  }
+
+  char cwd[PATH_MAX];
+  if (getcwd(cwd, sizeof(cwd)) == NULL)
+    error("getcwd failed");
+
+  StringBuffer sb;
+  sb_init(&sb);
+  append_line(&sb, MAGIC);
+  append_line(&sb, cwd);
+  append_line(&sb, src);
+  append_line(&sb, ofn);
+  append_line(&sb, out_obj ? "c" : "S");
+  append_cpp_options(&sb, cpp_cmd);
+  char *request = sb_steal(&sb);
+
+  int res = -1;
+  if (write_all(sock, request, strlen(request)) && shutdown(sock, SHUT_WR) == 0) {
+    size_t size;
+    char *response = read_all(sock, &size);
+    if (size > 0 && response[size - 1] != STATUS_REJECTED) {
+      fwrite(response, 1, size - 1, stderr);
+      res = response[size - 1];
+    }
+    free(response);
+  }
+  close(sock);
+  return res;
+}
+
+#endif
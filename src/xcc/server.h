@@ -0,0 +1,24 @@
+// Compile server
+//
+// `xcc --server=<socket> headers...` preprocesses and parses the given headers
+// once, and then waits for requests on the Unix domain socket.  Each request is
+// compiled in a forked process, which inherits the warm state (names, macros,
+// `#pragma once` files, typedefs, structs and declarations in global scope).
+// Sources which don't start with including just those headers are rejected.
+// Clients are `xcc -S` or `xcc -c` with `XCC_SERVER=<socket>`.
+
+#pragma once
+
+#include <stdbool.h>
+
+typedef struct Vector Vector;
+
+typedef int (*ServerCompileFunc)(const char *src, Vector *cpp_cmd, Vector *cc1_cmd,
+                                 Vector *as_cmd, const char *ofn);
+
+int run_server(const char *sock_path, Vector *cpp_cmd, Vector *cc1_cmd, Vector *as_cmd,
+               char **headers, int header_count, ServerCompileFunc compile);
+
+// Returns -1 if the server is not available, or exit status of the compilation.
+int request_server(const char *sock_path, const char *src, const char *ofn, bool out_obj,
+                   Vector *cpp_cmd);
@@ -27,6 +27,29 @@ try() {
   fi
 }
 
+# Counts how many times the header is read, when it is included twice.
+include_twice() {
+  local title="$1"
+  local expected="$2"
+  local header="$3"
+
+  echo -n "$title => "
+
+  local dir=$(mktemp -d)
+  echo -e "$header" > "$dir/guarded.h"
+  local actual
+  actual=$(echo -e "#include \"$dir/guarded.h\"\n#include \"$dir/guarded.h\"" | $CPP |
+           grep -c "^# 1 \"$dir/guarded.h\" 1")
+  rm -rf "$dir"
+
+  if [ "$actual" = "$expected" ]; then
+    echo "OK"
+  else
+    echo "NG: $expected expected, but got $actual"
+    exit 1
+  fi
+}
+
 compile_error() {
   local title="$1"
   local input="$2"
@@ -72,4 +95,8 @@ try 'Concat' 'FOO_123' '#define FOO(x)  FOO_ ## x\nFOO( 123 )'
 try 'Stringify' '"1 + 2"' '#define S(x)  #x\nS(1 + 2)'
 try 'Stringify escaped' '"\"abc\""' '#define S(x)  #x\nS("abc")'
 
+include_twice 'Include guard' 1 '#ifndef G\n#define G\nint x;\n#endif'
+include_twice 'Include guard with comments' 1 '/*\n * License\n */\n// Comment\n#ifndef G\n#define G\nint x;\n#endif  /* G */\n/* Trailing */'
+include_twice 'Code after comment' 2 '/* Comment\n */ int y;\n#ifndef G\n#define G\nint x;\n#endif'
+
 compile_error '#error' '#error !!!\nvoid main(){}'
@@ -0,0 +1,59 @@
+// Lexer benchmark: tokenizes the given files repeatedly and reports the throughput.
+//   $ ./lexer_bench [-n count] file...
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lexer.h"
+#include "util.h"
+
+static double now(void) {
+  return (double)clock() / CLOCKS_PER_SEC;
+}
+
+static size_t lex_file(const char *filename, long *ptokens) {
+  FILE *fp = fopen(filename, "r");
+  if (fp == NULL)
+    error("Cannot open file: %s\n", filename);
+  fseek(fp, 0, SEEK_END);
+  size_t size = ftell(fp);
+  rewind(fp);
+
+  set_source_file(fp, filename);
+  long count = 0;
+  while (match(-1)->kind != TK_EOF)
+    ++count;
+  fclose(fp);
+  *ptokens += count;
+  return size;
+}
+
+int main(int argc, char *argv[]) {
+  int iarg = 1;
+  int repeat = 10;
+  if (iarg + 1 < argc && strcmp(argv[iarg], "-n") == 0) {
+    repeat = atoi(argv[iarg + 1]);
+    iarg += 2;
+  }
+  if (iarg >= argc) {
+    fprintf(stderr, "Usage: %s [-n count] file...\n", argv[0]);
+    return 1;
+  }
+
+  init_lexer();
+
+  size_t total = 0;
+  long tokens = 0;
+  double start = now();
+  for (int i = 0; i < repeat; ++i) {
+    for (int j = iarg; j < argc; ++j)
+      total += lex_file(argv[j], &tokens);
+  }
+  double elapsed = now() - start;
+
+  printf("%zu bytes, %ld tokens in %.3f s: %.1f MB/s\n", total, tokens, elapsed,
+         total / elapsed / (1024 * 1024));
+  return 0;
+}
@@ -60,7 +60,7 @@ void print_type_test(void) {
     Vector *param_types = new_vector();
     vec_push(param_types, &tyInt);
     Type* func = new_func_type(&tyVoid, NULL, param_types, false);
-    Type* funcptr = ptrof(func);
+    const Type* funcptr = ptrof(func);
     check_print_type("void(*)(int)", funcptr);
   }
 
@@ -86,8 +86,44 @@ void print_type_test(void) {
   }
 }
 
+void check_same(const char *title, bool expected, bool actual) {
+  printf("%s - ", title);
+  if (actual != expected) {
+    fprintf(stderr, "ERROR: %s expected\n", expected ? "true" : "false");
+    exit(1);
+  }
+  printf("OK\n");
+}
+
+void intern_type_test(void) {
+  check_same("ptr shared", true, ptrof(&tyInt) == ptrof(&tyInt));
+  check_same("ptr to ptr shared", true, ptrof(ptrof(&tyChar)) == ptrof(ptrof(&tyChar)));
+  check_same("ptr to const", false, ptrof(&tyInt) == ptrof(qualified_type(&tyInt, TQ_CONST)));
+  check_same("const ptr", false, ptrof(&tyInt) == qualified_type(ptrof(&tyInt), TQ_CONST));
+  check_same("const ptr shared", true,
+             qualified_type(ptrof(&tyInt), TQ_CONST) == qualified_type(ptrof(&tyInt), TQ_CONST));
+
+  TypeTable table;
+  type_table_init(&table);
+  Vector *param_types = new_vector();
+  vec_push(param_types, &tyInt);
+  vec_push(param_types, ptrof(&tyChar));
+  type_table_put(&table, new_func_type(&tyVoid, NULL, param_types, false), "f");
+
+  Vector *param_types2 = new_vector();
+  vec_push(param_types2, &tyInt);
+  vec_push(param_types2, ptrof(qualified_type(&tyChar, TQ_CONST)));
+  void *value = NULL;
+  check_same("same func type", true,
+             type_table_try_get(&table, new_func_type(&tyVoid, NULL, param_types2, false), &value) &&
+             strcmp(value, "f") == 0);
+  check_same("other func type", false,
+             type_table_try_get(&table, new_func_type(&tyInt, NULL, param_types2, false), &value));
+}
+
 void runtest(void) {
   print_type_test();
+  intern_type_test();
 }
 
 int main(void) {
@@ -0,0 +1,40 @@
+#!/bin/bash
+
+XCC=${XCC:-../xcc}
+
+# Compiles a source including the header, through a server warmed with it.
+try_server() {
+  local title="$1"
+  local header="$2"
+
+  echo -n "$title => "
+
+  local dir=$(mktemp -d)
+  echo -e "$header" > $dir/header.h
+  echo -e '#include "header.h"\nint main(void){ struct S s = {42}; return s.x; }' > $dir/main.c
+
+  $XCC --server=$dir/sock $dir/header.h 2>/dev/null &
+  local pid=$!
+  for i in $(seq 50); do
+    [ -S $dir/sock ] && break
+    sleep 0.1
+  done
+
+  XCC_SERVER=$dir/sock $XCC -S -o$dir/main.s $dir/main.c
+  local actual="$?"
+  kill $pid
+  wait $pid 2>/dev/null
+
+  if [ "$actual" = 0 ] && grep -q 'main:' $dir/main.s; then
+    echo "OK"
+    rm -rf $dir
+  else
+    echo "NG: exit status $actual"
+    rm -rf $dir
+    exit 1
+  fi
+}
+
+try_server 'guarded header' '#ifndef HEADER_H\n#define HEADER_H\nstruct S { int x; };\n#endif'
+try_server 'pragma once header' '#pragma once\nstruct S { int x; };'
+try_server 'unguarded header' 'struct S { int x; };'
@@ -0,0 +1,111 @@
+// Name table benchmark: interns and looks up identifiers, and reports the throughput.
+//   $ ./table_bench [-n count]
+//
+// Identifiers are drawn with Zipf distribution from a vocabulary which resembles C source:
+// keywords and short locals are the most frequent, and longer names follow.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "table.h"
+#include "util.h"
+
+#define VOCABULARY  (20000)
+
+static const char *kFrequentWords[] = {
+  "int", "i", "return", "if", "p", "char", "const", "len", "void", "n", "struct", "for",
+  "else", "size_t", "NULL", "buf", "j", "while", "static", "unsigned", "s", "x", "y", "data",
+  "sizeof", "break", "case", "type", "name", "bool", "true", "false", "long", "value",
+};
+
+static const char *kParts[] = {
+  "get", "set", "new", "alloc", "free", "init", "parse", "emit", "gen", "table", "name",
+  "expr", "stmt", "type", "token", "buf", "vec", "size", "count", "index", "entry", "node",
+  "list", "next", "prev", "line", "file", "reg", "label", "scope", "var", "func", "info",
+};
+
+static double now(void) {
+  return (double)clock() / CLOCKS_PER_SEC;
+}
+
+static unsigned int rand_state = 12345;
+static unsigned int next_rand(void) {
+  rand_state = rand_state * 1103515245u + 12345u;
+  return rand_state >> 8;
+}
+
+static char *make_word(int rank) {
+  int nfreq = sizeof(kFrequentWords) / sizeof(*kFrequentWords);
+  if (rank < nfreq)
+    return strdup_(kFrequentWords[rank]);
+
+  int nparts = sizeof(kParts) / sizeof(*kParts);
+  char buf[64];
+  int len = 0;
+  if (rank % 7 == 0)
+    len += snprintf(buf + len, sizeof(buf) - len, "__");
+  int words = 1 + next_rand() % 3;
+  for (int i = 0; i < words; ++i)
+    len += snprintf(buf + len, sizeof(buf) - len, "%s%s", i > 0 ? "_" : "",
+                    kParts[next_rand() % nparts]);
+  snprintf(buf + len, sizeof(buf) - len, "%d", rank);
+  return strdup_(buf);
+}
+
+int main(int argc, char *argv[]) {
+  long count = 10000000;
+  if (argc > 2 && strcmp(argv[1], "-n") == 0)
+    count = atol(argv[2]);
+
+  char **words = malloc(sizeof(*words) * VOCABULARY);
+  double *cumulative = malloc(sizeof(*cumulative) * VOCABULARY);
+  double sum = 0;
+  for (int i = 0; i < VOCABULARY; ++i) {
+    words[i] = make_word(i);
+    sum += 1.0 / (i + 1);
+    cumulative[i] = sum;
+  }
+
+  // Sequence of word indices in Zipf distribution.
+  int *seq = malloc(sizeof(*seq) * count);
+  for (long k = 0; k < count; ++k) {
+    double r = (next_rand() / (double)(1 << 24)) * sum;
+    int lo = 0, hi = VOCABULARY - 1;
+    while (lo < hi) {
+      int mid = (lo + hi) / 2;
+      if (cumulative[mid] < r)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    seq[k] = lo;
+  }
+
+  // Intern: as the lexer does for every identifier.
+  const Name **names = malloc(sizeof(*names) * count);
+  double start = now();
+  for (long k = 0; k < count; ++k) {
+    const char *word = words[seq[k]];
+    names[k] = alloc_name(word, word + strlen(word), false);
+  }
+  double intern_time = now() - start;
+
+  // Lookup: half of the vocabulary is in a table, like a scope.
+  Table table;
+  table_init(&table);
+  for (int i = 0; i < VOCABULARY; i += 2)
+    table_put(&table, alloc_name(words[i], NULL, false), words[i]);
+  long found = 0;
+  start = now();
+  for (long k = 0; k < count; ++k) {
+    if (table_get(&table, names[k]) != NULL)
+      ++found;
+  }
+  double lookup_time = now() - start;
+
+  printf("alloc_name: %.1f M/s, table_get: %.1f M/s (%ld lookups, %ld found)\n",
+         count / intern_time * 1e-6, count / lookup_time * 1e-6, count, found);
+  return 0;
+}
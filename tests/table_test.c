@@ -45,8 +45,35 @@ void test_table(void) {
   EXPECT(count_table_elems(&table) == 0);
 }
 
+// Enough keys to grow the table, and deletion shifts following entries back.
+void test_table_many(void) {
+  enum { N = 1000 };
+  const Name *keys[N];
+  for (int i = 0; i < N; ++i) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "key%d", i);
+    keys[i] = alloc_name(buf, NULL, true);
+  }
+  EXPECT(alloc_name("key123", NULL, false) == keys[123]);
+
+  Table table;
+  table_init(&table);
+  for (int i = 0; i < N; ++i)
+    EXPECT(table_put(&table, keys[i], (void*)keys[i]));
+  EXPECT(!table_put(&table, keys[0], (void*)keys[0]));
+  EXPECT(table.count == N);
+
+  for (int i = 0; i < N; i += 2)
+    EXPECT(table_delete(&table, keys[i]));
+  EXPECT(table.count == N / 2);
+  EXPECT(count_table_elems(&table) == N / 2);
+  for (int i = 0; i < N; ++i)
+    EXPECT(table_get(&table, keys[i]) == ((i & 1) != 0 ? keys[i] : NULL));
+}
+
 void runtest(void) {
   test_table();
+  test_table_many();
 
   printf("OK\n");
 }
@@ -77,6 +77,21 @@ void test_sb(void) {
 
   sb_clear(&sb);
   EXPECT(true, sb_empty(&sb));
+
+  // Grows over the initial capacity.
+  for (int i = 0; i < 100; ++i)
+    sb_append(&sb, "0123456789", NULL);
+  EXPECT(1000, (int)strlen(sb_to_string(&sb)));
+
+  sb_clear(&sb);
+  sb_reserve(&sb, 3);
+  sb_append(&sb, "xyz", NULL);
+  char *stolen = sb_steal(&sb);
+  EXPECT_STREQ("steal", "xyz", stolen);
+  EXPECT(true, sb_empty(&sb));
+  sb_append(&sb, "w", NULL);
+  EXPECT_STREQ("after steal", "w", sb_to_string(&sb));
+  EXPECT_STREQ("stolen kept", "xyz", stolen);
 }
 
 void test_escape(void) {
@@ -428,6 +428,12 @@ int main(void) {
     void *p = (void*)1234;
     expect("cast pointer", 1234L, (long)p);
   }
+  {
+    int x = 300, m = -1;
+    expect("cast narrow then widen", 44, (long)(unsigned char)300);
+    expect("cast narrow then widen var", 44, (long)(unsigned char)x);
+    expect("cast narrow unsigned", 4294967295L, (long)(unsigned int)m);
+  }
   expect("global cleared", 0, g_zero);
   expect("global initializer", 330, g_init);
   expect("global struct initializer: int", 42, g_struct.x);
@@ -462,6 +468,23 @@ int main(void) {
     expect("anonymous", 596, a.x);
     expect("anonymous adr", (long)&a, (long)&a.x);
   }
+  {
+    struct{
+      int x;
+      union{
+        struct{
+          char y;
+          int z;
+        };
+        long w;
+      };
+      int v;
+    } a, *p = &a;
+    p->z = 12;
+    a.v = 34;
+    expect("nested anonymous", 46, a.z + p->v);
+    expect("nested anonymous adr", (long)&a.w, (long)&p->y);
+  }
   expect("func pointer", 9, apply(&sub, 15, 6));
   expect("func pointer w/o &", 9, apply(sub, 15, 6));
   expect("block comment", 123, /* comment */ 123);
@@ -522,6 +545,35 @@ int main(void) {
     } while (++i <= 10);
     expect("do-while-continue", 50, acc);
   }
+  {
+    int a[4] = {1, 2, 3, 4}, n = 3, acc = 0;
+    for (int i = 0; i < 4; ++i) {
+      int *p = &n;
+      acc += a[i] * (*p + 1);
+      if (i == 1)
+        n = 10;
+    }
+    expect("loop invariant", 89, acc);
+  }
+  {
+    long a[3][4];
+    int n = 4, acc = 0;
+    for (int i = 0; i < 3; ++i)
+      for (int j = 0; j < n; ++j)
+        a[i][j] = i * 10 + j;
+    int k = 3;
+    do {
+      acc += a[2][k] - a[1][k - 1];
+    } while (--k > 0);
+    expect("induction variable", 33, acc);
+  }
+  {
+    int s = 1, *ps = &s;
+    int x = s & 2;
+    *ps = 3;
+    int y = s & 2;
+    expect("referenced var", 2, x * 10 + y);
+  }
   expect("t && t", 1, 1 && 2);
   {
     int x = 1;
@@ -31,14 +31,13 @@ bool is_prim_type(const Type *type) {
   return is_number(type) || type->kind == TY_PTR;
 }
 
+static TypeTable functype_table;  // <intptr_t>, index in `functypes`.
+
 int get_func_type_index(const Type *type) {
-  int len = functypes->len;
-  for (int i = 0; i < len; ++i) {
-    const Type *t = functypes->data[i];
-    if (same_type(t, type))
-      return i;
-  }
-  return -1;
+  void *index;
+  if (!type_table_try_get(&functype_table, type, &index))
+    return -1;
+  return (intptr_t)index;
 }
 
 static int register_func_type(const Type *type) {
@@ -46,6 +45,7 @@ static int register_func_type(const Type *type) {
   if (index < 0) {
     index = functypes->len;
     vec_push(functypes, type);
+    type_table_put(&functype_table, type, (void*)(intptr_t)index);
   }
   return index;
 }
@@ -789,7 +789,7 @@ static void init_compiler(void) {
 
 static void compile1(FILE *ifp, const char *filename, Vector *decls) {
   set_source_file(ifp, filename);
-  parse(decls);
+  parse(decls, NULL);
 }
 
 int main(int argc, char *argv[]) {